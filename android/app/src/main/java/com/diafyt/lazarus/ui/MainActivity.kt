@@ -17,6 +17,7 @@ import androidx.appcompat.app.AppCompatActivity
 import androidx.viewpager2.widget.ViewPager2
 import com.diafyt.lazarus.*
 import com.diafyt.lazarus.utils.ExceptionArchivist
+import com.diafyt.lazarus.utils.TransportStatistics
 import com.google.android.material.snackbar.Snackbar
 import com.google.android.material.tabs.TabLayout
 import com.google.android.material.tabs.TabLayoutMediator
@@ -59,6 +60,7 @@ class MainActivity : AppCompatActivity() {
         setContentView(R.layout.activity_main)
 
         ExceptionArchivist.initialize(getExternalFilesDir(null))
+        TransportStatistics.initialize(getExternalFilesDir(null))
         initFragments()
 
         val adapter = NfcAdapter.getDefaultAdapter(this)
@@ -182,6 +184,16 @@ class MainActivity : AppCompatActivity() {
                 startActivity(intent)
                 true
             }
+            R.id.action_export_transport_statistics -> {
+                val file = TransportStatistics.export()
+                val s = if (file != null) {
+                    getString(R.string.snackbar_transport_statistics_exported, file.path)
+                } else {
+                    getString(R.string.snackbar_transport_statistics_failed)
+                }
+                Snackbar.make(viewPager, s, Snackbar.LENGTH_LONG).show()
+                true
+            }
             else -> super.onOptionsItemSelected(item)
         }
     }
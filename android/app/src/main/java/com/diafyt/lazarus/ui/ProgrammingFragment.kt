@@ -35,6 +35,11 @@ class ProgrammingFragment : AbstractMainFragment() {
     ): View? {
         val ret = inflater.inflate(R.layout.fragment_programming, container, false)
         progressBar = ret.findViewById(R.id.sensor_progress)
+        // compile the plan ahead of the first tap
+        val context = requireContext().applicationContext
+        lifecycleScope.launch(Dispatchers.IO) {
+            PlanCache.get(context, payloadAsset)
+        }
         return ret
     }
 
@@ -46,53 +51,61 @@ class ProgrammingFragment : AbstractMainFragment() {
             )
             return
         }
+        val tapTime = System.currentTimeMillis()
+        val tapNanos = System.nanoTime()
         job = viewLifecycleOwner.lifecycleScope.launch {
             progressBar.visibility = View.VISIBLE
             try {
-                activity?.let {
-                    val programKey =
-                        Util.retrieveProgramKey(tag)
-                    if (programKey == null) {
-                        Util.showInfoDialog(
-                            it,
-                            R.string.dialog_title_no_libre1,
-                            R.string.message_no_libre1
-                        )
-                        return@launch
-                    }
-                    if (programKey <= Util.libreRuntime) {
-                        Util.showInfoDialog(
-                            it,
-                            R.string.dialog_title_libre1_running,
-                            R.string.message_libre1_running
-                        )
-                        return@launch
-                    }
-                    if (programKey >= floor(2.0.pow(15.0))) {
-                        val msg = if (programKey == Util.thermometerProgramKey) {
-                            R.string.message_confirm_self_overwrite
-                        } else {
-                            R.string.message_confirm_foreign_overwrite
+                // the key check and the delivery share one connection unless the user is asked
+                NFCSession.use(tag) {
+                    activity?.let {
+                        val signature =
+                            Util.retrieveProgramKeyAndHeader(tag)
+                        if (signature == null) {
+                            Util.showInfoDialog(
+                                it,
+                                R.string.dialog_title_no_libre1,
+                                R.string.message_no_libre1
+                            )
+                            return@launch
+                        }
+                        val (programKey, header) = signature
+                        if (programKey <= Util.libreRuntime) {
+                            Util.showInfoDialog(
+                                it,
+                                R.string.dialog_title_libre1_running,
+                                R.string.message_libre1_running
+                            )
+                            return@launch
                         }
-                        AlertDialog.Builder(it).apply {
-                            setNegativeButton(R.string.button_title_no) { _, _ -> }
-                            setPositiveButton(R.string.button_title_yes) { _, _ ->
-                                job = viewLifecycleOwner.lifecycleScope.launch {
-                                    progressBar.visibility = View.VISIBLE
-                                    try {
-                                        programTag(tag, false)
-                                    } finally {
-                                        progressBar.visibility = View.INVISIBLE
-                                        job = null
+                        if (programKey >= floor(2.0.pow(15.0))) {
+                            val msg = if (programKey == Util.thermometerProgramKey) {
+                                R.string.message_confirm_self_overwrite
+                            } else {
+                                R.string.message_confirm_foreign_overwrite
+                            }
+                            AlertDialog.Builder(it).apply {
+                                setNegativeButton(R.string.button_title_no) { _, _ -> }
+                                setPositiveButton(R.string.button_title_yes) { _, _ ->
+                                    job = viewLifecycleOwner.lifecycleScope.launch {
+                                        progressBar.visibility = View.VISIBLE
+                                        try {
+                                            NFCSession.use(tag) {
+                                                programTag(tag, header, System.currentTimeMillis(), System.nanoTime())
+                                            }
+                                        } finally {
+                                            progressBar.visibility = View.INVISIBLE
+                                            job = null
+                                        }
                                     }
                                 }
+                                setTitle(getString(R.string.dialog_title_confirm_overwrite))
+                                setMessage(msg)
+                                show()
                             }
-                            setTitle(getString(R.string.dialog_title_confirm_overwrite))
-                            setMessage(msg)
-                            show()
+                        } else {
+                            programTag(tag, null, tapTime, tapNanos)
                         }
-                    } else {
-                        programTag(tag, true)
                     }
                 }
             } finally {
@@ -104,11 +117,22 @@ class ProgrammingFragment : AbstractMainFragment() {
 
     /**
      * Actually flash the image.
+     *
+     * The plan comes precompiled from the PlanCache, the time from the tap
+     * (or the confirmation) to the outcome is recorded per tag. Reprogramming
+     * a tag diffs against its TagSnapshot, looked up with the header read by
+     * the key check. Without one the delivery reads only the sections of the
+     * payload and starts a snapshot with them for the next time. Should the
+     * tag have changed while the confirmation dialog was open the verification
+     * catches it and drops the snapshot. A tag about to be initialized (no
+     * header given) changes completely and goes without one.
      */
-    private suspend fun programTag(tag: Tag, initialize: Boolean) {
+    private suspend fun programTag(tag: Tag, header: ByteArray?, startTime: Long, startNanos: Long) {
         Log.i(javaClass.name, "Begin tag programming.")
         var success = false
+        val initialize = header == null
         val initialized = if (initialize) {
+            TagSnapshot.invalidate(tag)
             initializeTag(tag) != null
         } else {
             true
@@ -116,12 +140,12 @@ class ProgrammingFragment : AbstractMainFragment() {
 
         if (initialized) {
             withContext(Dispatchers.IO) {
-                val text = activity?.assets?.open("thermometer-payload.txt")
-                    ?.bufferedReader()?.use { it.readText() }
-                val plan = text?.let { DeliveryPlan.create(it) }
-                success = plan?.deliver(tag) ?: false
+                val plan = context?.let { PlanCache.get(it.applicationContext, payloadAsset) }
+                val snapshot = header?.let { TagSnapshot.start(tag, it) }
+                success = plan?.let { it.deliver(tag, snapshot = snapshot) && it.verify(tag) } ?: false
             }
         }
+        TransportStatistics.recordProvisioning(NFCTransport.uid(tag), startTime, (System.nanoTime() - startNanos) / 1000, success)
 
         if (success) {
             Util.showInfoSnack(
@@ -146,5 +170,9 @@ class ProgrammingFragment : AbstractMainFragment() {
         Log.i(javaClass.name, "Tag initialization failed.")
         return null
     }
+
+    companion object {
+        private const val payloadAsset = "thermometer-payload.txt"
+    }
 }
 
@@ -14,13 +14,22 @@ import androidx.lifecycle.lifecycleScope
 import androidx.preference.PreferenceManager
 import androidx.viewpager2.widget.ViewPager2
 import com.diafyt.lazarus.R
-import com.diafyt.lazarus.utils.AsyncNFCTask
-import com.diafyt.lazarus.utils.NFCUtil
+import com.diafyt.lazarus.utils.MeasurementProfile
+import com.diafyt.lazarus.utils.NFCSession
+import com.diafyt.lazarus.utils.NFCTransport
+import com.diafyt.lazarus.utils.OversampledReading
+import com.diafyt.lazarus.utils.PerfCounters
+import com.diafyt.lazarus.utils.RatiometricReading
+import com.diafyt.lazarus.utils.SampleLog
+import com.diafyt.lazarus.utils.StreamReading
+import com.diafyt.lazarus.utils.TemperatureReading
+import com.diafyt.lazarus.utils.TransportStatistics
 import com.diafyt.lazarus.utils.Util
+import com.diafyt.lazarus.utils.WindowStatistics
 import kotlinx.coroutines.Job
 import kotlinx.coroutines.delay
 import kotlinx.coroutines.launch
-import kotlin.math.ln
+import java.util.Locale
 import kotlin.math.pow
 import kotlin.math.round
 
@@ -32,9 +41,20 @@ class TemperatureFragment : AbstractMainFragment() {
     override val tabTitleKey = R.string.tab_title_temperature
     private val keyUseFahrenheit = "useFahrenheit"
     private val keyLastMeasurement = "lastMeasurement"
+    private val keyRecordHistory = "recordHistory"
+    private val keyAverageReading = "averageReading"
+    private val keyLastHistorySize = "lastHistorySize"
+    private val keyHistoryAvailable = "historyAvailable"
+    private val keyAverageAvailable = "averageAvailable"
+    private val historyInterval = 15 // minutes
+    private val averagedConversions = 16
+    private val statisticsWindow = 64 // conversions
 
     private lateinit var resultText: TextView
     private lateinit var unitSwitch: SwitchCompat
+    private lateinit var historyText: TextView
+    private lateinit var logSwitch: SwitchCompat
+    private lateinit var averageSwitch: SwitchCompat
     private lateinit var progressBar: ProgressBar
 
     // transient state
@@ -42,6 +62,9 @@ class TemperatureFragment : AbstractMainFragment() {
 
     // conserved state
     private var lastMeasurement: Double? = null // in degrees Celsius
+    private var lastHistorySize: Int? = null // number of samples logged by the sensor
+    private var historyAvailable = false // whether the sensor read last runs the full firmware
+    private var averageAvailable = false // whether the sensor read last has the oversampling command
 
     override fun onCreateView(
         inflater: LayoutInflater, container: ViewGroup?, savedInstanceState: Bundle?
@@ -49,14 +72,24 @@ class TemperatureFragment : AbstractMainFragment() {
         if (savedInstanceState?.containsKey(keyLastMeasurement) == true) {
             lastMeasurement = savedInstanceState.getDouble(keyLastMeasurement)
         }
+        if (savedInstanceState?.containsKey(keyLastHistorySize) == true) {
+            lastHistorySize = savedInstanceState.getInt(keyLastHistorySize)
+        }
+        historyAvailable = savedInstanceState?.getBoolean(keyHistoryAvailable) ?: false
+        averageAvailable = savedInstanceState?.getBoolean(keyAverageAvailable) ?: false
 
         val ret = inflater.inflate(R.layout.fragment_temperature, container, false)
 
         resultText = ret.findViewById(R.id.text_thermometer_result)
         unitSwitch = ret.findViewById(R.id.unit_switch)
         progressBar = ret.findViewById(R.id.sensor_progress)
+        historyText = ret.findViewById(R.id.text_thermometer_history)
+        logSwitch = ret.findViewById(R.id.log_switch)
+        averageSwitch = ret.findViewById(R.id.average_switch)
 
         unitSwitch.setOnClickListener { unitSwitchClick() }
+        logSwitch.setOnClickListener { logSwitchClick() }
+        averageSwitch.setOnClickListener { averageSwitchClick() }
 
         updateUI()
 
@@ -74,6 +107,32 @@ class TemperatureFragment : AbstractMainFragment() {
         updateUI()
     }
 
+    /**
+     * Handle user input.
+     *
+     * The setting is applied to the sensor on the next read.
+     */
+    private fun logSwitchClick() {
+        PreferenceManager.getDefaultSharedPreferences(activity?.applicationContext).edit().apply {
+            putBoolean(keyRecordHistory, logSwitch.isChecked)
+            apply()
+        }
+        updateUI()
+    }
+
+    /**
+     * Handle user input.
+     *
+     * The setting applies from the next read on.
+     */
+    private fun averageSwitchClick() {
+        PreferenceManager.getDefaultSharedPreferences(activity?.applicationContext).edit().apply {
+            putBoolean(keyAverageReading, averageSwitch.isChecked)
+            apply()
+        }
+        updateUI()
+    }
+
     /**
      * Refresh the UI to be consistent with the internal state.
      */
@@ -82,6 +141,19 @@ class TemperatureFragment : AbstractMainFragment() {
             PreferenceManager.getDefaultSharedPreferences(activity?.applicationContext).getBoolean(
                 keyUseFahrenheit, false)
         unitSwitch.isChecked = useFahrenheit
+        logSwitch.isChecked =
+            PreferenceManager.getDefaultSharedPreferences(activity?.applicationContext).getBoolean(
+                keyRecordHistory, false)
+        averageSwitch.isChecked =
+            PreferenceManager.getDefaultSharedPreferences(activity?.applicationContext).getBoolean(
+                keyAverageReading, false)
+        // the payload keeps no sample log, only the full firmware can record one
+        logSwitch.visibility = if (historyAvailable) View.VISIBLE else View.GONE
+        historyText.visibility = logSwitch.visibility
+        // only firmware built with the oversampling command can average
+        averageSwitch.visibility = if (averageAvailable) View.VISIBLE else View.GONE
+        historyText.text = getString(
+            R.string.screen_thermometer_history, lastHistorySize?.toString() ?: "–")
         lastMeasurement.let {
             val numericValue = it?.let {
                 if (useFahrenheit) {
@@ -100,6 +172,9 @@ class TemperatureFragment : AbstractMainFragment() {
     override fun onSaveInstanceState(outState: Bundle) {
         super.onSaveInstanceState(outState)
         lastMeasurement?.let { outState.putDouble(keyLastMeasurement, it) }
+        lastHistorySize?.let { outState.putInt(keyLastHistorySize, it) }
+        outState.putBoolean(keyHistoryAvailable, historyAvailable)
+        outState.putBoolean(keyAverageAvailable, averageAvailable)
     }
 
     override fun handleNfc(tag: Tag) {
@@ -113,39 +188,42 @@ class TemperatureFragment : AbstractMainFragment() {
         job = viewLifecycleOwner.lifecycleScope.launch {
             progressBar.visibility = View.VISIBLE
             try {
-                activity?.let {
-                    val programKey =
-                        Util.retrieveProgramKey(tag)
-                    if (programKey == null) {
-                        Util.showInfoDialog(
-                            it,
-                            R.string.dialog_title_no_libre1,
-                            R.string.message_no_libre1
-                        )
-                        return@launch
-                    }
-                    when {
-                        programKey <  2.0.pow(15.0) -> {
-                            AlertDialog.Builder(it).apply {
-                                setNegativeButton(R.string.button_title_no) { _, _ -> }
-                                setPositiveButton(R.string.button_title_go_to_tutorial) { _, _ ->
-                                    val pager = it.findViewById<ViewPager2>(R.id.pager)
-                                    pager.setCurrentItem(0, false)
-                                }
-                                setTitle(getString(R.string.dialog_title_programmable_sensor))
-                                setMessage(R.string.message_programmable_sensor)
-                                show()
-                            }
-                        }
-                        programKey != Util.thermometerProgramKey -> {
+                // identification, reading and the history share one connection
+                NFCSession.use(tag) {
+                    activity?.let {
+                        val programKey =
+                            Util.retrieveProgramKey(tag)
+                        if (programKey == null) {
                             Util.showInfoDialog(
                                 it,
-                                R.string.dialog_title_no_thermometer,
-                                R.string.message_no_thermometer
+                                R.string.dialog_title_no_libre1,
+                                R.string.message_no_libre1
                             )
+                            return@launch
                         }
-                        else -> {
-                            readTag(tag)
+                        when {
+                            programKey <  2.0.pow(15.0) -> {
+                                AlertDialog.Builder(it).apply {
+                                    setNegativeButton(R.string.button_title_no) { _, _ -> }
+                                    setPositiveButton(R.string.button_title_go_to_tutorial) { _, _ ->
+                                        val pager = it.findViewById<ViewPager2>(R.id.pager)
+                                        pager.setCurrentItem(0, false)
+                                    }
+                                    setTitle(getString(R.string.dialog_title_programmable_sensor))
+                                    setMessage(R.string.message_programmable_sensor)
+                                    show()
+                                }
+                            }
+                            programKey != Util.thermometerProgramKey -> {
+                                Util.showInfoDialog(
+                                    it,
+                                    R.string.dialog_title_no_thermometer,
+                                    R.string.message_no_thermometer
+                                )
+                            }
+                            else -> {
+                                readTag(tag)
+                            }
                         }
                     }
                 }
@@ -157,58 +235,160 @@ class TemperatureFragment : AbstractMainFragment() {
     }
 
     /**
-     * Convert the raw value received from the reprogrammed sensor into
-     * an actual temperature value in degree Celsius.
+     * Perform the actual temperature measurement, see TemperatureReading.
      */
-    private fun temperatureCalibration(raw: Int): Double {
-        val r = raw + 411.737
-        val kelvin = steinharthart(
-            a=0.000679241, b=0.000324031, c=-0.000000173770, d=-0.0000000000677986, r=r)
-        return kelvin - 273.15
+    private suspend fun readTag(tag: Tag) {
+        val reading = TemperatureReading.retrieve(tag) ?: return
+        lastMeasurement = reading.celsius
+        // the sample log and the counters are kept by the interrupt service routines,
+        // the payload handler has no sample log, that needs the fully flashed firmware
+        historyAvailable = reading.calibrated && reading.table?.fullFirmware == true
+        averageAvailable = historyAvailable && reading.table?.provides(OversampledReading.command) == true
+        updateUI()
+        if (historyAvailable) {
+            if (reading.table?.provides(RatiometricReading.command) == true) {
+                logRatiometric(tag)
+            }
+            val averageReading =
+                PreferenceManager.getDefaultSharedPreferences(activity?.applicationContext).getBoolean(
+                    keyAverageReading, false)
+            if (averageReading && averageAvailable) {
+                averageTemperature(tag)
+            }
+            if (reading.table?.provides(StreamReading.command) == true) {
+                logStream(tag)
+            }
+            syncHistory(tag)
+            if (reading.table?.provides(WindowStatistics.command) == true) {
+                logWindowStatistics(tag)
+            }
+            logCounters(tag)
+        }
     }
 
     /**
-     * Implement the Steinhart-Hart equation calculating the dependency between
-     * temperature and resistance of a thermistor.
+     * Log the ratiometric triple belonging to the temperature sample just read and
+     * keep it for the export.
+     *
+     * Sent right after the temperature command, so the firmware answers with the
+     * triple it took behind that sample.
      */
-    private fun steinharthart(a: Double, b: Double, c: Double, d: Double, r: Double): Double {
-        return if (r > 0) {
-            1.0 / (a + b*ln(r) + c* ln(r).pow(3.0) + d* ln(r).pow(2.0))
-        } else {
-            0.0
+    private suspend fun logRatiometric(tag: Tag) {
+        val triple = RatiometricReading.retrieve(tag)
+        if (triple == null) {
+            Log.w(javaClass.name, "Retrieving ratiometric triple failed.")
+            return
         }
+        Log.i(javaClass.name, "Ratiometric triple: $triple")
+        TransportStatistics.recordSensorData(NFCTransport.uid(tag), "ratiometric", triple.toString())
     }
 
     /**
-     * Perform the actual temperature measurement.
+     * Replace the reading with the mean of several thermistor conversions, which the
+     * firmware accumulates with the settings of a single reading.
+     *
+     * This takes a couple of requests while the conversions run, if it fails the
+     * single reading stays.
      */
-    private suspend fun readTag(tag: Tag) {
-        Log.i(javaClass.name, "Retrieving temperature reading.")
-        val cmd = byteArrayOf(
-            0x02, // flags: high data rate mode
-            0xB3.toByte(), // unlock blocks
-            0x07 // vendor code
-        )
-        // First a request to get the measurement hardware to run
-        AsyncNFCTask(tag).asyncRun(cmd)?.let {
-            Log.d(javaClass.name, "Throwaway answer was " + Util.bytesToHex(it))
-            NFCUtil.checkError(it)
-        }
-        // Wait a bit so the measurement hardware has time to do its thing
-        delay(42)
-        // Finally retrieve the measurement
-        val result = AsyncNFCTask(tag).asyncRun(cmd)?.let {
-            Log.i(javaClass.name, "Answer was " + Util.bytesToHex(it))
-            NFCUtil.checkError(it)
-        }
-        if (result == null) {
-            Log.w(javaClass.name, "Measurement failed.")
+    private suspend fun averageTemperature(tag: Tag) {
+        val averaged = OversampledReading.retrieve(tag, averagedConversions)
+        if (averaged == null) {
+            Log.w(javaClass.name, "Retrieving averaged reading failed.")
+            return
+        }
+        Log.i(javaClass.name, "Averaged reading: $averaged")
+        TransportStatistics.recordSensorData(NFCTransport.uid(tag), "averaged reading", averaged.toString())
+        lastMeasurement = TemperatureReading.calibrate(averaged.mean)
+        updateUI()
+    }
+
+    /**
+     * Log a burst of consecutive thermistor conversions and keep it for the export.
+     *
+     * The first poll starts the stream, the second one after a frame worth of
+     * conversions collects them; the firmware stops converting on its own.
+     */
+    private suspend fun logStream(tag: Tag) {
+        val stream = StreamReading(tag)
+        stream.poll()
+        delay(StreamReading.maxBurst * StreamReading.conversionMillis)
+        val samples = stream.poll()
+        if (samples == null) {
+            Log.w(javaClass.name, "Retrieving stream failed.")
+            return
+        }
+        Log.i(javaClass.name, "Stream: $samples lost=${stream.lost}")
+        TransportStatistics.recordSensorData(NFCTransport.uid(tag), "stream", "$samples lost=${stream.lost}")
+    }
+
+    /**
+     * Log the summary of the window of conversions started on the previous read,
+     * keep it for the export and start the next window.
+     *
+     * Sent last, while the window runs the firmware starts no other conversion.
+     */
+    private suspend fun logWindowStatistics(tag: Tag) {
+        val statistics = WindowStatistics.retrieve(tag, statisticsWindow)
+        if (statistics == null) {
+            Log.w(javaClass.name, "Retrieving window statistics failed.")
+            return
+        }
+        Log.i(javaClass.name, "Window statistics: $statistics")
+        if (statistics.count > 0) {
+            TransportStatistics.recordSensorData(NFCTransport.uid(tag), "window statistics", statistics.toString())
+        }
+    }
+
+    /**
+     * Log the performance counters of the firmware and keep them for the export.
+     *
+     * Only called for the fully flashed firmware, other firmware has other
+     * contents in these blocks.
+     */
+    private suspend fun logCounters(tag: Tag) {
+        val counters = PerfCounters.retrieve(tag)
+        if (counters == null) {
+            Log.w(javaClass.name, "Retrieving performance counters failed.")
             return
         }
-        Log.i(javaClass.name, "Measurement done.")
-        val raw = Util.littleEndianDecode(result).toInt()
-        lastMeasurement = temperatureCalibration(raw)
+        Log.i(javaClass.name, "Performance counters: $counters")
+        TransportStatistics.recordSensorData(NFCTransport.uid(tag), "performance counters", counters.toString())
+    }
+
+    /**
+     * Retrieve the sample log of the sensor and apply the logging setting.
+     *
+     * Every entry is a thermistor conversion with the settings calibrate() is made for,
+     * the firmware has no other settings for the log.
+     */
+    private suspend fun syncHistory(tag: Tag) {
+        val history = SampleLog.retrieve(tag)
+        if (history == null) {
+            Log.w(javaClass.name, "Retrieving history failed.")
+            return
+        }
+        Log.i(javaClass.name, "Retrieved ${history.entries.size} logged samples.")
+        val text = StringBuilder("interval=${history.interval}min elapsed=${history.minutes}min\n")
+        for (entry in history.entries) {
+            text.append(String.format(Locale.ROOT, "minute %d raw=%d %.2f°C\n",
+                entry.minutes, entry.raw, TemperatureReading.calibrate(entry.raw)))
+        }
+        TransportStatistics.recordSensorData(NFCTransport.uid(tag), "sample log", text.toString())
+        lastHistorySize = history.entries.size
         updateUI()
-        Log.i(javaClass.name, "Retrieved temperature reading.")
+        val recordHistory =
+            PreferenceManager.getDefaultSharedPreferences(activity?.applicationContext).getBoolean(
+                keyRecordHistory, false)
+        if (recordHistory != (history.interval != 0)) {
+            val interval = if (recordHistory) historyInterval else 0
+            // the log is calibrated like a reading, which needs the thermistor profile
+            if (recordHistory && !MeasurementProfile.store(tag)) {
+                Log.w(javaClass.name, "Setting the measurement profile failed.")
+                return
+            }
+            if (!SampleLog.enable(tag, interval)) {
+                Log.w(javaClass.name, "Changing the logging interval failed.")
+            }
+        }
     }
 }
\ No newline at end of file
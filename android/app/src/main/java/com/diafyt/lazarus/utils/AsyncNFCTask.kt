@@ -1,18 +1,28 @@
 package com.diafyt.lazarus.utils
 
 import android.nfc.Tag
-import android.nfc.tech.NfcV
+import kotlinx.coroutines.CancellationException
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.delay
 import kotlinx.coroutines.isActive
 import kotlinx.coroutines.withContext
 import java.io.IOException
+import kotlin.random.Random
 
 /**
  * Perform NFC communication in an asynchronous manner.
  * This does the actual IO.
+ *
+ * If an NFCSession is open for the tag its connection is used, otherwise
+ * a connection is made for the duration of the transmissions. Failed
+ * transmissions are retried with a jittered exponential backoff. Every
+ * attempt is recorded in the TransportStatistics without the backoff, the
+ * retries per transmission separately.
  */
 class AsyncNFCTask(val tag: Tag) {
     private val timeout = 1000
+    private val firstBackoff = 2L
+    private val maxBackoff = 64L
 
     /**
      * Perform a single transmission.
@@ -34,39 +44,61 @@ class AsyncNFCTask(val tag: Tag) {
      */
     suspend fun asyncRun(cmds: List<ByteArray>): List<ByteArray?> {
         var lastSuccess = System.currentTimeMillis()
-        val nfcvTag = NfcV.get(tag)
+        val session = NFCSession.current(tag)
+        val transport = session?.transport ?: NFCTransport.factory(tag)
         val ret = ArrayList<ByteArray?>()
         withContext(Dispatchers.IO) {
             try {
-                nfcvTag.connect()
+                if (session == null) {
+                    val start = System.nanoTime()
+                    transport.connect()
+                    TransportStatistics.recordConnect((System.nanoTime() - start) / 1000)
+                }
                 for (cmd in cmds) {
                     if (!isActive) {
                         break
                     }
                     var answer: ByteArray? = null
+                    var retries = 0
+                    var backoff = firstBackoff
                     while (isActive) {
+                        val start = System.nanoTime()
                         try {
-                            answer = nfcvTag.transceive(cmd)
+                            answer = transport.transceive(cmd)
+                            TransportStatistics.recordAttempt(cmd, (System.nanoTime() - start) / 1000, true)
                             lastSuccess = System.currentTimeMillis()
                             break
                         } catch (e: IOException) {
-                            if (System.currentTimeMillis() > lastSuccess + timeout) {
+                            TransportStatistics.recordAttempt(cmd, (System.nanoTime() - start) / 1000, false)
+                            val remaining = lastSuccess + timeout - System.currentTimeMillis()
+                            if (remaining < 0) {
                                 break
                             }
+                            // a marginal field rarely recovers within microseconds, give it (and the CPU) a break
+                            // without holding on to an IO thread
+                            delay(minOf(Random.nextLong(backoff / 2, backoff + 1), remaining))
+                            backoff = minOf(2 * backoff, maxBackoff)
+                            retries++
                         }
                     }
+                    TransportStatistics.recordCommand(cmd, retries, answer != null)
                     ret.add(answer)
                     if (answer == null) {
                         break
                     }
                 }
+            } catch (e: CancellationException) {
+                // a cancelled backoff is no error, it just ends the transmissions
+                throw e
             } catch (e: Exception) {
                 ExceptionArchivist.log(e)
             } finally {
-                try {
-                    nfcvTag.close()
-                } catch (e: Exception) {
-                    ExceptionArchivist.log(e)
+                if (session == null) {
+                    try {
+                        transport.close()
+                    } catch (e: Exception) {
+                        ExceptionArchivist.log(e)
+                    }
                 }
             }
         }
@@ -0,0 +1,145 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+import android.util.Log
+import kotlin.math.min
+
+/**
+ * The custom command dispatch table on a tag, which tells what the firmware
+ * installed there provides.
+ *
+ * The table grows downwards from 0xffce. It starts and ends with a key and holds
+ * one 4 byte entry per command: the address of the handler and the command code
+ * (both little endian). The key tells whose table it is: the fully flashed
+ * firmware of diafyt Lazarus uses 0xcece, the sensor firmware (also with a
+ * payload installed) 0xabab.
+ *
+ * @param key the key of the table
+ * @param commands the command codes registered in the table
+ */
+class CommandTable(val key: Int, val commands: Set<Int>) {
+    /**
+     * Whether the fully flashed firmware runs, whose interrupt service routines
+     * keep the sample log and the performance counters. A payload only adds
+     * handlers to the sensor firmware.
+     */
+    val fullFirmware: Boolean
+        get() = key == firmwareKey
+
+    /**
+     * Whether the command is registered on the tag.
+     */
+    fun provides(command: Byte): Boolean {
+        return commands.contains(command.toInt() and 0xFF)
+    }
+
+    companion object {
+        private const val libreBaseAddress = 0xf860
+        private const val tableStart = 0xffce
+        private const val firmwareKey = 0xcece
+        private const val sensorKey = 0xabab
+        private const val blocklen = 8
+
+        /**
+         * More entries than the payload builder and the module linker ever write.
+         */
+        private const val maxEntries = 32
+
+        /**
+         * Maximal number of blocks requested per read multiple blocks command.
+         */
+        private const val blocksPerRead = 3
+
+        /**
+         * Number of tables kept, the least recently used goes first.
+         */
+        private const val cachedTags = 16
+
+        private val cache = object : LinkedHashMap<String, CommandTable>(cachedTags, 0.75f, true) {
+            override fun removeEldestEntry(eldest: MutableMap.MutableEntry<String, CommandTable>?): Boolean {
+                return size > cachedTags
+            }
+        }
+
+        private fun key(tag: Tag): String {
+            return NFCTransport.uid(tag).joinToString("") { String.format("%02X", it) }
+        }
+
+        /**
+         * The table of the tag as read before, read from the tag if unknown.
+         *
+         * The table only changes when the tag is programmed, which calls forget(),
+         * so every reading after the first one of a tag saves reading it (about two
+         * read multiple blocks commands). Callers finding a command missing which
+         * the table promised call forget() as well.
+         */
+        suspend fun cached(tag: Tag): CommandTable? {
+            synchronized(this) {
+                cache[key(tag)]?.let { return it }
+            }
+            val table = retrieve(tag) ?: return null
+            synchronized(this) {
+                cache[key(tag)] = table
+            }
+            return table
+        }
+
+        /**
+         * Drop the cached table of the tag.
+         */
+        fun forget(tag: Tag) {
+            synchronized(this) {
+                cache.remove(key(tag))
+            }
+        }
+
+        /**
+         * Read the table from the tag, block by block downwards until its end.
+         *
+         * Returns null in case of a communication error or if there is no table
+         * with a known key.
+         */
+        suspend fun retrieve(tag: Tag): CommandTable? {
+            val lastBlock = (tableStart - libreBaseAddress) / blocklen
+            val lowestBlock = (tableStart - 4 * maxEntries - 2 - libreBaseAddress) / blocklen
+            var firstBlock = lastBlock + 1
+            var raw = ByteArray(0)
+            val commands = HashSet<Int>()
+            var key: Int? = null
+            var address = tableStart
+            while (true) {
+                // fetch more blocks as long as the next word is not there yet
+                while (address < libreBaseAddress + firstBlock * blocklen) {
+                    if (firstBlock <= lowestBlock) {
+                        Log.w(CommandTable::class.java.name, "Command table is not terminated.")
+                        return null
+                    }
+                    val num = min(blocksPerRead, firstBlock - lowestBlock)
+                    val data = NFCUtil.readMultipleBlocks(
+                        tag, (firstBlock - num).toByte(), num.toByte()) ?: return null
+                    if (data.size != num * blocklen) {
+                        Log.w(CommandTable::class.java.name, "Unexpected answer length while reading the command table.")
+                        return null
+                    }
+                    raw = data + raw
+                    firstBlock -= num
+                }
+                val offset = address - libreBaseAddress - firstBlock * blocklen
+                val word = (raw[offset].toInt() and 0xFF) or ((raw[offset + 1].toInt() and 0xFF) shl 8)
+                if (key == null) {
+                    if (word != firmwareKey && word != sensorKey) {
+                        Log.w(CommandTable::class.java.name, "Unknown command table key $word.")
+                        return null
+                    }
+                    key = word
+                } else if (word == key) {
+                    return CommandTable(key, commands)
+                } else {
+                    commands.add(word)
+                    address -= 2    // skip the handler address
+                }
+                address -= 2
+            }
+        }
+    }
+}
@@ -11,133 +11,327 @@ class DeliveryPlan(val sections: List<DeliverySection>) {
     /**
      * Describe the data to be delivered by specifying the position of
      * the initial block to be written as well as the data to be written.
+     *
+     * The checksum of the data is what the verification expects from the
+     * tag, it is computed once per plan.
      */
-    class DeliverySection(val initialBlock: Byte, val data: ByteArray)
+    class DeliverySection(val initialBlock: Byte, val data: ByteArray,
+                          val checksum: Short = computeChecksum(data))
 
     /**
      * Execute the actual delivery as described by this instance.
+     *
+     * In differential mode the current contents of the tag are read first
+     * and only blocks which differ are written. If reading fails the
+     * affected section is written completely. A snapshot of the tag replaces
+     * reading the sections it covers, the others are read section by section
+     * and recorded in it; it is kept up to date with the blocks written.
      */
-    suspend fun deliver(tag: Tag): Boolean {
+    suspend fun deliver(tag: Tag, differential: Boolean = true, snapshot: TagSnapshot? = null): Boolean {
         Log.i(javaClass.name, "Payload delivery starting.")
+        CommandTable.forget(tag)
+        var written = 0
+        var total = 0
         for (section in sections) {
-            var offset = 0
-            while (offset < section.data.size) {
-                val num = min(2, (section.data.size - offset) / 8)
-                val pos = (section.initialBlock + (offset / 8)).toByte()
-                val blocks = section.data.sliceArray(offset until (offset + 8*num))
-                Log.d(javaClass.name, "Going to write $num blocks at $pos")
-                val answer = if (num == 1) {
-                    NFCUtil.writeBlock(tag, pos, blocks)
-                } else {
-                    NFCUtil.writeMultipleBlocks(tag, pos, blocks)
+            val blockCount = section.data.size / 8
+            val changed = if (differential) {
+                (snapshot?.let { changedBlocks(it, section) } ?: changedBlocks(tag, section, snapshot != null))
+                    ?: BooleanArray(blockCount) { true }
+            } else {
+                BooleanArray(blockCount) { true }
+            }
+            total += blockCount
+            var block = 0
+            while (block < blockCount) {
+                if (!changed[block]) {
+                    block++
+                    continue
+                }
+                // merge consecutive changed blocks into one run
+                var end = block
+                while (end < blockCount && changed[end]) {
+                    end++
                 }
-                if (answer == null) {
+                if (!writeRun(tag, section, block, end)) {
                     Log.i(javaClass.name, "Payload delivery error.")
+                    TagSnapshot.invalidate(tag)
                     return false
                 }
-                offset += 8*num
+                TagSnapshot.update(tag, (section.initialBlock.toInt() and 0xFF) + block,
+                                   section.data.copyOfRange(8 * block, 8 * end))
+                written += end - block
+                block = end
+            }
+        }
+        Log.i(javaClass.name, "Payload delivery complete, wrote $written of $total blocks.")
+        return true
+    }
+
+    /**
+     * Check that the tag holds the planned contents.
+     *
+     * Each section is checked with a single checksum command if the dispatch
+     * table of the tag lists it (the thermometer payload brings it along),
+     * otherwise it is read back completely. A failing checksum command falls
+     * back to reading the section.
+     */
+    suspend fun verify(tag: Tag): Boolean {
+        val remote = CommandTable.cached(tag)?.provides(checksumCommand) ?: false
+        for (section in sections) {
+            val checksum = if (remote) remoteChecksum(tag, section) else null
+            val intact = if (checksum != null) {
+                checksum == section.checksum
+            } else {
+                changedBlocks(tag, section)?.none { it } ?: false
+            }
+            if (!intact) {
+                Log.i(javaClass.name, "Payload verification failed.")
+                TagSnapshot.invalidate(tag)
+                return false
+            }
+        }
+        Log.i(javaClass.name, "Payload verification complete.")
+        return true
+    }
+
+    /**
+     * Let the firmware compute the checksum of a section on the tag.
+     *
+     * Returns null if the command fails.
+     */
+    private suspend fun remoteChecksum(tag: Tag, section: DeliverySection): Short? {
+        val address = libreBaseAddress + 8 * (section.initialBlock.toInt() and 0xFF)
+        val parameters = byteArrayOf(
+            (address and 0xFF).toByte(), ((address shr 8) and 0xFF).toByte(),
+            (section.data.size and 0xFF).toByte(), ((section.data.size shr 8) and 0xFF).toByte()
+        )
+        val answer = NFCUtil.customCommand(tag, checksumCommand, parameters) ?: return null
+        if (answer.size != 2) {
+            return null
+        }
+        return Util.littleEndianDecode(answer).toShort()
+    }
+
+    /**
+     * Compare the section with the current contents of the tag.
+     *
+     * Returns which blocks differ or null if the tag could not be read. The
+     * blocks read are recorded in the snapshot of the tag if asked to.
+     */
+    private suspend fun changedBlocks(tag: Tag, section: DeliverySection,
+                                      record: Boolean = false): BooleanArray? {
+        val blockCount = section.data.size / 8
+        val changed = BooleanArray(blockCount)
+        var block = 0
+        while (block < blockCount) {
+            val num = min(blocksPerRead, blockCount - block)
+            val pos = (section.initialBlock + block).toByte()
+            val current = NFCUtil.readMultipleBlocks(tag, pos, num.toByte()) ?: return null
+            if (current.size != 8*num) {
+                Log.w(javaClass.name, "Unexpected answer length while reading the tag.")
+                return null
+            }
+            if (record) {
+                TagSnapshot.update(tag, pos.toInt() and 0xFF, current)
+            }
+            for (i in 0 until num) {
+                val offset = 8 * (block + i)
+                changed[block + i] = !current.sliceArray(8*i until 8*(i + 1)).contentEquals(
+                    section.data.sliceArray(offset until offset + 8))
+            }
+            block += num
+        }
+        return changed
+    }
+
+    /**
+     * Compare the section with a snapshot of the tag, null if the snapshot
+     * does not cover it.
+     */
+    private fun changedBlocks(snapshot: TagSnapshot, section: DeliverySection): BooleanArray? {
+        if (!snapshot.covers(section.initialBlock.toInt() and 0xFF, section.data.size / 8)) {
+            return null
+        }
+        val first = 8 * (section.initialBlock.toInt() and 0xFF)
+        return BooleanArray(section.data.size / 8) { block ->
+            (0 until 8).any { snapshot.image[first + 8 * block + it] != section.data[8 * block + it] }
+        }
+    }
+
+    /**
+     * Write the blocks from start (inclusive) to end (exclusive) of a section.
+     */
+    private suspend fun writeRun(tag: Tag, section: DeliverySection, start: Int, end: Int): Boolean {
+        var offset = 8*start
+        while (offset < 8*end) {
+            val num = min(2, (8*end - offset) / 8)
+            val pos = (section.initialBlock + (offset / 8)).toByte()
+            val blocks = section.data.sliceArray(offset until (offset + 8*num))
+            Log.d(javaClass.name, "Going to write $num blocks at $pos")
+            val answer = if (num == 1) {
+                NFCUtil.writeBlock(tag, pos, blocks)
+            } else {
+                NFCUtil.writeMultipleBlocks(tag, pos, blocks)
+            }
+            if (answer == null) {
+                return false
             }
+            offset += 8*num
         }
-        Log.i(javaClass.name, "Payload delivery complete.")
         return true
     }
 
+    /**
+     * Serialize the plan into the compiled form read by fromBinary().
+     *
+     * Layout (little endian): magic, format version, number of sections, then
+     * per section the initial block, the number of blocks, the checksum and
+     * the data, finally a checksum over everything before.
+     */
+    fun toBinary(): ByteArray {
+        val size = binaryHeaderSize + sections.sumBy { sectionHeaderSize + it.data.size } + 2
+        val binary = ByteArray(size)
+        binaryMagic.copyInto(binary)
+        binary[4] = binaryFormatVersion
+        binary[5] = sections.size.toByte()
+        var offset = binaryHeaderSize
+        for (section in sections) {
+            binary[offset] = section.initialBlock
+            binary[offset + 1] = (section.data.size / 8).toByte()
+            binary[offset + 2] = (section.checksum.toInt() and 0xFF).toByte()
+            binary[offset + 3] = ((section.checksum.toInt() shr 8) and 0xFF).toByte()
+            section.data.copyInto(binary, offset + sectionHeaderSize)
+            offset += sectionHeaderSize + section.data.size
+        }
+        val checksum = computeChecksum(binary, 0, offset)
+        binary[offset] = (checksum.toInt() and 0xFF).toByte()
+        binary[offset + 1] = ((checksum.toInt() shr 8) and 0xFF).toByte()
+        return binary
+    }
+
     companion object {
         private const val libreBaseAddress = 0xf860
 
+        private val binaryMagic = "LZDP".toByteArray(Charsets.US_ASCII)
+        private const val binaryFormatVersion: Byte = 1
+        private const val binaryHeaderSize = 6
+        private const val sectionHeaderSize = 4
+
         /**
-         * Verify that the plan has the desired properties.
-         *
-         * This only checks things not checked in the parse() method.
+         * Maximal number of blocks requested per read multiple blocks command.
+         */
+        private const val blocksPerRead = 3
+
+        /**
+         * Custom command computing the checksum of an FRAM range on the tag.
          */
-        private fun verify(plan: DeliveryPlan): DeliveryPlan? {
-            var programKey: Long? = null
-            for (section in plan.sections) {
-                val endBlock = section.initialBlock + section.data.size / 8
-                if (section.initialBlock <= 39 && endBlock >= 39) {
-                    programKey = Util.littleEndianDecode(
-                        section.data.sliceArray(
-                            (0x13c - 8 * section.initialBlock) until (0x13e - 8 * section.initialBlock)
-                        )
-                    )
-                    if (programKey.toInt() != Util.thermometerProgramKey) {
-                        Log.w(::DeliveryPlan.javaClass.name, "Payload has wrong program key.")
-                        return null
-                    }
+        private const val checksumCommand = 0xB6.toByte()
+
+        /**
+         * Check what the parser does not check: the program key in block 39 and
+         * the checksum of the header if the payload contains it.
+         */
+        private fun checkContents(parser: TITXTParser): Boolean {
+            val image = parser.image
+            val keyOffset = 8 * TITXTParser.programKeyBlock + 4
+            val programKey = (image[keyOffset].toInt() and 0xFF) or ((image[keyOffset + 1].toInt() and 0xFF) shl 8)
+            if (programKey != Util.thermometerProgramKey) {
+                Log.w(::DeliveryPlan.javaClass.name, "Payload has wrong program key.")
+                return false
+            }
+            if (parser.written[0]) {
+                val crc = CRC()
+                for (k in 2 until 0x18) {
+                    crc.update(image[k])
                 }
-                if (section.initialBlock == 0.toByte()) {
-                    val header = section.data.sliceArray(0 until 0x18)
-                    val storedChecksum =
-                        Util.littleEndianDecode(
-                            header.sliceArray(0 until 2)
-                        )
-                    val crc = CRC()
-                    for (b in header.sliceArray(2 until header.size)) {
-                        crc.update(b)
-                    }
-                    val computedChecksum = crc.getCRC()
-                    if (storedChecksum.toShort() != computedChecksum) {
-                        Log.w(::DeliveryPlan.javaClass.name, "Payload fails checksum.")
-                        return null
-                    }
+                val storedChecksum = (image[0].toInt() and 0xFF) or ((image[1].toInt() and 0xFF) shl 8)
+                if (storedChecksum.toShort() != crc.getCRC()) {
+                    Log.w(::DeliveryPlan.javaClass.name, "Payload fails checksum.")
+                    return false
                 }
             }
-            return plan
+            return true
         }
 
         /**
-         * Use the TITXTParser to convert the ASCII data into a binary representation.
+         * Parse and check a payload without building a plan.
+         *
+         * Passing the same parser for a batch of payloads avoids allocating per
+         * payload.
          */
-        private fun parse(text: String): DeliveryPlan? {
+        fun validate(text: CharSequence, parser: TITXTParser = TITXTParser()): Boolean {
             try {
-                val instructions = TITXTParser().process(text)
-                var programmingKeyFound = false
-                val sections = ArrayList<DeliverySection>()
-                for ((startAddress, data) in instructions) {
-                    if (startAddress % 8 != 0) {
-                        Log.w(
-                            ::DeliveryPlan.javaClass.name,
-                            "Target addresses must be divisible by 8."
-                        )
-                        return null
-                    }
-                    val startBlock = (startAddress - libreBaseAddress) / 8
-                    if (data.size % 8 != 0 || data.size + startAddress > 0x10000) {
-                        Log.w(
-                            ::DeliveryPlan.javaClass.name,
-                            "Payload length must be divisible by 8 and not run over the end."
-                        )
-                        return null
-                    }
-                    val endBlock = (startAddress - libreBaseAddress + data.size) / 8
-                    if (startBlock <= 39 && endBlock >= 39) {
-                        programmingKeyFound = true
-                    }
-                    if (startBlock in 1..2 || endBlock in 0..1) {
-                        Log.w(
-                            ::DeliveryPlan.javaClass.name,
-                            "Payload must contain all or none of the first area."
-                        )
-                        return null
-                    }
-                    sections.add(DeliverySection(startBlock.toByte(), data))
-                }
-                if (!programmingKeyFound) {
-                    Log.w(::DeliveryPlan.javaClass.name, "Payload must contain programming key.")
-                    return null
-                }
-                return DeliveryPlan(sections)
+                parser.parse(text)
             } catch (e: TITXTParser.ParseException) {
                 Log.e(::DeliveryPlan.javaClass.name, "Payload failed to parse.", e)
+                return false
+            }
+            return checkContents(parser)
+        }
+
+        private fun computeChecksum(data: ByteArray, start: Int = 0, end: Int = data.size): Short {
+            val crc = CRC()
+            for (k in start until end) {
+                crc.update(data[k])
+            }
+            return crc.getCRC()
+        }
+
+        /**
+         * Load a plan serialized by toBinary().
+         *
+         * The payload was validated when the plan was compiled, so only the
+         * integrity of the binary is checked. Returns null if it is damaged or
+         * of another format version.
+         */
+        fun fromBinary(binary: ByteArray): DeliveryPlan? {
+            if (binary.size < binaryHeaderSize + 2
+                || !binary.copyOfRange(0, 4).contentEquals(binaryMagic)
+                || binary[4] != binaryFormatVersion) {
                 return null
             }
+            val end = binary.size - 2
+            val storedChecksum = (binary[end].toInt() and 0xFF) or ((binary[end + 1].toInt() and 0xFF) shl 8)
+            if (storedChecksum.toShort() != computeChecksum(binary, 0, end)) {
+                Log.w(::DeliveryPlan.javaClass.name, "Compiled plan fails checksum.")
+                return null
+            }
+            val count = binary[5].toInt() and 0xFF
+            val sections = ArrayList<DeliverySection>(count)
+            var offset = binaryHeaderSize
+            for (k in 0 until count) {
+                if (offset + sectionHeaderSize > end) {
+                    return null
+                }
+                val length = 8 * (binary[offset + 1].toInt() and 0xFF)
+                val checksum = (binary[offset + 2].toInt() and 0xFF) or ((binary[offset + 3].toInt() and 0xFF) shl 8)
+                val start = offset + sectionHeaderSize
+                if (start + length > end) {
+                    return null
+                }
+                sections.add(DeliverySection(binary[offset], binary.copyOfRange(start, start + length),
+                                             checksum.toShort()))
+                offset = start + length
+            }
+            return if (offset == end) DeliveryPlan(sections) else null
         }
 
         /**
          * Create a delivery plan from textual data in TI-TXT format.
          */
-        fun create(text: String): DeliveryPlan? {
-            return parse(text)?.let { verify(it) }
+        fun create(text: CharSequence): DeliveryPlan? {
+            val parser = TITXTParser()
+            if (!validate(text, parser)) {
+                return null
+            }
+            val sections = ArrayList<DeliverySection>(parser.sectionCount)
+            for (k in 0 until parser.sectionCount) {
+                val start = 8 * parser.sectionBlocks[k]
+                sections.add(DeliverySection(
+                    parser.sectionBlocks[k].toByte(),
+                    parser.image.copyOfRange(start, start + 8 * parser.sectionLengths[k])))
+            }
+            return DeliveryPlan(sections)
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,37 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+
+/**
+ * Set the measurement profile which the fully flashed firmware keeps in FRAM.
+ *
+ * The profile is the SD14CTL1 value (channel, gain, rate, filter and
+ * interrupt delay) of the conversions of the sample log and of the
+ * oversampling, statistics and stream commands, see the README. The
+ * firmware applies it from the next measurement on, no reprogramming needed.
+ */
+object MeasurementProfile {
+    private const val profileBlock = 73
+    private const val blocklen = 8
+
+    /**
+     * Thermistor at the fastest rate, the settings of the temperature command
+     * which the calibration of a reading is made for.
+     */
+    const val thermistor = 0xD043
+
+    /**
+     * Switch the profile with a single block write.
+     *
+     * Only for the fully flashed firmware, other firmware has code in this block.
+     */
+    suspend fun store(tag: Tag, sd14ctl1: Int = thermistor): Boolean {
+        if (sd14ctl1 !in 0..0xFFFF) {
+            throw RuntimeException("SD14CTL1 must fit into 16 bits.")
+        }
+        val profile = ByteArray(blocklen)
+        profile[0] = (sd14ctl1 and 0xFF).toByte()
+        profile[1] = ((sd14ctl1 shr 8) and 0xFF).toByte()
+        return NFCUtil.writeBlock(tag, profileBlock.toByte(), profile) != null
+    }
+}
@@ -0,0 +1,96 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+import android.util.Log
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.NonCancellable
+import kotlinx.coroutines.withContext
+import java.util.IdentityHashMap
+
+/**
+ * Keep a single NFC connection open for a whole logical operation.
+ *
+ * While a session is open every command for its tag (be it via NFCUtil or
+ * AsyncNFCTask) uses this connection instead of connecting and closing
+ * around each command. Sessions for the same tag may be nested, the
+ * connection is closed when the outermost one ends.
+ */
+class NFCSession private constructor(val tag: Tag) {
+    val transport: NFCTransport = NFCTransport.factory(tag)
+    private var depth = 0
+
+    companion object {
+        private val sessions = IdentityHashMap<Tag, NFCSession>()
+
+        /**
+         * Return the open session of the tag if there is one.
+         */
+        fun current(tag: Tag): NFCSession? {
+            synchronized(sessions) {
+                return sessions[tag]
+            }
+        }
+
+        /**
+         * Run the block with a connection to the tag kept open throughout.
+         *
+         * If connecting fails the block still runs, its commands then
+         * connect individually as without a session.
+         */
+        suspend inline fun <T> use(tag: Tag, block: () -> T): T {
+            val session = open(tag)
+            try {
+                return block()
+            } finally {
+                session?.let { close(it) }
+            }
+        }
+
+        @PublishedApi
+        internal suspend fun open(tag: Tag): NFCSession? {
+            current(tag)?.let {
+                it.depth++
+                return it
+            }
+            val session = NFCSession(tag)
+            val connected = withContext(Dispatchers.IO) {
+                try {
+                    val start = System.nanoTime()
+                    session.transport.connect()
+                    TransportStatistics.recordConnect((System.nanoTime() - start) / 1000)
+                    true
+                } catch (e: Exception) {
+                    ExceptionArchivist.log(e)
+                    false
+                }
+            }
+            if (!connected) {
+                Log.w(NFCSession::class.java.name, "Connecting the session failed.")
+                return null
+            }
+            session.depth = 1
+            synchronized(sessions) {
+                sessions[tag] = session
+            }
+            return session
+        }
+
+        @PublishedApi
+        internal suspend fun close(session: NFCSession) {
+            if (--session.depth > 0) {
+                return
+            }
+            synchronized(sessions) {
+                sessions.remove(session.tag)
+            }
+            // also close when the operation was cancelled
+            withContext(NonCancellable + Dispatchers.IO) {
+                try {
+                    session.transport.close()
+                } catch (e: Exception) {
+                    ExceptionArchivist.log(e)
+                }
+            }
+        }
+    }
+}
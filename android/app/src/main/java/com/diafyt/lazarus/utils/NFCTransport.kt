@@ -0,0 +1,40 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+import android.nfc.tech.NfcV
+
+/**
+ * Carrier of the raw ISO 15693 frames to and from a tag.
+ *
+ * All communication goes through the transport made by the factory, which
+ * allows replacing the NFC hardware by a simulated tag (as done by the unit
+ * tests) without touching the transfer logic. The UID of a tag is taken via
+ * this companion as well, since a simulated tag has no NFC stack behind it.
+ */
+interface NFCTransport {
+    fun connect()
+    fun close()
+
+    /**
+     * Exchange a frame, throws an IOException if no answer arrived.
+     */
+    fun transceive(cmd: ByteArray): ByteArray
+
+    companion object {
+        var factory: (Tag) -> NFCTransport = { NfcVTransport(it) }
+        var uid: (Tag) -> ByteArray = { it.id }
+    }
+}
+
+/**
+ * The transport of a real tag via the NFC adapter of the phone.
+ */
+class NfcVTransport(tag: Tag) : NFCTransport {
+    private val nfcv: NfcV = NfcV.get(tag)
+
+    override fun connect() = nfcv.connect()
+
+    override fun close() = nfcv.close()
+
+    override fun transceive(cmd: ByteArray): ByteArray = nfcv.transceive(cmd)
+}
@@ -21,7 +21,7 @@ object NFCUtil {
             0x00,  0x00, 0x00, 0x00, 0x00,  0x00, 0x00, 0x00, // placeholder for tag UID
             pos
         ) + data
-        System.arraycopy(tag.id, 0, cmd, 2, 8)
+        System.arraycopy(NFCTransport.uid(tag), 0, cmd, 2, 8)
         AsyncNFCTask(tag).asyncRun(cmd)?.let {
             return checkError(it)
         }
@@ -42,7 +42,7 @@ object NFCUtil {
             pos,
             (data.size / blocklen - 1).toByte()
         ) + data
-        System.arraycopy(tag.id, 0, cmd, 2, 8)
+        System.arraycopy(NFCTransport.uid(tag), 0, cmd, 2, 8)
         AsyncNFCTask(tag).asyncRun(cmd)?.let {
             return checkError(it)
         }
@@ -60,7 +60,7 @@ object NFCUtil {
              0x20, // read single block
              0x00,  0x00, 0x00, 0x00, 0x00,  0x00, 0x00, 0x00, // placeholder for tag UID
              pos)
-        System.arraycopy(tag.id, 0, cmd, 2, 8)
+        System.arraycopy(NFCTransport.uid(tag), 0, cmd, 2, 8)
         AsyncNFCTask(tag).asyncRun(cmd)?.let {
             return checkError(it)
         }
@@ -80,7 +80,24 @@ object NFCUtil {
             pos,
             (count - 1).toByte()
         )
-        System.arraycopy(tag.id, 0, cmd, 2, 8)
+        System.arraycopy(NFCTransport.uid(tag), 0, cmd, 2, 8)
+        AsyncNFCTask(tag).asyncRun(cmd)?.let {
+            return checkError(it)
+        }
+        return null
+    }
+
+    /**
+     * Send a custom command with the vendor code of Texas Instruments.
+     *
+     * This returns just the payload without status flags.
+     */
+    suspend fun customCommand(tag: Tag, code: Byte, parameters: ByteArray = ByteArray(0)): ByteArray? {
+        val cmd = byteArrayOf(
+            0x02, // flags: high data rate mode
+            code,
+            0x07 // vendor code
+        ) + parameters
         AsyncNFCTask(tag).asyncRun(cmd)?.let {
             return checkError(it)
         }
@@ -0,0 +1,88 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+import android.util.Log
+import kotlinx.coroutines.delay
+
+/**
+ * Result of averaging consecutive conversions on the sensor.
+ *
+ * The firmware accumulates the conversions in its SD14 ISR so only the sum
+ * travels via NFC instead of every single conversion.
+ *
+ * The command is opt-in, the default firmware build has no room for it; the
+ * thermometer screen only offers averaging once the driver table of a sensor
+ * lists it.
+ *
+ * @param count number of accumulated conversions
+ * @param sum sum of all conversions
+ * @param sequence number of the result, increments with every result the firmware completes
+ */
+class OversampledReading(val count: Int, val sum: Long, val sequence: Int) {
+    /**
+     * Mean of the conversions with extended resolution.
+     *
+     * This is on the same scale as a single conversion.
+     */
+    val mean: Double
+        get() = sum.toDouble() / count
+
+    override fun toString(): String {
+        return "count=$count sum=$sum mean=$mean sequence=$sequence"
+    }
+
+    companion object {
+        /**
+         * Custom command answering with the sum of N conversions.
+         */
+        const val command = 0xB5.toByte()
+        private const val answerLength = 8
+
+        /**
+         * Number of requests before giving up on a result.
+         */
+        private const val attempts = 5
+
+        /**
+         * Duration of a conversion at the fastest SD14RATE of the 2 kHz SD14 clock.
+         */
+        private const val defaultConversionMillis = 16L
+
+        /**
+         * Retrieve the mean of the given number of consecutive conversions.
+         *
+         * The firmware answers with the newest completed result and starts the next
+         * one. A result with the requested count may be left over from an earlier
+         * reading, so only a result with a sequence number different from the one
+         * answering the first request is taken. This repeats the request until there is
+         * one, waiting in between for roughly the duration of the conversions.
+         *
+         * In case of an error (e.g. firmware not supporting the command) null is returned.
+         */
+        suspend fun retrieve(tag: Tag, count: Int, conversionMillis: Long = defaultConversionMillis): OversampledReading? {
+            if (count !in 1..0xFFFF) {
+                throw RuntimeException("Number of conversions must fit into 16 bits.")
+            }
+            val parameters = byteArrayOf((count and 0xFF).toByte(), ((count shr 8) and 0xFF).toByte())
+            var firstSequence: Int? = null
+            for (i in 0 until attempts) {
+                val answer = NFCUtil.customCommand(tag, command, parameters) ?: return null
+                if (answer.size < answerLength) {
+                    Log.w(OversampledReading::class.java.name, "Oversampling answer too short.")
+                    return null
+                }
+                val answerCount = Util.littleEndianDecode(answer.sliceArray(0 until 2)).toInt()
+                val sequence = Util.littleEndianDecode(answer.sliceArray(6 until 8)).toInt()
+                if (firstSequence == null) {
+                    firstSequence = sequence
+                } else if (answerCount == count && sequence != firstSequence) {
+                    return OversampledReading(
+                        answerCount, Util.littleEndianDecode(answer.sliceArray(2 until 6)), sequence)
+                }
+                delay(count * conversionMillis)
+            }
+            Log.w(OversampledReading::class.java.name, "No oversampled result available.")
+            return null
+        }
+    }
+}
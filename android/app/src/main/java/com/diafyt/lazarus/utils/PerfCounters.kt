@@ -0,0 +1,69 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+import android.util.Log
+
+/**
+ * Performance counters which the firmware keeps in FRAM.
+ *
+ * They live in blocks 37 and 38 plus two bytes of block 72 (see the README
+ * for the exact layout) and wrap around, so comparing two snapshots tells
+ * what happened in between.
+ *
+ * @param conversions results of the measurement hardware
+ * @param wakeups interrupts which woke up the sensor, a measure of the time out of low power mode
+ * @param overflows conversion results lost because they were not read in time
+ * @param commands custom commands received
+ * @param timerEvents events of the sample log timer
+ * @param boots times the firmware started, frequent boots hint at a weak field
+ * @param activeTicks milliseconds out of low power mode while the firmware timer runs,
+ *        each wakeup counts as a whole tick or none, so only large differences are meaningful
+ */
+class PerfCounters(
+    val conversions: Long, val wakeups: Long, val overflows: Int,
+    val commands: Int, val timerEvents: Int, val boots: Int, val activeTicks: Int
+) {
+    /**
+     * Single line representation for logging and export.
+     */
+    override fun toString(): String {
+        return "conversions=$conversions wakeups=$wakeups overflows=$overflows " +
+                "commands=$commands timerEvents=$timerEvents boots=$boots activeTicks=$activeTicks"
+    }
+
+    companion object {
+        private const val firstBlock = 37
+        private const val blockCount = 2
+        private const val blocklen = 8
+        private const val activeTicksBlock = 72
+        private const val activeTicksOffset = 2
+
+        /**
+         * Read the counters with a read multiple blocks command and the
+         * active ticks behind the temperature table with a read single block
+         * command.
+         *
+         * In case of a communication error null is returned.
+         */
+        suspend fun retrieve(tag: Tag): PerfCounters? {
+            val raw = NFCUtil.readMultipleBlocks(
+                tag, firstBlock.toByte(), blockCount.toByte()) ?: return null
+            if (raw.size != blockCount * blocklen) {
+                Log.w(PerfCounters::class.java.name, "Unexpected answer length while reading the counters.")
+                return null
+            }
+            val active = NFCUtil.readBlock(tag, activeTicksBlock.toByte()) ?: return null
+            if (active.size != blocklen) {
+                Log.w(PerfCounters::class.java.name, "Unexpected answer length while reading the active ticks.")
+                return null
+            }
+            fun value(offset: Int, length: Int): Long {
+                return Util.littleEndianDecode(raw.sliceArray(offset until offset + length))
+            }
+            return PerfCounters(
+                value(0, 4), value(4, 4), value(8, 2).toInt(),
+                value(10, 2).toInt(), value(12, 2).toInt(), value(14, 2).toInt(),
+                Util.littleEndianDecode(active.sliceArray(activeTicksOffset until activeTicksOffset + 2)).toInt())
+        }
+    }
+}
@@ -0,0 +1,77 @@
+package com.diafyt.lazarus.utils
+
+import android.content.Context
+import android.util.Log
+import java.io.File
+import java.io.IOException
+import java.security.MessageDigest
+
+/**
+ * Keep compiled delivery plans so a payload is parsed and checked only once.
+ *
+ * A plan is compiled from its asset the first time it is needed and stored in
+ * binary form (see DeliveryPlan.toBinary()) named after the asset and a hash
+ * of its contents, so a changed asset is compiled again even if the version of
+ * the app stays the same. Later requests are served from memory, after a
+ * restart from the stored file, which costs reading and hashing the asset but
+ * not parsing it. Files of other asset contents are removed when a plan is
+ * compiled.
+ */
+object PlanCache {
+    private val plans = HashMap<String, DeliveryPlan>()
+
+    /**
+     * Retrieve the plan for a TI-TXT asset, returns null if it is broken.
+     */
+    fun get(context: Context, asset: String): DeliveryPlan? {
+        synchronized(this) {
+            plans[asset]?.let { return it }
+            val bytes = try {
+                context.assets.open(asset).use { it.readBytes() }
+            } catch (e: IOException) {
+                ExceptionArchivist.log(e, "Reading payload asset failed.")
+                return null
+            }
+            val dir = File(context.filesDir, "plans")
+            val file = File(dir, "$asset-${contentHash(bytes)}.bin")
+            var plan = if (file.exists()) {
+                try {
+                    DeliveryPlan.fromBinary(file.readBytes())
+                } catch (e: IOException) {
+                    Log.w(javaClass.name, "Reading compiled plan failed.", e)
+                    null
+                }
+            } else {
+                null
+            }
+            if (plan == null) {
+                Log.i(javaClass.name, "Compiling plan for $asset.")
+                plan = DeliveryPlan.create(bytes.toString(Charsets.US_ASCII)) ?: return null
+                store(dir, file, asset, plan)
+            }
+            plans[asset] = plan
+            return plan
+        }
+    }
+
+    /**
+     * Name the contents of an asset, the first 64 bits of its SHA-256 in hex.
+     */
+    private fun contentHash(bytes: ByteArray): String {
+        return MessageDigest.getInstance("SHA-256").digest(bytes).take(8)
+            .joinToString("") { "%02x".format(it.toInt() and 0xFF) }
+    }
+
+    private fun store(dir: File, file: File, asset: String, plan: DeliveryPlan) {
+        if (!dir.exists() && !dir.mkdirs()) {
+            Log.w(javaClass.name, "Failed to create plan directory.")
+            return
+        }
+        dir.listFiles { _, name -> name.startsWith("$asset-") }?.forEach { it.delete() }
+        try {
+            file.writeBytes(plan.toBinary())
+        } catch (e: IOException) {
+            ExceptionArchivist.log(e, "Storing compiled plan failed.")
+        }
+    }
+}
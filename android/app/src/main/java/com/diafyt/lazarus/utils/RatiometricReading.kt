@@ -0,0 +1,62 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+import android.util.Log
+
+/**
+ * Raw conversion results of all analog channels taken back to back by the firmware.
+ *
+ * The thermistor and the reference resistor are driven by the same current source,
+ * so their ratio does not depend on its drift.
+ *
+ * The command is an opt-in build of the firmware (RATIOMETRIC_COMMAND_ENABLED in
+ * main.c), the default image and the payload lack it. Callers check the command
+ * table of the tag first, the app only exports a triple and shows nothing of it.
+ *
+ * @param sequence number of the triple, increments with every triple the firmware completes
+ */
+class RatiometricReading(val reference: Int, val thermistor: Int, val internalTemperature: Int, val sequence: Int) {
+    /**
+     * Thermistor reading relative to the reference resistor reading.
+     */
+    val ratio: Double?
+        get() = if (reference > 0) thermistor.toDouble() / reference else null
+
+    override fun toString(): String {
+        return "reference=$reference thermistor=$thermistor internal=$internalTemperature " +
+                "ratio=${ratio ?: "-"} sequence=$sequence"
+    }
+
+    companion object {
+        /**
+         * Custom command answering with the newest triple and starting the next one.
+         */
+        const val command = 0xB4.toByte()
+        private const val answerLength = 8
+
+        /**
+         * Retrieve all channels with a single request.
+         *
+         * The firmware takes a triple right behind each temperature conversion, so after a
+         * temperature reading the answer holds a triple taken along with it. Sequence number
+         * zero means no triple was completed since power up.
+         *
+         * In case of an error (e.g. firmware not supporting the command) null is returned.
+         */
+        suspend fun retrieve(tag: Tag): RatiometricReading? {
+            val answer = NFCUtil.customCommand(tag, command) ?: return null
+            if (answer.size < answerLength) {
+                Log.w(RatiometricReading::class.java.name, "Ratiometric answer too short.")
+                return null
+            }
+            fun word(offset: Int): Int {
+                return Util.littleEndianDecode(answer.sliceArray(offset until offset + 2)).toInt()
+            }
+            if (word(6) == 0) {
+                Log.w(RatiometricReading::class.java.name, "No ratiometric triple completed yet.")
+                return null
+            }
+            return RatiometricReading(word(0), word(2), word(4), word(6))
+        }
+    }
+}
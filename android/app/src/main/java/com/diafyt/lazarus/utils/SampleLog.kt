@@ -0,0 +1,122 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+import android.util.Log
+import kotlin.math.min
+
+/**
+ * Access the sample log which the firmware records autonomously into FRAM.
+ *
+ * The log consists of a header block followed by a ring buffer of entries
+ * (see the README for the exact layout). Everything is retrieved via read
+ * multiple blocks so the whole history takes only a few NFC commands.
+ */
+object SampleLog {
+    private const val headerBlock = 4
+    private const val entryCount = 64
+    private const val entryLength = 4
+    private const val blocklen = 8
+    private const val blockCount = 1 + entryCount * entryLength / blocklen
+
+    /**
+     * Custom command relying on the interrupt service routines of the firmware,
+     * which lets it pick up the header. The temperature command is part of every
+     * fully flashed image, which is the only one keeping a log.
+     */
+    private const val wakeCommand = 0xB7.toByte()
+
+    /**
+     * Maximal number of blocks requested per read multiple blocks command.
+     */
+    private const val blocksPerRead = 3
+
+    /**
+     * A single logged sample.
+     *
+     * @param minutes time of the sample in minutes since logging was enabled
+     * @param raw conversion result as also returned by the custom command
+     */
+    class Entry(val minutes: Int, val raw: Int)
+
+    /**
+     * The log as retrieved from a tag.
+     *
+     * @param interval minutes between two samples, zero if logging is disabled
+     * @param minutes minutes elapsed since logging was enabled
+     * @param entries samples in chronological order
+     */
+    class History(val interval: Int, val minutes: Int, val entries: List<Entry>)
+
+    /**
+     * Read the whole log from the tag.
+     *
+     * In case of a communication error null is returned.
+     */
+    suspend fun retrieve(tag: Tag): History? {
+        val raw = ByteArray(blockCount * blocklen)
+        var block = 0
+        // the first read also yields the header, which tells how much of the buffer is in use
+        var needed = blocksPerRead
+        while (block < needed) {
+            val num = min(blocksPerRead, needed - block)
+            val data = NFCUtil.readMultipleBlocks(
+                tag, (headerBlock + block).toByte(), num.toByte()) ?: return null
+            if (data.size != num * blocklen) {
+                Log.w(javaClass.name, "Unexpected answer length while reading the log.")
+                return null
+            }
+            System.arraycopy(data, 0, raw, block * blocklen, data.size)
+            if (block == 0) {
+                val count = min(word(raw, 4), entryCount)
+                needed = 1 + (count * entryLength + blocklen - 1) / blocklen
+            }
+            block += num
+        }
+        return decode(raw)
+    }
+
+    /**
+     * Start a new log with the given interval (in minutes).
+     *
+     * This discards all previous entries. An interval of zero disables logging.
+     * The firmware only looks at the header when it wakes up, which it does
+     * not on its own while logging is disabled, so a custom command follows.
+     */
+    suspend fun enable(tag: Tag, interval: Int): Boolean {
+        val header = byteArrayOf(
+            (interval and 0xFF).toByte(), ((interval shr 8) and 0xFF).toByte(),
+            0x00, 0x00, // next
+            0x00, 0x00, // count
+            0x00, 0x00  // minutes
+        )
+        if (NFCUtil.writeBlock(tag, headerBlock.toByte(), header) == null) {
+            return false
+        }
+        return NFCUtil.customCommand(tag, wakeCommand) != null
+    }
+
+    /**
+     * Convert the raw memory contents into a history.
+     */
+    private fun decode(raw: ByteArray): History {
+        val interval = word(raw, 0)
+        val next = word(raw, 2) % entryCount
+        val count = min(word(raw, 4), entryCount)
+        val minutes = word(raw, 6)
+        val entries = ArrayList<Entry>()
+        // the oldest entry is at 'next' once the ring buffer wrapped around
+        val first = if (count < entryCount) 0 else next
+        for (i in 0 until count) {
+            val offset = blocklen + ((first + i) % entryCount) * entryLength
+            entries.add(Entry(word(raw, offset), word(raw, offset + 2)))
+        }
+        return History(interval, minutes, entries)
+    }
+
+    /**
+     * Decode the little endian 16 bit value at the given offset.
+     */
+    private fun word(raw: ByteArray, offset: Int): Int {
+        return Util.littleEndianDecode(raw.sliceArray(offset until offset + 2)).toInt()
+    }
+}
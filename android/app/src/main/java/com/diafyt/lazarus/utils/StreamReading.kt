@@ -0,0 +1,76 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+import android.util.Log
+
+/**
+ * Burst readout of the continuous conversion on the sensor.
+ *
+ * The first request starts the SD14 in continuous mode, the firmware keeps
+ * the newest conversions in a ring buffer and hands out up to 15 of them per
+ * frame. It stops converting on its own once nobody asks for a while.
+ *
+ * The command is opt-in, it only fits instead of the checksum command; the
+ * app streams only if the driver table of the sensor lists it.
+ */
+class StreamReading(val tag: Tag) {
+    /**
+     * Sequence number of the newest sample received so far.
+     */
+    private var sequence: Int? = null
+
+    /**
+     * Number of samples that were dropped between two polls.
+     */
+    var lost = 0L
+        private set
+
+    /**
+     * Retrieve the samples converted since the previous poll, oldest first.
+     *
+     * Samples overwritten in the ring buffer before they were read are counted
+     * in [lost]. In case of an error (e.g. firmware not supporting the
+     * command) null is returned.
+     */
+    suspend fun poll(maxSamples: Int = maxBurst): List<Int>? {
+        if (maxSamples !in 1..maxBurst) {
+            throw RuntimeException("At most $maxBurst samples fit into a frame.")
+        }
+        val answer = NFCUtil.customCommand(tag, command, byteArrayOf(maxSamples.toByte())) ?: return null
+        if (answer.size < 2 || answer.size % 2 != 0) {
+            Log.w(javaClass.name, "Stream answer malformed.")
+            return null
+        }
+        val newest = Util.littleEndianDecode(answer.sliceArray(0 until 2)).toInt()
+        val samples = (2 until answer.size step 2).map {
+            Util.littleEndianDecode(answer.sliceArray(it until it + 2)).toInt()
+        }
+        val previous = sequence
+        sequence = newest
+        if (previous == null) {
+            return samples
+        }
+        val fresh = (newest - previous) and 0xFFFF
+        if (fresh > samples.size) {
+            lost += fresh - samples.size
+        }
+        return samples.takeLast(minOf(fresh, samples.size))
+    }
+
+    companion object {
+        /**
+         * Custom command answering with the newest samples of the stream.
+         */
+        const val command = 0xB8.toByte()
+
+        /**
+         * Samples fitting into a frame besides the sequence number.
+         */
+        const val maxBurst = 15
+
+        /**
+         * Duration of a conversion at the fastest SD14RATE of the 2 kHz SD14 clock.
+         */
+        const val conversionMillis = 16L
+    }
+}
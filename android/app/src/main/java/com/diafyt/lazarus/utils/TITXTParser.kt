@@ -1,103 +1,174 @@
 package com.diafyt.lazarus.utils
 
 /**
- * Parse the TI-TXT format for describing binary images.
+ * Parse the TI-TXT format for describing binary images of the sensor memory.
  *
- * This uses a state machine (with the state kept in the `state` variable)
- * and transition functions (stored in the `transitionMatrix` variable)
- * which are selected by matching regular expressions on the token at hand.
+ * This reads the characters in a single pass straight into a preallocated
+ * image of the 244 blocks of FRAM visible via NFC, keeping track of which
+ * blocks were written. The layout rules are checked while parsing: sections
+ * have to start on a block boundary and consist of whole blocks, must not
+ * overlap, must contain all or none of the header (blocks 0 to 2), must
+ * leave the interrupt vectors (last four blocks) alone and block 39 has to
+ * be present.
+ *
+ * An instance may be reused for any number of documents, parsing does not
+ * allocate unless it fails. The results stay valid until the next call of
+ * parse().
  *
  * This raises TITXTParser.ParseException on malformed input.
  */
 class TITXTParser {
-    private var state = TITXTParserStates.INITIAL
-    private var result = HashMap<Int, ByteArray>()
-    private var address: Int? = null
-    private var chunk: ArrayList<Byte>? = null
-    private val transitionMatrix = mapOf(
-        Pair(TITXTParserStates.INITIAL, mapOf(
-            Pair(Regex("^@([0-9a-fA-F]+)$"), ::newSection),
-            Pair(Regex("^q$"), ::done))),
-        Pair(TITXTParserStates.SECTION, mapOf(
-            Pair(Regex("^@([0-9a-fA-F]+)$"), ::newSection),
-            Pair(Regex("^[0-9a-fA-F]{2}$"), ::newByte),
-            Pair(Regex("^q$"), ::done))),
-        Pair(TITXTParserStates.DONE, mapOf()))
+    /**
+     * Contents of the FRAM, only the written blocks are meaningful.
+     */
+    val image = ByteArray(blockCount * blockSize)
 
-    enum class TITXTParserStates {
-        INITIAL, SECTION, DONE
-    }
+    /**
+     * Which blocks of the image were written.
+     */
+    val written = BooleanArray(blockCount)
+
+    /**
+     * First block and number of blocks of each section in document order.
+     */
+    val sectionBlocks = IntArray(blockCount)
+    val sectionLengths = IntArray(blockCount)
+    var sectionCount = 0
+        private set
 
     class ParseException(message: String) : RuntimeException(message)
 
     /**
-     * Reset this instance so it is ready to parse a new document.
+     * Parse a document, returns the number of sections.
      */
-    private fun initialize() {
-        state = TITXTParserStates.INITIAL
-        result = HashMap()
-        address = null
-        chunk = null
-    }
-
-    private fun maySaveSection() {
-        address?.let { a ->
-            chunk?.let {c ->
-                result[a] = c.toByteArray()
-                address = null
-                chunk = null
+    fun parse(input: CharSequence): Int {
+        written.fill(false)
+        sectionCount = 0
+        var position = -1                 // offset of the next byte into the image, -1 outside of a section
+        var sectionStart = 0
+        var i = 0
+        val n = input.length
+        while (i < n) {
+            val c = input[i]
+            if (isSeparator(c)) {
+                i++
+                continue
+            }
+            when {
+                c == '@' -> {
+                    if (position >= 0) {
+                        endSection(sectionStart, position)
+                    }
+                    var address = 0
+                    var digits = 0
+                    i++
+                    while (i < n && !isSeparator(input[i])) {
+                        val digit = hexDigit(input[i])
+                        if (digit < 0 || digits == 4) {
+                            throw ParseException("Malformed address at offset $i")
+                        }
+                        address = (address shl 4) or digit
+                        digits++
+                        i++
+                    }
+                    if (digits == 0) {
+                        throw ParseException("Missing address at offset $i")
+                    }
+                    position = startSection(address)
+                    sectionStart = position
+                }
+                c == 'q' && (i + 1 == n || isSeparator(input[i + 1])) -> {
+                    if (position >= 0) {
+                        endSection(sectionStart, position)
+                    }
+                    i++
+                    while (i < n) {
+                        if (!isSeparator(input[i])) {
+                            throw ParseException("Data after the end of input at offset $i")
+                        }
+                        i++
+                    }
+                    if (!written[programKeyBlock]) {
+                        throw ParseException("Payload must contain block $programKeyBlock")
+                    }
+                    return sectionCount
+                }
+                else -> {
+                    val high = hexDigit(c)
+                    val low = if (i + 1 < n) hexDigit(input[i + 1]) else -1
+                    if (position < 0 || high < 0 || low < 0 || (i + 2 < n && !isSeparator(input[i + 2]))) {
+                        throw ParseException("Malformed byte at offset $i")
+                    }
+                    if (position % blockSize == 0) {
+                        claimBlock(position / blockSize)
+                    }
+                    image[position++] = ((high shl 4) or low).toByte()
+                    i += 2
+                }
             }
         }
+        throw ParseException("Input was not correctly terminated")
     }
 
-    // ([TITXTParserStates.INITIAL, TITXTParserStates.SECTION], "@([0-9a-fA-F]+)")
-    private fun newSection(match: MatchResult) {
-        maySaveSection()
-        address = match.groupValues[1].toInt( 16)
-        chunk = ArrayList()
-        state = TITXTParserStates.SECTION
+    /**
+     * Check the address of a new section, returns its offset into the image.
+     */
+    private fun startSection(address: Int): Int {
+        if (address < baseAddress || address % blockSize != 0) {
+            throw ParseException(String.format("Section at 0x%04x is not a block of the FRAM", address))
+        }
+        val block = (address - baseAddress) / blockSize
+        if (block in 1 until headerBlocks) {
+            throw ParseException("Payload must contain all or none of the header")
+        }
+        sectionBlocks[sectionCount] = block
+        return address - baseAddress
     }
 
-    // ([TITXTParserStates.SECTION], "[0-9a-fA-F]{2}")
-    private fun newByte(match: MatchResult) {
-        chunk?.add(match.groupValues[0].toInt(16).toByte())
+    /**
+     * Mark a block as written by the current section.
+     */
+    private fun claimBlock(block: Int) {
+        if (block >= blockCount - vectorBlocks) {
+            throw ParseException("Payload must not overwrite the interrupt vectors")
+        }
+        if (written[block]) {
+            throw ParseException("Sections overlap in block $block")
+        }
+        written[block] = true
     }
 
-    // ([TITXTParserStates.INITIAL, TITXTParserStates.SECTION], "q")
-    private fun done(@Suppress("UNUSED_PARAMETER") match: MatchResult) {
-        maySaveSection()
-        state = TITXTParserStates.DONE
+    private fun endSection(start: Int, end: Int) {
+        if ((end - start) % blockSize != 0) {
+            throw ParseException("Section length must be divisible by $blockSize")
+        }
+        if (start == 0 && end > start && end < headerBlocks * blockSize) {
+            throw ParseException("Payload must contain all or none of the header")
+        }
+        if (end > start) {
+            sectionLengths[sectionCount++] = (end - start) / blockSize
+        }
     }
 
-    private fun lex(input: String): List<String>{
-        return input.split(Regex("\\s+"))
-    }
+    companion object {
+        const val baseAddress = 0xf860
+        const val blockSize = 8
+        const val blockCount = 244
+        const val headerBlocks = 3
+        const val programKeyBlock = 39
+        private const val vectorBlocks = 4
 
-    private fun parse(tokens: List<String>): Map<Int, ByteArray> {
-        for (token in tokens) {
-            if (token.isNotEmpty()) {
-                var hasMatched = false
-                for (regex in transitionMatrix[state]!!.keys) {
-                    val match = regex.find(token)
-                    if (match != null) {
-                        hasMatched = true
-                        transitionMatrix[state]!![regex]!!(match)
-                        break
-                    }
-                }
-                if (!hasMatched) {
-                    throw ParseException("Parsing failed at token '$token'")
-                }
-            }
-        }
-        if (state != TITXTParserStates.DONE) {
-            throw ParseException("Input was not correctly terminated")
+        private fun isSeparator(c: Char): Boolean {
+            return c == ' ' || c == '\n' || c == '\r' || c == '\t'
         }
-        return result
-    }
 
-    fun process(input: String): Map<Int, ByteArray> {
-        initialize()
-        return parse(lex(input))
+        private fun hexDigit(c: Char): Int {
+            return when (c) {
+                in '0'..'9' -> c - '0'
+                in 'a'..'f' -> c - 'a' + 10
+                in 'A'..'F' -> c - 'A' + 10
+                else -> -1
+            }
+        }
     }
-}
\ No newline at end of file
+}
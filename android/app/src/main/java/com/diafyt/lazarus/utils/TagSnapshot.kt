@@ -0,0 +1,161 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+import android.util.Log
+import kotlin.math.min
+
+/**
+ * Image of all 244 blocks of FRAM visible via NFC (0xf860 to 0xffff) of a tag.
+ *
+ * Snapshots are cached per tag UID, so repeated taps on the same sensor do not
+ * have to discover its contents again. A snapshot stays valid as long as the
+ * header (blocks 0 to 2, including its CRC) on the tag is unchanged, which is
+ * checked with a single read. Blocks the firmware writes on its own are not
+ * covered by this: the sample log and the counters are always read from the
+ * tag, block 39 with the sensor time is read by every key check, which also
+ * refreshes it in the snapshot.
+ *
+ * A snapshot need not cover the whole tag: one started from a header only
+ * learns the blocks read or written through update(), e.g. the sections
+ * compared by a delivery, and answers for those alone. The full read uses the
+ * largest read multiple blocks command the tags accept, found by growing the
+ * batch from the size known to work.
+ */
+class TagSnapshot private constructor(val image: ByteArray, private val known: BooleanArray) {
+    /**
+     * Contents of the given blocks.
+     */
+    fun blocks(first: Int, count: Int): ByteArray {
+        return image.copyOfRange(blocklen * first, blocklen * (first + count))
+    }
+
+    /**
+     * Whether the contents of all the given blocks are known.
+     */
+    fun covers(first: Int, count: Int): Boolean {
+        synchronized(Companion) {
+            return (first until first + count).all { known[it] }
+        }
+    }
+
+    companion object {
+        const val blockCount = 244
+        const val headerBlocks = 3
+        private const val blocklen = 8
+
+        /**
+         * Number of snapshots kept, the least recently used goes first.
+         */
+        private const val cachedTags = 16
+
+        /**
+         * Largest batch which is still a valid read multiple blocks request
+         * with an answer fitting into a single frame.
+         */
+        private const val largestBatch = 31
+
+        private val cache = object : LinkedHashMap<String, TagSnapshot>(cachedTags, 0.75f, true) {
+            override fun removeEldestEntry(eldest: MutableMap.MutableEntry<String, TagSnapshot>?): Boolean {
+                return size > cachedTags
+            }
+        }
+
+        // blocks per read multiple blocks command known to work and whether larger ones were tried
+        private var batch = 3
+        private var batchSettled = false
+
+        private fun key(tag: Tag): String {
+            return NFCTransport.uid(tag).joinToString("") { String.format("%02X", it) }
+        }
+
+        /**
+         * Cached snapshot of the tag if the given header matches it.
+         */
+        fun lookup(tag: Tag, header: ByteArray): TagSnapshot? {
+            synchronized(this) {
+                val snapshot = cache[key(tag)] ?: return null
+                return if (snapshot.image.copyOfRange(0, header.size).contentEquals(header)) snapshot else null
+            }
+        }
+
+        /**
+         * Cached snapshot of the tag if the given header matches it, otherwise
+         * a new one knowing only the header, which replaces the cached one.
+         */
+        fun start(tag: Tag, header: ByteArray): TagSnapshot? {
+            if (header.size != headerBlocks * blocklen) {
+                return null
+            }
+            synchronized(this) {
+                lookup(tag, header)?.let { return it }
+                val image = ByteArray(blockCount * blocklen)
+                header.copyInto(image)
+                val snapshot = TagSnapshot(image, BooleanArray(blockCount) { it < headerBlocks })
+                cache[key(tag)] = snapshot
+                return snapshot
+            }
+        }
+
+        /**
+         * Read the remaining blocks of a tag whose header was just read and
+         * cache the result.
+         *
+         * In case of a communication error null is returned.
+         */
+        suspend fun read(tag: Tag, header: ByteArray): TagSnapshot? {
+            if (header.size != headerBlocks * blocklen) {
+                return null
+            }
+            val image = ByteArray(blockCount * blocklen)
+            header.copyInto(image)
+            var block = headerBlocks
+            while (block < blockCount) {
+                val known = synchronized(this) { batch }
+                val probing = synchronized(this) { !batchSettled } && known < largestBatch
+                val num = min(if (probing) min(2 * known, largestBatch) else known, blockCount - block)
+                val data = NFCUtil.readMultipleBlocks(tag, block.toByte(), num.toByte())
+                if (data == null || data.size != num * blocklen) {
+                    if (num <= known) {
+                        Log.w(TagSnapshot::class.java.name, "Reading the tag failed at block $block.")
+                        return null
+                    }
+                    // the tag refuses batches this large, stay with what worked
+                    synchronized(this) { batchSettled = true }
+                    Log.i(TagSnapshot::class.java.name, "Tag reads at most $known blocks per command.")
+                    continue
+                }
+                if (num > known) {
+                    synchronized(this) { batch = maxOf(batch, num) }
+                }
+                data.copyInto(image, block * blocklen)
+                block += num
+            }
+            val snapshot = TagSnapshot(image, BooleanArray(blockCount) { true })
+            synchronized(this) {
+                cache[key(tag)] = snapshot
+            }
+            return snapshot
+        }
+
+        /**
+         * Record blocks read from or written to the tag in its cached snapshot.
+         */
+        fun update(tag: Tag, first: Int, data: ByteArray) {
+            synchronized(this) {
+                cache[key(tag)]?.let {
+                    data.copyInto(it.image, first * blocklen)
+                    it.known.fill(true, first, min(first + data.size / blocklen, blockCount))
+                }
+            }
+        }
+
+        /**
+         * Forget the snapshot of the tag, for when it is found to be outdated.
+         */
+        fun invalidate(tag: Tag) {
+            synchronized(this) {
+                cache.remove(key(tag))
+            }
+        }
+    }
+}
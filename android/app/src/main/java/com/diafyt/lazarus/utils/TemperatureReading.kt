@@ -0,0 +1,137 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+import android.util.Log
+import kotlin.math.ln
+import kotlin.math.pow
+
+/**
+ * Temperature measurement of a sensor reprogrammed as thermometer.
+ *
+ * @param celsius the temperature in degrees Celsius
+ * @param calibrated whether the firmware converted the sample itself
+ * @param table the dispatch table of the tag, null if reading it failed
+ */
+class TemperatureReading(val celsius: Double, val calibrated: Boolean, val table: CommandTable?) {
+    companion object {
+        private const val sampleWithStatusLength = 4
+        private const val calibratedCommand = 0xB7.toByte()
+        private const val sampleCommand = 0xB3.toByte()
+        private const val thermistorSettings = 0xD043 // SD14CTL1 for the thermistor
+        private const val maxSampleRequests = 2
+
+        /**
+         * Perform the actual temperature measurement.
+         *
+         * Firmware with the temperature lookup table converts the sample itself, which the
+         * dispatch table on the tag tells; the table is cached per tag (see CommandTable.cached()).
+         * Its interrupt service routine completes a conversion ahead of each request, so a single
+         * request gets a valid sample. Only a fully flashed image has it.
+         * The handler of the thermometer payload has no interrupt service routine and takes the
+         * SD14 settings as parameter. It converts while the request waits and switches the SD14
+         * off again, so a single request gets a fresh sample as well. Its answer carries a status
+         * of zero only if the SD14 was busy with a conversion of a fully flashed image, which is
+         * over by the time the request is repeated.
+         *
+         * In case of a communication error null is returned.
+         */
+        suspend fun retrieve(tag: Tag): TemperatureReading? {
+            Log.i(TemperatureReading::class.java.name, "Retrieving temperature reading.")
+            val table = CommandTable.cached(tag)
+            if (table == null) {
+                Log.w(TemperatureReading::class.java.name, "Reading the command table failed.")
+            }
+            // firmware with the lookup table answers in centi-degrees Celsius
+            if (table != null && table.provides(calibratedCommand)) {
+                val answer = NFCUtil.customCommand(tag, calibratedCommand)
+                if (answer == null) {
+                    CommandTable.forget(tag)
+                } else if (answer.size >= sampleWithStatusLength && status(answer) != 0) {
+                    val centi = Util.littleEndianDecode(answer.sliceArray(0 until 2)).toShort()
+                    Log.i(TemperatureReading::class.java.name, "Retrieved calibrated temperature reading.")
+                    return TemperatureReading(centi / 100.0, true, table)
+                }
+            }
+            var result: ByteArray? = null
+            for (attempt in 1..maxSampleRequests) {
+                val answer = sampleRequest(tag, thermistorSettings)
+                if (answer == null) {
+                    CommandTable.forget(tag)
+                    break
+                }
+                // payloads built before the status was added answer with the sample alone
+                if (answer.size < sampleWithStatusLength || status(answer) != 0) {
+                    result = answer
+                    break
+                }
+                Log.i(TemperatureReading::class.java.name, "SD14 busy, repeating the request.")
+            }
+            if (result == null || result.size < 2) {
+                Log.w(TemperatureReading::class.java.name, "Measurement failed.")
+                return null
+            }
+            Log.i(TemperatureReading::class.java.name, "Measurement done.")
+            val raw = Util.littleEndianDecode(result.sliceArray(0 until 2)).toInt()
+            Log.i(TemperatureReading::class.java.name, "Retrieved temperature reading.")
+            return TemperatureReading(calibrate(raw), false, table)
+        }
+
+        /**
+         * Send the custom command of the payload with the given SD14CTL1 settings,
+         * returns the answer without status flags or null on failure.
+         */
+        private suspend fun sampleRequest(tag: Tag, settings: Int): ByteArray? {
+            val answer = NFCUtil.customCommand(
+                tag, sampleCommand, byteArrayOf((settings and 0xFF).toByte(), (settings shr 8).toByte()))
+            answer?.let { Log.i(TemperatureReading::class.java.name, "Answer was " + Util.bytesToHex(it)) }
+            return answer
+        }
+
+        /**
+         * Convert the raw value received from the reprogrammed sensor into
+         * an actual temperature value in degree Celsius.
+         *
+         * The offset stands in for the reference resistor, the payload answers with
+         * the thermistor alone. The fully flashed firmware converts on the sensor
+         * (B7) and reports the reference resistor along with the thermistor in the
+         * ratiometric triple (B4, see RatiometricReading) taken behind each sample.
+         */
+        fun calibrate(raw: Int): Double {
+            return calibrate(raw.toDouble())
+        }
+
+        /**
+         * Convert a mean of raw values (e.g. of an OversampledReading), which keeps the
+         * resolution gained by averaging, like calibrate() of a single raw value.
+         */
+        fun calibrate(raw: Double): Double {
+            val r = raw + 411.737
+            val kelvin = steinharthart(
+                a=0.000679241, b=0.000324031, c=-0.000000173770, d=-0.0000000000677986, r=r)
+            return kelvin - 273.15
+        }
+
+        /**
+         * Implement the Steinhart-Hart equation calculating the dependency between
+         * temperature and resistance of a thermistor.
+         *
+         * The lookup table of the firmware is generated from the same coefficients
+         * (see embedded/host/table.c), keep both in sync.
+         */
+        private fun steinharthart(a: Double, b: Double, c: Double, d: Double, r: Double): Double {
+            return if (r > 0) {
+                1.0 / (a + b*ln(r) + c* ln(r).pow(3.0) + d* ln(r).pow(2.0))
+            } else {
+                0.0
+            }
+        }
+
+        /**
+         * Status (B3) or sequence number (B7) following the sample of an answer, zero
+         * if the answer holds no sample.
+         */
+        private fun status(answer: ByteArray): Int {
+            return Util.littleEndianDecode(answer.sliceArray(2 until 4)).toInt()
+        }
+    }
+}
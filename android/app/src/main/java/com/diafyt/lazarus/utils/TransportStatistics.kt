@@ -0,0 +1,267 @@
+package com.diafyt.lazarus.utils
+
+import android.util.Log
+import java.io.File
+import java.io.IOException
+import java.util.*
+
+/**
+ * Collect timing of the NFC transport for tuning chunk sizes and timeouts.
+ *
+ * Every transmission is recorded per opcode (the command code of the frame)
+ * with the number of retries and whether an answer arrived in the end. The
+ * latency is recorded per attempt, separately for answered and lost frames,
+ * so the backoff between retries does not show up as latency. Connecting is
+ * recorded separately. Times go into histograms with power of two buckets,
+ * so memory stays constant however long the app runs.
+ *
+ * Programming a tag is recorded as a whole as well, with the UID of the tag,
+ * so a provisioning run can be judged by sensors per hour. Only the most
+ * recent tags are kept individually.
+ *
+ * What the app reads from the sensors themselves, the sample log and the
+ * performance counters of the firmware, is added to the export as well, the
+ * latest of each kind for the most recent tags.
+ *
+ * This is a singleton like the ExceptionArchivist and exports into the same
+ * directory.
+ */
+object TransportStatistics {
+    private var persistenceDir: File? = null
+    private val connects = Histogram()
+    private val opcodes = TreeMap<Int, OpcodeStatistics>()
+    private val provisioning = Histogram()
+    private val provisioned = LinkedList<String>()
+    private var provisioningSuccesses = 0L
+    private var provisioningStart = 0L
+    private var provisioningEnd = 0L
+    private const val provisionedKept = 256
+    private const val sensorTagsKept = 16
+    private const val sensorDataKinds = 2
+    // keyed by UID and kind, the value starts with the time of reading
+    private val sensorData = object : LinkedHashMap<String, String>(sensorTagsKept * sensorDataKinds, 0.75f, true) {
+        override fun removeEldestEntry(eldest: MutableMap.MutableEntry<String, String>?): Boolean {
+            return size > sensorTagsKept * sensorDataKinds
+        }
+    }
+
+    /**
+     * Histogram of durations in microseconds with power of two buckets.
+     *
+     * Bucket i counts durations below 2^(i + firstShift) microseconds, the
+     * last bucket takes everything beyond.
+     */
+    class Histogram {
+        private val buckets = LongArray(bucketCount)
+        var count = 0L
+            private set
+        private var totalMicros = 0L
+        private var maxMicros = 0L
+
+        fun add(micros: Long) {
+            var bucket = 0
+            while (bucket < bucketCount - 1 && micros >= 1L shl (bucket + firstShift)) {
+                bucket++
+            }
+            buckets[bucket]++
+            count++
+            totalMicros += micros
+            maxMicros = maxOf(maxMicros, micros)
+        }
+
+        override fun toString(): String {
+            if (count == 0L) {
+                return "n=0"
+            }
+            val histogram = buckets.indices.filter { buckets[it] != 0L }.joinToString(" ") {
+                val bound = if (it < bucketCount - 1) "<${1L shl (it + firstShift)}" else ">=${1L shl (it + firstShift - 1)}"
+                "$bound:${buckets[it]}"
+            }
+            return "n=$count mean=${totalMicros / count}us max=${maxMicros}us [$histogram]"
+        }
+
+        companion object {
+            private const val firstShift = 7       // 128 us, well below a frame
+            private const val bucketCount = 14     // the last one starts at about half a second
+        }
+    }
+
+    /**
+     * Everything recorded for a single opcode.
+     */
+    class OpcodeStatistics {
+        val latency = Histogram()
+        val lostLatency = Histogram()
+        val retries = LongArray(retryBuckets)
+        var successes = 0L
+        var failures = 0L
+
+        override fun toString(): String {
+            val retryText = retries.indices.filter { retries[it] != 0L }.joinToString(" ") {
+                val bound = if (it < retryBuckets - 1) "$it" else ">=$it"
+                "$bound:${retries[it]}"
+            }
+            return "ok=$successes failed=$failures retries=[$retryText] latency $latency lost $lostLatency"
+        }
+
+        companion object {
+            const val retryBuckets = 8
+        }
+    }
+
+    /**
+     * Set up the directory for exports.
+     *
+     * @param persistenceDir path where files are to be stored
+     */
+    fun initialize(persistenceDir: File?) {
+        TransportStatistics.persistenceDir = persistenceDir
+    }
+
+    /**
+     * Record the time it took to connect to a tag.
+     */
+    fun recordConnect(micros: Long) {
+        synchronized(this) {
+            connects.add(micros)
+        }
+    }
+
+    private fun opcodeStatistics(cmd: ByteArray): OpcodeStatistics {
+        val opcode = if (cmd.size > 1) cmd[1].toInt() and 0xFF else -1
+        return opcodes.getOrPut(opcode) { OpcodeStatistics() }
+    }
+
+    /**
+     * Record a single attempt to exchange a frame.
+     *
+     * @param cmd the frame sent, its second byte is the opcode
+     * @param micros time until the answer arrived or the transport reported it lost
+     * @param answered whether an answer arrived
+     */
+    fun recordAttempt(cmd: ByteArray, micros: Long, answered: Boolean) {
+        synchronized(this) {
+            val statistics = opcodeStatistics(cmd)
+            if (answered) {
+                statistics.latency.add(micros)
+            } else {
+                statistics.lostLatency.add(micros)
+            }
+        }
+    }
+
+    /**
+     * Record the final outcome of a transmission.
+     *
+     * @param cmd the frame sent, its second byte is the opcode
+     * @param retries attempts beyond the first one
+     * @param success whether an answer arrived
+     */
+    fun recordCommand(cmd: ByteArray, retries: Int, success: Boolean) {
+        synchronized(this) {
+            val statistics = opcodeStatistics(cmd)
+            statistics.retries[minOf(retries, OpcodeStatistics.retryBuckets - 1)]++
+            if (success) {
+                statistics.successes++
+            } else {
+                statistics.failures++
+            }
+        }
+    }
+
+    /**
+     * Record programming a tag from the tap to the final outcome.
+     *
+     * @param uid the ID of the tag
+     * @param start wall clock time of the tap in milliseconds
+     * @param micros time until the tag was programmed or programming failed
+     * @param success whether the payload was delivered and verified
+     */
+    fun recordProvisioning(uid: ByteArray, start: Long, micros: Long, success: Boolean) {
+        val uidText = uid.reversed().joinToString("") { String.format("%02X", it) }
+        synchronized(this) {
+            provisioning.add(micros)
+            if (success) {
+                provisioningSuccesses++
+            }
+            if (provisioning.count == 1L) {
+                provisioningStart = start
+            }
+            provisioningEnd = start + micros / 1000
+            if (provisioned.size == provisionedKept) {
+                provisioned.removeFirst()
+            }
+            provisioned.addLast("tag $uidText at ${Date(start)} took ${micros / 1000}ms ${if (success) "ok" else "failed"}")
+        }
+    }
+
+    /**
+     * Keep data read from a sensor for the export, replacing what was
+     * recorded before for the same tag and kind.
+     *
+     * @param uid the ID of the tag
+     * @param kind what the data is, e.g. "sample log"
+     * @param text the data, one item per line
+     */
+    fun recordSensorData(uid: ByteArray, kind: String, text: String) {
+        val uidText = uid.reversed().joinToString("") { String.format("%02X", it) }
+        synchronized(this) {
+            sensorData["tag $uidText $kind"] = "at ${Date()}\n$text"
+        }
+    }
+
+    /**
+     * Human readable summary of everything recorded so far.
+     */
+    fun report(): String {
+        synchronized(this) {
+            val builder = StringBuilder()
+            builder.append("connect $connects\n")
+            for ((opcode, statistics) in opcodes) {
+                builder.append(String.format("opcode 0x%02X %s\n", opcode, statistics))
+            }
+            if (provisioning.count != 0L) {
+                val hours = maxOf(provisioningEnd - provisioningStart, 1L) / 3600000.0
+                builder.append(String.format("provisioning ok=%d failed=%d sensors/h=%.1f time %s\n",
+                    provisioningSuccesses, provisioning.count - provisioningSuccesses,
+                    provisioningSuccesses / hours, provisioning))
+                for (line in provisioned) {
+                    builder.append(line).append('\n')
+                }
+            }
+            for ((title, text) in sensorData) {
+                builder.append(title).append(' ').append(text)
+                if (!text.endsWith('\n')) {
+                    builder.append('\n')
+                }
+            }
+            return builder.toString()
+        }
+    }
+
+    /**
+     * Write the summary into a file next to the exception logs.
+     *
+     * @return the file written or null on failure
+     */
+    fun export(): File? {
+        val dir = persistenceDir
+        if (dir == null) {
+            Log.w(javaClass.name, "No persistence directory supplied.")
+            return null
+        }
+        val logDir = File(dir, "log")
+        if (!logDir.exists() && !logDir.mkdirs()) {
+            Log.w(javaClass.name, "Failed to create log directory.")
+            return null
+        }
+        val file = File(logDir, "transport--" + Date().time + ".txt")
+        return try {
+            file.writeText(report())
+            file
+        } catch (e: IOException) {
+            ExceptionArchivist.log(e, "Exporting transport statistics failed.")
+            null
+        }
+    }
+}
@@ -115,13 +115,46 @@ object Util {
      * This also checks whether the tag is a Libre 1. The program key uses the location of the
      * sensor time, meaning that this also enables detection of non-expired sensors.
      *
+     * Block 39 is always read from the tag since a running sensor updates it on its own, a
+     * cached TagSnapshot of the tag is brought up to date with it.
+     *
      * In case of a tag different from a Libre 1 null is returned.
      */
     suspend fun retrieveProgramKey(tag: Tag): Int? {
-        if (tag.id[6] != 0x07.toByte() || tag.id[7] != 0xE0.toByte()) {
+        return retrieveProgramKeyAndHeader(tag)?.first
+    }
+
+    /**
+     * Retrieve the program signature along with the header read to check the tag.
+     *
+     * Passing the header on (e.g. to TagSnapshot.lookup()) saves reading it again.
+     */
+    suspend fun retrieveProgramKeyAndHeader(tag: Tag): Pair<Int, ByteArray>? {
+        val uid = NFCTransport.uid(tag)
+        if (uid[6] != 0x07.toByte() || uid[7] != 0xE0.toByte()) {
             // wrong manufacturer
             return null
         }
+        val header = retrieveHeader(tag) ?: return null
+        val block39 = NFCUtil.readBlock(tag, 39) ?: return null
+        if (block39.size != 8) {
+            // block size different from Libre
+            return null
+        }
+        TagSnapshot.update(tag, 39, block39)
+        return Pair(littleEndianDecode(
+            block39.sliceArray(
+                4 until 6
+            )
+        ).toInt(), header)
+    }
+
+    /**
+     * Retrieve the header (blocks 0 to 2) and check its CRC.
+     *
+     * In case of a communication error or a corrupted header null is returned.
+     */
+    suspend fun retrieveHeader(tag: Tag): ByteArray? {
         val header = NFCUtil.readMultipleBlocks(tag, 0, 3) ?: return null
         val storedChecksum = littleEndianDecode(
             header.sliceArray(0 until 2)
@@ -134,15 +167,6 @@ object Util {
         if (storedChecksum != computedChecksum) {
             return null
         }
-        val block39 = NFCUtil.readBlock(tag, 39) ?: return null
-        if (block39.size != 8) {
-            // block size different from Libre
-            return null
-        }
-        return littleEndianDecode(
-            block39.sliceArray(
-                4 until 6
-            )
-        ).toInt()
+        return header
     }
 }
\ No newline at end of file
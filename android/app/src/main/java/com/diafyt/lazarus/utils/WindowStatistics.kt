@@ -0,0 +1,89 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+import android.util.Log
+
+/**
+ * Summary of a window of continuous conversions kept by the firmware.
+ *
+ * The SD14 ISR only adds up the conversions and the squares of their
+ * deviations from the first one, mean and variance are divided out here, so
+ * the firmware needs neither division nor arithmetic beyond 32 bit.
+ *
+ * The command is opt-in, it only fits instead of the checksum command; the
+ * app asks for statistics only if the driver table of the sensor lists it.
+ *
+ * @param count number of conversions in the window so far
+ * @param min smallest conversion, only valid with a count above zero
+ * @param max largest conversion, only valid with a count above zero
+ * @param first first conversion of the window, the deviations are taken from it
+ * @param sum sum of the conversions
+ * @param squares sum of the squared deviations from the first conversion
+ */
+class WindowStatistics(
+    val count: Int, val min: Int, val max: Int, val first: Int, val sum: Long, val squares: Long
+) {
+    /**
+     * Mean of the conversions, on the same scale as a single conversion.
+     */
+    val mean: Double?
+        get() = if (count > 0) sum.toDouble() / count else null
+
+    /**
+     * Sample variance of the conversions, null with fewer than two or if the
+     * firmware saturated the sum of squares.
+     */
+    val variance: Double?
+        get() {
+            if (count < 2 || squares >= saturatedSquares) {
+                return null
+            }
+            val deviation = sum.toDouble() - count.toDouble() * first
+            return (squares - deviation * deviation / count) / (count - 1)
+        }
+
+    /**
+     * Single line representation for logging and export.
+     */
+    override fun toString(): String {
+        return "count=$count min=$min max=$max mean=$mean variance=$variance"
+    }
+
+    companion object {
+        /**
+         * Custom command answering with the summary of the window.
+         */
+        const val command = 0xB9.toByte()
+        private const val answerLength = 16
+
+        /**
+         * The firmware stops adding squares once their sum reaches this.
+         */
+        private const val saturatedSquares = 0xF0000000L
+
+        /**
+         * Retrieve the summary of the current window.
+         *
+         * A nonzero window size resets the summary after answering and starts a new
+         * window of that many conversions, unless another conversion is running. In
+         * case of an error (e.g. firmware not supporting the command) null is returned.
+         */
+        suspend fun retrieve(tag: Tag, window: Int = 0): WindowStatistics? {
+            if (window !in 0..0xFFFF) {
+                throw RuntimeException("Window size must fit into 16 bits.")
+            }
+            val parameters = byteArrayOf((window and 0xFF).toByte(), ((window shr 8) and 0xFF).toByte())
+            val answer = NFCUtil.customCommand(tag, command, parameters) ?: return null
+            if (answer.size < answerLength) {
+                Log.w(WindowStatistics::class.java.name, "Statistics answer too short.")
+                return null
+            }
+            fun value(offset: Int, length: Int): Long {
+                return Util.littleEndianDecode(answer.sliceArray(offset until offset + length))
+            }
+            return WindowStatistics(
+                value(0, 2).toInt(), value(2, 2).toInt(), value(4, 2).toInt(), value(6, 2).toInt(),
+                value(8, 4), value(12, 4))
+        }
+    }
+}
@@ -0,0 +1,60 @@
+package com.diafyt.lazarus.utils
+
+import kotlinx.coroutines.runBlocking
+import org.junit.Assert.assertTrue
+import org.junit.Before
+import org.junit.Test
+import java.io.File
+import java.util.Locale
+
+/**
+ * Programming time and throughput of the thermometer payload against the rate
+ * of lost frames, delivered and verified the way ProgrammingFragment does.
+ *
+ * Every frame takes latencyMillis on the simulated sensor, the retries of
+ * AsyncNFCTask add their backoff on top, so the times are wall clock and vary
+ * a little between runs while the frames and losses repeat with the seeds. The
+ * report goes to the standard output, e.g. of
+ * ./gradlew test --tests '*DeliveryBenchmark' -i
+ */
+class DeliveryBenchmark {
+    private lateinit var payload: String
+    private lateinit var plan: DeliveryPlan
+
+    @Before
+    fun setUp() {
+        SimulatedTag.install()
+        payload = File(DeliveryPlanTest.payloadPath).readText()
+        plan = DeliveryPlan.create(payload) ?: throw AssertionError("Payload rejected.")
+    }
+
+    @Test
+    fun lossRateSweep() = runBlocking<Unit> {
+        println(String.format(Locale.ROOT, "%6s %5s %7s %6s %7s %10s %9s %8s",
+            "loss", "seed", "frames", "lost", "blocks", "time [ms]", "blocks/s", "result"))
+        for (lossRate in lossRates) {
+            for (seed in seeds) {
+                val simulated = SimulatedTag(lossRate = lossRate, seed = seed, latencyMillis = latencyMillis)
+                simulated.installPayload(payload)
+                val start = System.nanoTime()
+                val success = NFCSession.use(simulated.tag) {
+                    plan.deliver(simulated.tag) && plan.verify(simulated.tag)
+                }
+                val millis = (System.nanoTime() - start) / 1e6
+                val blocks = simulated.blocksRead + simulated.blocksWritten
+                println(String.format(Locale.ROOT, "%6.2f %5d %7d %6d %7d %10.0f %9.1f %8s",
+                    lossRate, seed, simulated.frames, simulated.lost, blocks, millis,
+                    blocks * 1000 / millis, if (success) "ok" else "failed"))
+                if (lossRate == 0.0) {
+                    assertTrue(success)
+                }
+            }
+        }
+    }
+
+    companion object {
+        private val lossRates = listOf(0.0, 0.05, 0.1, 0.2, 0.3)
+        private val seeds = listOf(1, 2, 3)
+        private const val latencyMillis = 5L
+    }
+}
@@ -0,0 +1,198 @@
+package com.diafyt.lazarus.utils
+
+import kotlinx.coroutines.runBlocking
+import org.junit.Assert.assertArrayEquals
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertFalse
+import org.junit.Assert.assertNotNull
+import org.junit.Assert.assertNull
+import org.junit.Assert.assertTrue
+import org.junit.Before
+import org.junit.Test
+import java.io.File
+
+/**
+ * Programming a simulated sensor with the thermometer payload the way
+ * ProgrammingFragment does.
+ */
+class DeliveryPlanTest {
+    private lateinit var payload: String
+    private lateinit var plan: DeliveryPlan
+
+    @Before
+    fun setUp() {
+        SimulatedTag.install()
+        payload = File(payloadPath).readText()
+        plan = DeliveryPlan.create(payload) ?: throw AssertionError("Payload rejected.")
+    }
+
+    private fun assertProgrammed(simulated: SimulatedTag) {
+        for (section in plan.sections) {
+            val first = section.initialBlock.toInt() and 0xFF
+            assertArrayEquals(section.data, simulated.blocks(first, section.data.size / 8))
+        }
+    }
+
+    @Test
+    fun deliverAndVerify() = runBlocking<Unit> {
+        val simulated = SimulatedTag()
+        simulated.installPayload(payload)
+        NFCSession.use(simulated.tag) {
+            assertTrue(plan.deliver(simulated.tag))
+            assertTrue(plan.verify(simulated.tag))
+        }
+        assertProgrammed(simulated)
+        // the checksum handler of the payload verified every section
+        assertEquals(plan.sections.size, simulated.customCommands)
+        assertEquals(Util.thermometerProgramKey, Util.retrieveProgramKey(simulated.tag))
+    }
+
+    @Test
+    fun redeliveryWritesNothing() = runBlocking<Unit> {
+        val simulated = SimulatedTag()
+        assertTrue(plan.deliver(simulated.tag))
+        val written = simulated.blocksWritten
+        assertTrue(written > 0)
+        assertTrue(plan.deliver(simulated.tag))
+        assertEquals(written, simulated.blocksWritten)
+    }
+
+    @Test
+    fun snapshotReplacesReading() = runBlocking<Unit> {
+        val simulated = SimulatedTag()
+        val header = Util.retrieveHeader(simulated.tag)
+        assertNotNull(header)
+        val snapshot = TagSnapshot.read(simulated.tag, header!!)
+        assertNotNull(snapshot)
+        val read = simulated.blocksRead
+        assertTrue(plan.deliver(simulated.tag, snapshot = snapshot))
+        assertEquals(read, simulated.blocksRead)
+        assertProgrammed(simulated)
+    }
+
+    @Test
+    fun startedSnapshotReadsOnlyTheSections() = runBlocking<Unit> {
+        val simulated = SimulatedTag()
+        TagSnapshot.invalidate(simulated.tag)    // another test may have left one for the same UID
+        val (_, header) = Util.retrieveProgramKeyAndHeader(simulated.tag)!!
+        val snapshot = TagSnapshot.start(simulated.tag, header)
+        val read = simulated.blocksRead
+        assertTrue(plan.deliver(simulated.tag, snapshot = snapshot))
+        assertEquals(read + plan.sections.sumBy { it.data.size / 8 }, simulated.blocksRead)
+        assertProgrammed(simulated)
+        // the next time the snapshot covers the sections
+        val again = TagSnapshot.start(simulated.tag, header)
+        val reread = simulated.blocksRead
+        val written = simulated.blocksWritten
+        assertTrue(plan.deliver(simulated.tag, snapshot = again))
+        assertEquals(reread, simulated.blocksRead)
+        assertEquals(written, simulated.blocksWritten)
+    }
+
+    @Test
+    fun programKeyIsReadLive() = runBlocking<Unit> {
+        val simulated = SimulatedTag()
+        val header = Util.retrieveHeader(simulated.tag)!!
+        assertNotNull(TagSnapshot.read(simulated.tag, header))
+        // the running sensor advances its time without touching the header
+        simulated.memory[8 * SimulatedTag.programKeyBlock + 4]++
+        assertEquals(0x1235, Util.retrieveProgramKey(simulated.tag))
+        val snapshot = TagSnapshot.lookup(simulated.tag, header)
+        assertArrayEquals(simulated.blocks(SimulatedTag.programKeyBlock, 1),
+                          snapshot!!.blocks(SimulatedTag.programKeyBlock, 1))
+    }
+
+    @Test
+    fun changedHeaderDropsSnapshot() = runBlocking<Unit> {
+        val simulated = SimulatedTag()
+        val header = Util.retrieveHeader(simulated.tag)!!
+        assertNotNull(TagSnapshot.read(simulated.tag, header))
+        header[2]++
+        header.copyInto(simulated.memory)
+        assertNull(Util.retrieveHeader(simulated.tag))
+        assertNull(TagSnapshot.lookup(simulated.tag, header))
+    }
+
+    @Test
+    fun lostFramesAreRetried() = runBlocking<Unit> {
+        val simulated = SimulatedTag(lossRate = 0.2, seed = 7)
+        simulated.installPayload(payload)
+        NFCSession.use(simulated.tag) {
+            assertTrue(plan.deliver(simulated.tag))
+            assertTrue(plan.verify(simulated.tag))
+        }
+        assertTrue(simulated.lost > 0)
+        assertProgrammed(simulated)
+    }
+
+    @Test
+    fun verifyDetectsDamage() = runBlocking<Unit> {
+        val simulated = SimulatedTag()
+        simulated.installPayload(payload)
+        assertTrue(plan.deliver(simulated.tag))
+        val section = plan.sections.last()
+        simulated.memory[8 * (section.initialBlock.toInt() and 0xFF)]++
+        assertFalse(plan.verify(simulated.tag))
+    }
+
+    @Test
+    fun verifyWithChecksumCommand() = runBlocking<Unit> {
+        val simulated = SimulatedTag()
+        val checksumHandler = simulated.installPayload(payload).getValue(SimulatedTag.checksumCommand)
+        simulated.registerCommands(SimulatedTag.sensorKey,
+            SimulatedTag.sensorCommands + (SimulatedTag.checksumCommand to checksumHandler))
+        val tableSection = 0xffb0
+        // the payload rewrites the table, leave it out so only the checksum handler of the payload is listed
+        val sections = plan.sections.filter {
+            SimulatedTag.libreBaseAddress + 8 * (it.initialBlock.toInt() and 0xFF) < tableSection
+        }
+        val partial = DeliveryPlan(sections)
+        assertTrue(partial.deliver(simulated.tag))
+        assertNotNull(CommandTable.cached(simulated.tag))
+        val read = simulated.blocksRead
+        val commands = simulated.customCommands
+        assertTrue(partial.verify(simulated.tag))
+        // the cached table tells that the command is there, nothing is read back
+        assertEquals(read, simulated.blocksRead)
+        assertEquals(commands + sections.size, simulated.customCommands)
+        simulated.memory[8 * (sections.last().initialBlock.toInt() and 0xFF)]++
+        assertFalse(partial.verify(simulated.tag))
+    }
+
+    @Test
+    fun verifyWithoutChecksumCommandReadsBack() = runBlocking<Unit> {
+        val simulated = SimulatedTag()
+        // without the table section the sensor keeps its own table
+        val sections = plan.sections.filter {
+            SimulatedTag.libreBaseAddress + 8 * (it.initialBlock.toInt() and 0xFF) < 0xffb0
+        }
+        val partial = DeliveryPlan(sections)
+        assertTrue(partial.deliver(simulated.tag))
+        val commands = simulated.customCommands
+        assertTrue(partial.verify(simulated.tag))
+        // the sensor table has no 0xB6, so no command is tried
+        assertEquals(commands, simulated.customCommands)
+    }
+
+    @Test
+    fun compiledPlanDeliversTheSame() = runBlocking<Unit> {
+        val compiled = DeliveryPlan.fromBinary(plan.toBinary())
+        assertNotNull(compiled)
+        val simulated = SimulatedTag()
+        assertTrue(compiled!!.deliver(simulated.tag))
+        assertProgrammed(simulated)
+    }
+
+    @Test
+    fun sensorIsRecognized() = runBlocking<Unit> {
+        val simulated = SimulatedTag()
+        assertEquals(0x1234, Util.retrieveProgramKey(simulated.tag))
+        simulated.uid[7] = 0
+        assertNull(Util.retrieveProgramKey(simulated.tag))
+    }
+
+    companion object {
+        // unit tests run in the directory of the module
+        const val payloadPath = "src/main/assets/thermometer-payload.txt"
+    }
+}
@@ -0,0 +1,397 @@
+package com.diafyt.lazarus.utils
+
+import android.nfc.Tag
+import java.io.IOException
+import java.util.IdentityHashMap
+import kotlin.random.Random
+
+/**
+ * A Libre sensor as ISO 15693 tag, standing in for the hardware behind NFCTransport.
+ *
+ * The tag holds the 244 blocks of FRAM starting at 0xf860 with a CRC protected
+ * header, a block 39 signature of a sensor which was not reprogrammed and the
+ * custom command dispatch table of the sensor firmware. It implements read and
+ * write single and multiple blocks and dispatches custom commands through the
+ * table in its FRAM, so a payload rewriting the table takes effect just like on
+ * a sensor. Commands of the sensor firmware (below the FRAM) answer without data.
+ *
+ * A handler in FRAM runs a model of the handler of this project installed at its
+ * address (see installHandler and installPayload), which answers only while the
+ * FRAM there still holds the code the model stands for; the command ID only
+ * selects the table entry, as on a sensor. The checksum handler answers with the
+ * CRC of the requested range, the temperature handler with centi-degrees and the
+ * conversion handler with the raw sample, the temperature handler followed by a
+ * sequence number, the conversion handler by a status. The temperature handler
+ * has a sample ready for every request. The conversion handler takes the SD14CTL1
+ * settings as parameter and converts within the request, answering with status
+ * one; while the SD14 is busy with a conversion of the firmware it answers with
+ * status zero. Without a model or with other code at the address the tag does
+ * not answer.
+ *
+ * Frames are lost at random with the given probability, half of them before the
+ * tag executed the command and half of them afterwards (only the answer got lost).
+ * The random numbers come from a seeded generator, so every run yields the same
+ * losses. Every frame, lost or not, takes latencyMillis, which stands in for the
+ * air interface and the NFC stack of the phone.
+ *
+ * @param lossRate probability of losing a frame
+ * @param seed of the loss injection
+ * @param maxReadBlocks blocks per read multiple blocks command the tag accepts
+ * @param latencyMillis duration of a frame
+ */
+class SimulatedTag(
+    private val lossRate: Double = 0.0, seed: Int = 1, private val maxReadBlocks: Int = 3,
+    private val latencyMillis: Long = 0
+) : NFCTransport {
+    val tag: Tag = allocateTag()
+    val uid = byteArrayOf(nextSerial(), 0x3C, 0x21, 0x0F, 0x00, 0xA0.toByte(), 0x07, 0xE0.toByte())
+    val memory = ByteArray(blockCount * blocklen)
+
+    /**
+     * What a conversion of the thermistor yields, raw and as the firmware converts it.
+     */
+    var sample = 0x1A2B
+    var centiDegrees = 2150
+
+    // statistics
+    var frames = 0
+        private set
+    var lost = 0
+        private set
+    var blocksRead = 0
+        private set
+    var blocksWritten = 0
+        private set
+    var customCommands = 0
+        private set
+
+    private val random = Random(seed)
+    private var connected = false
+    private var sequence = 0
+
+    /**
+     * What the handlers of this project do, see the class documentation.
+     */
+    enum class Handler { CONVERSION, TEMPERATURE, CHECKSUM }
+
+    private class InstalledHandler(val handler: Handler, val code: ByteArray)
+
+    private val handlers = HashMap<Int, InstalledHandler>()
+
+    /**
+     * Number of custom command requests the SD14 stays busy with a conversion
+     * of the firmware.
+     */
+    var busyRequests = 0
+
+    init {
+        // arbitrary but fixed contents, the header is marked as an active sensor
+        for (i in memory.indices) {
+            memory[i] = (i * 7 + 3).toByte()
+        }
+        memory[4] = 0x03
+        store16(libreBaseAddress, checksum(headerSize - 2, 2))
+        store16(libreBaseAddress + programKeyBlock * blocklen + 4, 0x1234)  // sensor time
+        registerCommands(sensorKey, sensorCommands)
+        synchronized(tags) {
+            tags[tag] = this
+        }
+    }
+
+    /**
+     * Write a dispatch table with the given key and handler addresses per command.
+     */
+    fun registerCommands(key: Int, commands: List<Pair<Int, Int>>) {
+        var address = tableStart
+        store16(address, key)
+        for ((id, handler) in commands) {
+            store16(address - 2, id)
+            store16(address - 4, handler)
+            address -= 4
+        }
+        store16(address - 2, key)
+    }
+
+    /**
+     * Model the handler at the given FRAM address, which stands for the given
+     * code, by default what the FRAM holds there now.
+     */
+    fun installHandler(address: Int, handler: Handler, code: ByteArray = load(address, codeLength)) {
+        handlers[address] = InstalledHandler(handler, code.copyOf(codeLength))
+    }
+
+    /**
+     * Model the handlers of a payload in TI-TXT at the addresses its dispatch
+     * table gives them, returns the handler address per command of the table.
+     *
+     * The handlers are known by their command IDs in the firmware of this
+     * project, the checksum and temperature command IDs and the conversion for
+     * any other. The tag itself still has to be programmed with the payload.
+     */
+    fun installPayload(payload: String): Map<Int, Int> {
+        val parser = TITXTParser()
+        if (parser.parse(payload) == 0) {
+            throw IllegalArgumentException("Payload rejected.")
+        }
+        val table = commandTable { parser.image[it - libreBaseAddress] }
+        for ((id, address) in table) {
+            if (address >= libreBaseAddress) {
+                val handler = when (id) {
+                    checksumCommand -> Handler.CHECKSUM
+                    temperatureCommand -> Handler.TEMPERATURE
+                    else -> Handler.CONVERSION
+                }
+                val offset = address - libreBaseAddress
+                installHandler(address, handler, parser.image.copyOfRange(offset, offset + codeLength))
+            }
+        }
+        return table
+    }
+
+    /**
+     * Contents of the given blocks.
+     */
+    fun blocks(first: Int, count: Int): ByteArray {
+        return memory.copyOfRange(first * blocklen, (first + count) * blocklen)
+    }
+
+    override fun connect() {
+        if (connected) {
+            throw IllegalStateException("Already connected.")
+        }
+        connected = true
+    }
+
+    override fun close() {
+        connected = false
+    }
+
+    override fun transceive(cmd: ByteArray): ByteArray {
+        if (!connected) {
+            throw IllegalStateException("Not connected.")
+        }
+        frames++
+        if (latencyMillis > 0) {
+            Thread.sleep(latencyMillis)
+        }
+        val fate = random.nextDouble()
+        if (fate < lossRate / 2) {
+            lost++
+            throw IOException("Request lost.")
+        }
+        val answer = execute(cmd)
+        if (answer == null || fate < lossRate) {
+            lost++
+            throw IOException("Answer lost.")
+        }
+        return answer
+    }
+
+    /**
+     * Carry out a complete frame, returns the answer or null for none.
+     */
+    private fun execute(cmd: ByteArray): ByteArray? {
+        if (cmd.size < 2) {
+            return error(errorNotRecognized)
+        }
+        var position = 2
+        if (cmd[0].toInt() and flagAddressed != 0) {
+            if (cmd.size < 2 + uid.size || !cmd.copyOfRange(2, 2 + uid.size).contentEquals(uid)) {
+                return null // addressed to another tag
+            }
+            position += uid.size
+        }
+        val code = cmd[1].toInt() and 0xFF
+        when (code) {
+            0x20, 0x23 -> { // read single and multiple blocks
+                if (cmd.size < position + (if (code == 0x23) 2 else 1)) {
+                    return error(errorNotRecognized)
+                }
+                val block = cmd[position].toInt() and 0xFF
+                val count = if (code == 0x23) (cmd[position + 1].toInt() and 0xFF) + 1 else 1
+                if (count > maxReadBlocks || block + count > blockCount) {
+                    return error(errorNotAvailable)
+                }
+                blocksRead += count
+                return byteArrayOf(0) + blocks(block, count)
+            }
+            0x21, 0x24 -> { // write single and multiple blocks
+                if (cmd.size < position + (if (code == 0x24) 2 else 1)) {
+                    return error(errorNotRecognized)
+                }
+                val block = cmd[position++].toInt() and 0xFF
+                val count = if (code == 0x24) (cmd[position++].toInt() and 0xFF) + 1 else 1
+                if (cmd.size != position + count * blocklen || block + count > blockCount) {
+                    return error(errorNotAvailable)
+                }
+                if (block + count > blockCount - lockedBlocks) {
+                    return error(errorLocked)
+                }
+                cmd.copyInto(memory, block * blocklen, position, cmd.size)
+                blocksWritten += count
+                return byteArrayOf(0)
+            }
+            else -> {
+                if (code < 0xA0 || cmd.size < 3 || cmd[2] != vendorTI) {
+                    return error(errorNotSupported)
+                }
+                val address = commandTable { memory[it - libreBaseAddress] }[code]
+                    ?: return error(errorNotSupported)
+                if (address < libreBaseAddress) {
+                    return byteArrayOf(0) // sensor firmware in ROM, not modeled further
+                }
+                val installed = handlers[address] ?: return null
+                if (!load(address, codeLength).contentEquals(installed.code)) {
+                    return null // the model does not know this code
+                }
+                customCommands++
+                return when (installed.handler) {
+                    Handler.CHECKSUM -> checksumAnswer(cmd.copyOfRange(3, cmd.size))
+                    Handler.TEMPERATURE -> byteArrayOf(0) + word(centiDegrees) + word(++sequence)
+                    Handler.CONVERSION -> {
+                        if (busyRequests > 0) {
+                            busyRequests--
+                            byteArrayOf(0) + word(0) + word(0)
+                        } else {
+                            byteArrayOf(0) + word(sample) + word(1)
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    private fun checksumAnswer(parameters: ByteArray): ByteArray {
+        if (parameters.size < 4) {
+            return error(errorNotRecognized)
+        }
+        val start = (parameters[0].toInt() and 0xFF) or ((parameters[1].toInt() and 0xFF) shl 8)
+        val length = (parameters[2].toInt() and 0xFF) or ((parameters[3].toInt() and 0xFF) shl 8)
+        if (start < libreBaseAddress || start + length > 0x10000) {
+            return error(errorNotAvailable)
+        }
+        return byteArrayOf(0) + word(checksum(length, start - libreBaseAddress))
+    }
+
+    /**
+     * Walk a dispatch table the way the ROM does, the first entry of a command wins.
+     */
+    private fun commandTable(byteAt: (Int) -> Byte): Map<Int, Int> {
+        fun load16(address: Int) =
+            (byteAt(address).toInt() and 0xFF) or ((byteAt(address + 1).toInt() and 0xFF) shl 8)
+        val table = LinkedHashMap<Int, Int>()
+        var address = tableStart
+        val key = load16(address)
+        if (key != sensorKey && key != firmwareKey) {
+            return table
+        }
+        address -= 2
+        while (address > libreBaseAddress + 2) {
+            val id = load16(address)
+            if (id == key) {
+                break
+            }
+            table.getOrPut(id) { load16(address - 2) }
+            address -= 4
+        }
+        return table
+    }
+
+    /**
+     * CRC-16/MCRF4XX with reversed bits as the firmware computes it, written
+     * out bitwise to be independent of CRC.kt.
+     */
+    private fun checksum(length: Int, offset: Int): Int {
+        var crc = 0xFFFF
+        for (i in offset until offset + length) {
+            crc = crc xor (memory[i].toInt() and 0xFF)
+            for (bit in 0 until 8) {
+                crc = if (crc and 1 != 0) (crc shr 1) xor 0x8408 else crc shr 1
+            }
+        }
+        var reversed = 0
+        for (bit in 0 until 16) {
+            reversed = (reversed shl 1) or (crc and 1)
+            crc = crc shr 1
+        }
+        return reversed
+    }
+
+    private fun load(address: Int, length: Int): ByteArray {
+        val offset = address - libreBaseAddress
+        return memory.copyOfRange(offset, offset + length)
+    }
+
+    private fun store16(address: Int, value: Int) {
+        word(value).copyInto(memory, address - libreBaseAddress)
+    }
+
+    private fun word(value: Int): ByteArray {
+        return byteArrayOf((value and 0xFF).toByte(), ((value shr 8) and 0xFF).toByte())
+    }
+
+    private fun error(code: Int): ByteArray {
+        return byteArrayOf(flagError, code.toByte())
+    }
+
+    companion object {
+        const val libreBaseAddress = 0xf860
+        const val blockCount = 244
+        const val blocklen = 8
+        const val headerSize = 0x18
+        const val programKeyBlock = 39
+        const val tableStart = 0xffce
+        const val sensorKey = 0xabab
+        const val firmwareKey = 0xcece
+        const val checksumCommand = 0xB6
+        const val temperatureCommand = 0xB7
+        private const val lockedBlocks = 4
+
+        /**
+         * Bytes of code at the start of a handler which tell it apart.
+         */
+        private const val codeLength = 8
+        private const val vendorTI: Byte = 0x07
+        private const val flagAddressed = 0x20
+        private const val flagError: Byte = 0x01
+        private const val errorNotSupported = 0x01
+        private const val errorNotRecognized = 0x02
+        private const val errorNotAvailable = 0x10
+        private const val errorLocked = 0x12
+
+        /**
+         * Sensor firmware entries of the dispatch table, in the order found from tableStart on.
+         */
+        val sensorCommands = listOf(
+            0xA0 to 0x5724, 0xA1 to 0xF9BA, 0xA2 to 0x5A56, 0xA3 to 0xFBCA, 0xA4 to 0x5A2C)
+
+        private val tags = IdentityHashMap<Tag, SimulatedTag>()
+        private var serial = 0
+
+        private fun nextSerial(): Byte {
+            synchronized(tags) {
+                return (++serial).toByte()
+            }
+        }
+
+        /**
+         * Route all NFC communication of the app to the simulated tags.
+         */
+        fun install() {
+            NFCTransport.factory = { synchronized(tags) { tags.getValue(it) } }
+            NFCTransport.uid = { synchronized(tags) { tags.getValue(it).uid } }
+        }
+
+        /**
+         * An instance of android.nfc.Tag, which has no public constructor and
+         * only serves as identity of the simulated tag here.
+         */
+        private fun allocateTag(): Tag {
+            val unsafeClass = Class.forName("sun.misc.Unsafe")
+            val field = unsafeClass.getDeclaredField("theUnsafe")
+            field.isAccessible = true
+            val allocate = unsafeClass.getMethod("allocateInstance", Class::class.java)
+            return allocate.invoke(field.get(null), Tag::class.java) as Tag
+        }
+    }
+}
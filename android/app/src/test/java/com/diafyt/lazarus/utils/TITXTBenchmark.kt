@@ -0,0 +1,102 @@
+package com.diafyt.lazarus.utils
+
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertTrue
+import org.junit.Before
+import org.junit.Test
+import java.io.File
+import java.util.Locale
+
+/**
+ * Time per parse of the TI-TXT parser on the JVM, for an image covering every
+ * block a payload may write and for a batch of payloads validated the way
+ * PlanCache compiles them.
+ *
+ * The full image holds the shipped payload at its place and fills the other
+ * blocks, the batch is the shipped payload in upper and lower case and with
+ * CRLF line ends. Each case is warmed up before it is timed, the times are
+ * wall clock and vary between runs and machines. The report goes to the standard output, e.g. of
+ * ./gradlew test --tests '*TITXTBenchmark' -i
+ */
+class TITXTBenchmark {
+    private lateinit var payload: String
+    private lateinit var fullImage: String
+    private lateinit var batch: List<String>
+
+    @Before
+    fun setUp() {
+        payload = File(DeliveryPlanTest.payloadPath).readText()
+        val parser = TITXTParser()
+        parser.parse(payload)
+        val image = parser.image.copyOf()
+        for (block in 0 until writableBlocks) {
+            if (!parser.written[block]) {
+                for (k in 0 until TITXTParser.blockSize) {
+                    image[block * TITXTParser.blockSize + k] = (block * 7 + k).toByte()
+                }
+            }
+        }
+        fullImage = titxt(image, writableBlocks)
+        val variants = listOf(payload, payload.toLowerCase(Locale.ROOT), payload.replace("\n", "\r\n"))
+        batch = List(batchSize) { variants[it % variants.size] }
+    }
+
+    /**
+     * Write the first blocks of an image as a single section, 16 bytes per line.
+     */
+    private fun titxt(image: ByteArray, blocks: Int): String {
+        val text = StringBuilder()
+        text.append(String.format(Locale.ROOT, "@%04x\n", TITXTParser.baseAddress))
+        for (i in 0 until blocks * TITXTParser.blockSize) {
+            text.append(String.format(Locale.ROOT, "%02X", image[i]))
+            text.append(if (i % 16 == 15) '\n' else ' ')
+        }
+        text.append("q\n")
+        return text.toString()
+    }
+
+    /**
+     * Run the body warm-up plus timed times, returns nanoseconds per run.
+     */
+    private inline fun measure(runs: Int, body: () -> Unit): Double {
+        repeat(warmupRuns) { body() }
+        val start = System.nanoTime()
+        repeat(runs) { body() }
+        return (System.nanoTime() - start).toDouble() / runs
+    }
+
+    private fun report(case: String, characters: Int, nanos: Double) {
+        println(String.format(Locale.ROOT, "%-30s %9d %12.1f %10.1f",
+            case, characters, nanos / 1000, characters * 1000 / nanos))
+    }
+
+    @Test
+    fun parseTimes() {
+        val parser = TITXTParser()
+        assertEquals(1, parser.parse(fullImage))
+        assertEquals(writableBlocks, parser.written.count { it })
+        batch.forEach { assertTrue(DeliveryPlan.validate(it, parser)) }
+
+        println(String.format(Locale.ROOT, "%-30s %9s %12s %10s", "case", "chars", "parse [us]", "MB/s"))
+        report("full image, parser reused", fullImage.length,
+            measure(fullImageRuns) { parser.parse(fullImage) })
+        report("full image, new parser", fullImage.length,
+            measure(fullImageRuns) { TITXTParser().parse(fullImage) })
+        val batchChars = batch.sumBy { it.length }
+        report("payload batch, parser reused", batchChars / batchSize,
+            measure(batchRuns) { batch.forEach { DeliveryPlan.validate(it, parser) } } / batchSize)
+        report("payload batch, new parser", batchChars / batchSize,
+            measure(batchRuns) { batch.forEach { DeliveryPlan.validate(it) } } / batchSize)
+    }
+
+    companion object {
+        /**
+         * Blocks from 0xf860 up to the interrupt vectors, which the parser refuses.
+         */
+        private const val writableBlocks = TITXTParser.blockCount - 4
+        private const val batchSize = 64
+        private const val warmupRuns = 200
+        private const val fullImageRuns = 2000
+        private const val batchRuns = 100
+    }
+}
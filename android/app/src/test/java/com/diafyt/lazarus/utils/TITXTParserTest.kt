@@ -0,0 +1,101 @@
+package com.diafyt.lazarus.utils
+
+import org.junit.Assert.assertArrayEquals
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertFalse
+import org.junit.Assert.assertTrue
+import org.junit.Assert.fail
+import org.junit.Test
+import java.io.File
+
+/**
+ * Parsing and validating payloads, the shipped one and malformed ones.
+ */
+class TITXTParserTest {
+    private val parser = TITXTParser()
+
+    private fun assertRejected(text: String) {
+        try {
+            parser.parse(text)
+            fail("Accepted: $text")
+        } catch (e: TITXTParser.ParseException) {
+        }
+    }
+
+    private fun block(address: Int): Int {
+        return (address - TITXTParser.baseAddress) / TITXTParser.blockSize
+    }
+
+    @Test
+    fun shippedPayload() {
+        val text = File(DeliveryPlanTest.payloadPath).readText()
+        assertEquals(3, parser.parse(text))
+        assertEquals(listOf(TITXTParser.programKeyBlock, block(0xfda0), block(0xffb0)),
+                     parser.sectionBlocks.take(3))
+        assertEquals(listOf(1, 30, 4), parser.sectionLengths.take(3))
+        assertEquals(35, parser.written.count { it })
+        val key = 8 * TITXTParser.programKeyBlock + 4
+        assertArrayEquals(byteArrayOf(0x01, 0x80.toByte()), parser.image.copyOfRange(key, key + 2))
+        assertTrue(DeliveryPlan.validate(text, parser))
+    }
+
+    @Test
+    fun parserIsReusable() {
+        val text = File(DeliveryPlanTest.payloadPath).readText()
+        assertRejected("@f998\n00 00 00 00 01 80 00\nq\n")
+        assertEquals(3, parser.parse(text))
+        assertEquals(1, parser.parse("@f998\n00 00 00 00 01 80 00 00\nq\n"))
+        assertEquals(1, parser.written.count { it })
+    }
+
+    @Test
+    fun malformedText() {
+        assertRejected("")
+        assertRejected("@f998\n00 00 00 00 01 80 00 00\n")
+        assertRejected("@f998\n00 00 00 00 01 80 00 00\nq\n00")
+        assertRejected("@f99g\n00 00 00 00 01 80 00 00\nq\n")
+        assertRejected("@0f998\n00 00 00 00 01 80 00 00\nq\n")
+        assertRejected("@\n00 00 00 00 01 80 00 00\nq\n")
+        assertRejected("@f998\n00 00 00 00 01 80 00 0G\nq\n")
+        assertRejected("@f998\n00 00 00 00 01 80 00 000\nq\n")
+        assertRejected("00 00 00 00 01 80 00 00\nq\n")
+    }
+
+    @Test
+    fun layoutRules() {
+        val key = "@f998\n00 00 00 00 01 80 00 00\n"
+        // not on a block boundary, outside of the FRAM
+        assertRejected("@f99a\n00 00 00 00 01 80 00 00\nq\n")
+        assertRejected("@1000\n00 00 00 00 00 00 00 00\n${key}q\n")
+        // whole blocks only
+        assertRejected("@f998\n00 00 00 00 01 80 00\nq\n")
+        // all or none of the header
+        assertRejected("@f868\n00 00 00 00 00 00 00 00\n${key}q\n")
+        assertRejected("@f860\n00 00 00 00 00 00 00 00\n${key}q\n")
+        // no overlap, no interrupt vectors, block 39 present
+        assertRejected("${key}@f998\n00 00 00 00 01 80 00 00\nq\n")
+        assertRejected("@ffe0\n00 00 00 00 00 00 00 00\n${key}q\n")
+        assertRejected("@fda0\n00 00 00 00 00 00 00 00\nq\n")
+        assertEquals(2, parser.parse("@ffd8\n00 00 00 00 00 00 00 00\n${key}q\n"))
+    }
+
+    private fun withHeader(header: ByteArray): String {
+        return "@f860\n" + header.joinToString(" ") { String.format("%02X", it) } +
+                "\n@f998\n00 00 00 00 01 80 00 00\nq\n"
+    }
+
+    @Test
+    fun contents() {
+        assertFalse(DeliveryPlan.validate("@f998\n00 00 00 00 02 80 00 00\nq\n", parser))
+        val header = ByteArray(3 * TITXTParser.blockSize) { it.toByte() }
+        val crc = CRC()
+        for (k in 2 until header.size) {
+            crc.update(header[k])
+        }
+        header[0] = (crc.getCRC().toInt() and 0xFF).toByte()
+        header[1] = ((crc.getCRC().toInt() shr 8) and 0xFF).toByte()
+        assertTrue(DeliveryPlan.validate(withHeader(header), parser))
+        header[5]++
+        assertFalse(DeliveryPlan.validate(withHeader(header), parser))
+    }
+}
@@ -0,0 +1,107 @@
+package com.diafyt.lazarus.utils
+
+import kotlinx.coroutines.runBlocking
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertFalse
+import org.junit.Assert.assertNotNull
+import org.junit.Assert.assertNull
+import org.junit.Assert.assertTrue
+import org.junit.Before
+import org.junit.Test
+import java.io.File
+
+/**
+ * Reading the temperature from a simulated sensor the way TemperatureFragment does.
+ */
+class TemperatureReadingTest {
+    @Before
+    fun setUp() {
+        SimulatedTag.install()
+    }
+
+    private suspend fun programmed(simulated: SimulatedTag): SimulatedTag {
+        val payload = File(DeliveryPlanTest.payloadPath).readText()
+        val plan = DeliveryPlan.create(payload)
+        assertNotNull(plan)
+        simulated.installPayload(payload)
+        assertTrue(plan!!.deliver(simulated.tag))
+        return simulated
+    }
+
+    @Test
+    fun payloadReading() = runBlocking<Unit> {
+        val simulated = programmed(SimulatedTag())
+        val reading = NFCSession.use(simulated.tag) { TemperatureReading.retrieve(simulated.tag) }
+        assertNotNull(reading)
+        assertFalse(reading!!.calibrated)
+        assertEquals(TemperatureReading.calibrate(simulated.sample), reading.celsius, 0.0)
+        assertFalse(reading.table!!.fullFirmware)
+        // the payload converts within the request
+        assertEquals(1, simulated.customCommands)
+    }
+
+    @Test
+    fun busySensorIsAskedAgain() = runBlocking<Unit> {
+        val simulated = programmed(SimulatedTag())
+        simulated.busyRequests = 1
+        val reading = NFCSession.use(simulated.tag) { TemperatureReading.retrieve(simulated.tag) }
+        assertNotNull(reading)
+        assertEquals(TemperatureReading.calibrate(simulated.sample), reading!!.celsius, 0.0)
+        assertEquals(2, simulated.customCommands)
+    }
+
+    @Test
+    fun commandTableIsReadOnce() = runBlocking<Unit> {
+        val simulated = programmed(SimulatedTag())
+        assertNotNull(TemperatureReading.retrieve(simulated.tag))
+        val blocksRead = simulated.blocksRead
+        assertNotNull(TemperatureReading.retrieve(simulated.tag))
+        // a reading is a single exchange once the table is known
+        assertEquals(blocksRead, simulated.blocksRead)
+        // programming the tag again drops the table
+        programmed(simulated)
+        val programmedRead = simulated.blocksRead
+        assertNotNull(TemperatureReading.retrieve(simulated.tag))
+        assertTrue(simulated.blocksRead > programmedRead)
+    }
+
+    @Test
+    fun firmwareReading() = runBlocking<Unit> {
+        val simulated = SimulatedTag()
+        simulated.registerCommands(SimulatedTag.firmwareKey,
+            listOf(0xAA to 0xFAC0, 0xB3 to 0xFAC0, SimulatedTag.temperatureCommand to 0xFB00))
+        simulated.installHandler(0xFAC0, SimulatedTag.Handler.CONVERSION)
+        simulated.installHandler(0xFB00, SimulatedTag.Handler.TEMPERATURE)
+        simulated.centiDegrees = -1234
+        val reading = TemperatureReading.retrieve(simulated.tag)
+        assertNotNull(reading)
+        assertTrue(reading!!.calibrated)
+        assertEquals(-12.34, reading.celsius, 1e-9)
+        assertTrue(reading.table!!.fullFirmware)
+        // the first answer is valid, no second request
+        assertEquals(1, simulated.customCommands)
+    }
+
+    @Test
+    fun lostFramesAreRetried() = runBlocking<Unit> {
+        val simulated = programmed(SimulatedTag(lossRate = 0.2, seed = 3))
+        val reading = NFCSession.use(simulated.tag) { TemperatureReading.retrieve(simulated.tag) }
+        assertNotNull(reading)
+        assertEquals(TemperatureReading.calibrate(simulated.sample), reading!!.celsius, 0.0)
+    }
+
+    @Test
+    fun overwrittenHandlerDoesNotAnswer() = runBlocking<Unit> {
+        val simulated = programmed(SimulatedTag())
+        val handlers = simulated.installPayload(File(DeliveryPlanTest.payloadPath).readText())
+        // the payload answers the reading with its conversion handler
+        simulated.memory[handlers.getValue(0xB3) - SimulatedTag.libreBaseAddress]++
+        assertNull(NFCSession.use(simulated.tag) { TemperatureReading.retrieve(simulated.tag) })
+        assertEquals(0, simulated.customCommands)
+    }
+
+    @Test
+    fun sensorFirmwareHasNoReading() = runBlocking<Unit> {
+        assertNull(TemperatureReading.retrieve(SimulatedTag().tag))
+    }
+}
@@ -0,0 +1,184 @@
+/*
+ * bench.c
+ *
+ * Benchmarks of the firmware running in the host simulation.
+ *
+ * Reports for every custom command in the driver table, the interrupt service
+ * routines and the autonomous sampling cycle the peripheral register accesses,
+ * conversions, wakeups and interrupts the mock counts exactly. The host build
+ * runs no MSP430 instructions, so neither cycles nor times in active mode are
+ * reported: the cycle model of host.c only bounds the tests, its figures are
+ * register accesses times a constant and say nothing about the code between
+ * them.
+ *
+ * Usage: lazarus-host-bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+
+//================================================================
+
+#define REFERENCE_CHANNEL           3           // channels as in enum Channel_Index of main.c
+#define THERMISTOR_CHANNEL          2
+#define INTERNAL_TEMPERATURE_CHANNEL 1
+#define COMMAND_GAP_NS              20000000ULL     // between two commands of a reader
+#define WAKE_SETTLE_NS              200000000ULL    // for the conversions a wakeup command starts
+#define SAMPLE_LOG_BLOCK            4
+#define SAMPLING_MINUTES            120
+
+/* Parameters sent along with a command, all others get none */
+static const struct
+{
+    uint16_t id;
+    uint8_t parameters[4];
+    int length;
+} CommandParameters[] = {
+    { 0x00AA, { 0x43, 0xD0 }, 2 },         // thermistor, CUSTOM_SD14CTL1 of main.c
+    { 0x00B5, { 16, 0 }, 2 },              // oversampling by 16
+    { 0x00B6, { 0xA0, 0xFD, 0x00, 0x02 }, 4 },  // checksum of the payload code area
+    { 0x00B9, { 16, 0 }, 2 },              // statistics over windows of 16
+};
+
+/*  Boot                                                                               *
+ *  Function:  Start from a fresh device with stable inputs and let the main loop run  *
+ *             until it sleeps, as it does when a reader powers it up.                 */
+static void Boot(void)
+{
+    host_reset();
+    host_set_input(REFERENCE_CHANNEL, 0x2000, 2);
+    host_set_input(THERMISTOR_CHANNEL, 0x1800, 4);
+    host_set_input(INTERNAL_TEMPERATURE_CHANNEL, 0x1200, 1);
+    host_run_main(COMMAND_GAP_NS);
+}
+
+static void BenchCommand(uint16_t id, unsigned iterations)
+{
+    uint8_t parameters[4] = { 0 };
+    uint8_t response[HOST_FIFO_SIZE];
+    uint64_t accesses = 0;
+    uint64_t minimum = UINT64_MAX, maximum = 0;
+    int parameters_length = 0;
+    int length = 0;
+    unsigned i;
+
+    for (i = 0; i < sizeof(CommandParameters) / sizeof(CommandParameters[0]); i++)
+    {
+        if (CommandParameters[i].id == id)
+        {
+            memcpy(parameters, CommandParameters[i].parameters, sizeof(parameters));
+            parameters_length = CommandParameters[i].length;
+        }
+    }
+
+    Boot();
+    for (i = 0; i < iterations; i++)
+    {
+        HostStatistics before;
+        uint64_t spent;
+
+        host_idle(COMMAND_GAP_NS);
+        before = host_statistics;
+        length = host_rf_command(id, parameters, parameters_length, response, sizeof(response));
+        spent = host_statistics.register_accesses - before.register_accesses;
+        accesses += spent;
+        minimum = spent < minimum ? spent : minimum;
+        maximum = spent > maximum ? spent : maximum;
+    }
+
+    printf("  0x%02X %10.1f %8llu %8llu %6d\n", id, (double) accesses / iterations,
+           (unsigned long long) minimum, (unsigned long long) maximum, length);
+}
+
+static void PrintInterrupt(const char *name, enum host_interrupt kind)
+{
+    uint64_t count = host_statistics.interrupts[kind];
+
+    printf("  %-10s %10llu", name, (unsigned long long) count);
+    if (count)
+    {
+        printf(" %12.1f\n", (double) host_statistics.interrupt_accesses[kind] / count);
+    }
+    else
+    {
+        printf(" %12s\n", "-");
+    }
+}
+
+/*  BenchSampling                                                                      *
+ *  Function:  Enable the sample log with an interval of one minute and let the        *
+ *             firmware run on its own, like on the skin between two scans.            */
+static void BenchSampling(void)
+{
+    uint8_t header[HOST_BLOCK_SIZE] = { 1, 0, 0, 0, 0, 0, 0, 0 };
+    uint8_t response[HOST_FIFO_SIZE];
+
+    Boot();
+    host_write_block(SAMPLE_LOG_BLOCK, header);
+    // the app follows up with the temperature command, which lets a stopped scheduler pick up the header
+    host_rf_command(0x00B7, NULL, 0, response, sizeof(response));
+    host_idle(WAKE_SETTLE_NS);              // the temperature conversion it started is not part of the cycle
+    memset(&host_statistics, 0, sizeof(host_statistics));
+    host_run_main((uint64_t) SAMPLING_MINUTES * 60 * 1000000000ULL);
+    host_read_block(SAMPLE_LOG_BLOCK, header);
+
+    printf("Sampling cycle (%d minutes, log interval 1 minute)\n", SAMPLING_MINUTES);
+    printf("  logged samples          %10u\n", header[4] | (header[5] << 8));
+    printf("  conversions             %10llu\n", (unsigned long long) host_statistics.conversions);
+    printf("  wakeups                 %10llu\n", (unsigned long long) host_statistics.wakeups);
+    printf("  register accesses       %10llu\n", (unsigned long long) host_statistics.register_accesses);
+    printf("  accesses per wakeup     %10.2f\n", host_statistics.wakeups
+           ? (double) host_statistics.register_accesses / host_statistics.wakeups : 0.0);
+    printf("\n");
+    printf("Interrupts during the sampling cycle\n");
+    printf("  %-10s %10s %12s\n", "isr", "count", "accesses");
+    PrintInterrupt("SD14", HOST_INTERRUPT_SD14);
+    PrintInterrupt("Timer0_A0", HOST_INTERRUPT_TIMER0_A0);
+}
+
+/*  BenchIdle                                                                          *
+ *  Function:  Let the firmware run on its own with logging disabled, the wakeups are  *
+ *             pure overhead then.                                                     */
+static void BenchIdle(void)
+{
+    uint8_t header[HOST_BLOCK_SIZE] = { 0 };
+
+    host_write_block(SAMPLE_LOG_BLOCK, header);     // the sample log lives in FRAM, it survives the reset
+    Boot();
+    memset(&host_statistics, 0, sizeof(host_statistics));
+    host_run_main((uint64_t) SAMPLING_MINUTES * 60 * 1000000000ULL);
+
+    printf("Idle (%d minutes, logging disabled)\n", SAMPLING_MINUTES);
+    printf("  wakeups                 %10llu\n", (unsigned long long) host_statistics.wakeups);
+    printf("  register accesses       %10llu\n", (unsigned long long) host_statistics.register_accesses);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned iterations = argc > 1 ? (unsigned) atoi(argv[1]) : 100;
+    uint16_t i;
+
+    if (iterations == 0)
+    {
+        iterations = 1;
+    }
+
+    printf("Peripheral register accesses counted by the mock, no MSP430 cycles or times\n\n");
+    printf("Custom commands (%u iterations, %llu ms apart)\n", iterations,
+           (unsigned long long) (COMMAND_GAP_NS / 1000000));
+    printf("  %-4s %10s %8s %8s %6s\n", "id", "accesses", "min", "max", "bytes");
+    for (i = 0; i < host_firmware_driver_count(); i++)
+    {
+        BenchCommand(host_firmware_driver_id(i), iterations);
+    }
+    printf("\n");
+
+    BenchSampling();
+    printf("\n");
+
+    BenchIdle();
+    return 0;
+}
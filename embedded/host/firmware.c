@@ -0,0 +1,154 @@
+/*
+ * firmware.c
+ *
+ * Compile main.c for the host and connect it to the simulation.
+ *
+ * Including main.c here makes its macros and definitions available, which is
+ * needed to lay out the driver table the same way the ROM finds it at
+ * DRIVER_TABLE_START.
+ */
+
+#include <stdint.h>
+
+/* types.h with the widths of the MSP430, so FRAM objects keep their layout */
+#define _TYPEDEF_H_
+typedef uint8_t u08_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef int8_t s08_t;
+typedef int16_t s16_t;
+typedef int32_t s32_t;
+
+#define main firmware_main
+#include "../main.c"
+#undef main
+
+#include "host.h"
+
+/* Every entry of the driver table in main.c, keep in sync with it */
+static const struct
+{
+    const u16_t *id;
+    const DriverFunction *function;
+} DriverFunctions[] = {
+    { &CustomCommandID, &CustomCommandAddress },
+    { &TemperatureCommandID, &TemperatureCommandAddress },
+#if CHECKSUM_COMMAND_ENABLED
+    { &ChecksumCommandID, &ChecksumCommandAddress },
+#endif
+#if RATIOMETRIC_COMMAND_ENABLED
+    { &RatiometricCommandID, &RatiometricCommandAddress },
+#endif
+#if OVERSAMPLING_COMMAND_ENABLED
+    { &OversamplingCommandID, &OversamplingCommandAddress },
+#endif
+#if STATISTICS_COMMAND_ENABLED
+    { &StatisticsCommandID, &StatisticsCommandAddress },
+#endif
+#if STREAM_COMMAND_ENABLED
+    { &StreamCommandID, &StreamCommandAddress },
+#endif
+};
+
+#define DRIVER_FUNCTION_COUNT   (sizeof(DriverFunctions) / sizeof(DriverFunctions[0]))
+
+/* Fails to compile once NUMBER_OF_DRIVER_FUNCTIONS and the list above disagree */
+typedef char DriverFunctionsComplete[(DRIVER_FUNCTION_COUNT == NUMBER_OF_DRIVER_FUNCTIONS) ? 1 : -1];
+
+/* FRAM objects which the firmware places with #pragma location */
+static const struct
+{
+    u16_t address;
+    void *object;
+    u16_t size;
+} FramObjects[] = {
+    { SAMPLE_LOG_ADDRESS, &SampleLog, sizeof(SampleLog) },
+    { PERF_COUNTERS_ADDRESS, &PerfCounters, sizeof(PerfCounters) },
+    { TEMPERATURE_TABLE_ADDRESS, (void *) TemperatureTable, sizeof(TemperatureTable) },
+    { ACTIVE_TICKS_ADDRESS, &ActiveTicks, sizeof(ActiveTicks) },
+    { PROFILE_ADDRESS, &Profile, sizeof(Profile) },
+};
+
+/* Fails to compile once the performance counters no longer fill blocks 37 and 38 */
+typedef char PerfCountersLayout[(sizeof(PerfCountersType) == 2 * HOST_BLOCK_SIZE) ? 1 : -1];
+
+/* Fails to compile once the temperature table runs into the signature in block 39 */
+typedef char TemperatureTableLayout[(PERF_COUNTERS_ADDRESS + sizeof(PerfCountersType) + HOST_BLOCK_SIZE <= TEMPERATURE_TABLE_ADDRESS) ? 1 : -1];
+
+/* Fails to compile once the temperature table runs into the active ticks */
+typedef char ActiveTicksLayout[(TEMPERATURE_TABLE_ADDRESS + sizeof(TemperatureTable) <= ACTIVE_TICKS_ADDRESS) ? 1 : -1];
+
+/* Fails to compile once the measurement profile no longer fills a block of its own */
+typedef char ProfileLayout[(sizeof(MeasurementProfileType) == HOST_BLOCK_SIZE && PROFILE_ADDRESS % HOST_BLOCK_SIZE == 0) ? 1 : -1];
+
+/* Host pointers do not fit into the table, it holds a token instead */
+#define DRIVER_ADDRESS_TOKEN    0xF000
+
+static void store16(u16_t address, u16_t value)
+{
+    host_memory[address] = value & 0xFF;
+    host_memory[address + 1] = value >> 8;
+}
+
+void host_firmware_main(void)
+{
+    firmware_main();
+}
+
+void host_firmware_sd14_isr(void)
+{
+    SD14_ADC();
+}
+
+void host_firmware_timer0_a0_isr(void)
+{
+    TimerA0_ISR();
+}
+
+/*  host_firmware_install_driver_table                                                  *
+ *  Function:  Write the driver table into the memory image in the format documented   *
+ *             in main.c, so the ROM emulation in host.c can parse it.                  */
+void host_firmware_install_driver_table(void)
+{
+    u16_t i;
+
+    store16(DRIVER_TABLE_START, START_KEY);
+    for (i = 0; i < DRIVER_FUNCTION_COUNT; i++)
+    {
+        store16(DRIVER_1_COMMAND - 4 * i, *DriverFunctions[i].id);
+        store16(DRIVER_1_ADDR - 4 * i, DRIVER_ADDRESS_TOKEN + i);
+    }
+    store16(DRIVER_TABLE_END, END_KEY);
+}
+
+void host_firmware_call_driver(uint16_t address)
+{
+    (*DriverFunctions[address - DRIVER_ADDRESS_TOKEN].function)();
+}
+
+uint16_t host_firmware_driver_count(void)
+{
+    return DRIVER_FUNCTION_COUNT;
+}
+
+uint16_t host_firmware_driver_id(uint16_t index)
+{
+    return *DriverFunctions[index].id;
+}
+
+/*  host_firmware_fram                                                                  *
+ *  Function:  Locate an FRAM byte, either inside a firmware object placed at a fixed   *
+ *             address or in the plain memory image.                                    */
+uint8_t *host_firmware_fram(uint16_t address)
+{
+    u16_t i;
+
+    for (i = 0; i < sizeof(FramObjects) / sizeof(FramObjects[0]); i++)
+    {
+        if (address >= FramObjects[i].address && address - FramObjects[i].address < FramObjects[i].size)
+        {
+            return (uint8_t *) FramObjects[i].object + (address - FramObjects[i].address);
+        }
+    }
+    return &host_memory[address];
+}
@@ -0,0 +1,597 @@
+/*
+ * host.c
+ *
+ * Peripheral mock and simulation clock for running the firmware on a Linux host.
+ *
+ * Cycle model: the firmware is compiled for the host, so MSP430 instructions and
+ * cycles can not be counted. What the mock does see is every peripheral register
+ * access, every interrupt and every __delay_cycles(). Each of them costs a fixed
+ * number of MCLK cycles (HOST_CYCLES_PER_ACCESS, HOST_CYCLES_INTERRUPT, what
+ * __delay_cycles() asks for), which advances the clock, so polling and waiting in
+ * a handler show up as active time and peripheral events happen in order. This
+ * captures what dominates the firmware (register traffic, polling and waiting)
+ * and is deterministic, hence suitable for regression numbers. The cycles and
+ * active times are estimates of this model, not figures measured on the MSP430;
+ * the arithmetic between two register accesses is free in it. The register
+ * accesses and interrupts are counted exactly.
+ *
+ * Writes through a register accessor happen after the accessor returned, so their
+ * side effects are applied lazily by commit() on the next access, when going to
+ * sleep, before a __delay_cycles() and when a handler returns. The mock assumes a little endian host for the
+ * byte halves of the 16 bit registers.
+ */
+
+#include <setjmp.h>
+#include <string.h>
+
+#include <rf430frl152h.h>
+#include "host.h"
+
+//================================================================
+
+#define HOST_DRIVER_TABLE_START     0xFFCE      // fixed in ROM
+#define HOST_DRIVER_TABLE_KEY       0xCECE
+#define HOST_NO_EVENT               UINT64_MAX
+
+unsigned char host_memory[0x10000];
+HostStatistics host_statistics;
+
+static unsigned short Registers[HOST_REGISTER_COUNT];
+static uint64_t Now;                        // simulation clock in ns
+static uint64_t Deadline;                   // end of the current host_idle() or host_run_main()
+static int InterruptsEnabled;               // GIE
+static int WakeRequested;                   // an ISR cleared the LPM bits on exit
+static int MainRunning;
+static int PayloadMode;                     // the interrupt vectors belong to the sensor firmware
+static jmp_buf MainStop;
+
+static int Sd14Busy;
+static uint64_t Sd14Done;                   // completion time of the running conversion
+static uint16_t Inputs[8];
+static uint16_t Noise[8];
+static uint32_t NoiseState;
+
+static int TimerRunning;
+static uint64_t TimerPeriod;
+static uint64_t TimerHz;
+static uint64_t TimerNext;
+static unsigned short TimerSeen[3];         // TA0CTL, TA0CCR0, TA0EX0 as last applied
+
+static uint8_t RxFifo[HOST_FIFO_SIZE];
+static int RxLength;
+static int RxPosition;
+static uint8_t TxFifo[HOST_FIFO_SIZE];
+static int TxLength;
+static int TxPending;                       // bytes of RF13MTXF written by the last access
+
+/*  Account                                                                            *
+ *  Function:  Let active mode code advance the clock.                                 */
+static void Account(uint64_t cycles)
+{
+    uint64_t ns = cycles * 1000000000ULL / HOST_MCLK_HZ;
+
+    host_statistics.active_cycles += cycles;
+    host_statistics.active_ns += ns;
+    Now += ns;
+}
+
+static uint16_t NextNoise(unsigned channel)
+{
+    NoiseState = NoiseState * 1103515245UL + 12345UL;
+    if (Noise[channel] == 0)
+    {
+        return 0;
+    }
+    return (uint16_t)((NoiseState >> 16) % (2 * Noise[channel] + 1));
+}
+
+/*  StartConversion                                                                    *
+ *  Function:  The first result after enabling takes twice as long with SD14INTDLY0,   *
+ *             since the CIC filter needs two samples to settle.                       */
+static void StartConversion(void)
+{
+    Sd14Busy = 1;
+    Sd14Done = Now + HOST_SD14_CONVERSION_NS;
+    if (Registers[HOST_SD14CTL1] & SD14INTDLY0)
+    {
+        Sd14Done += HOST_SD14_CONVERSION_NS;
+    }
+}
+
+/*  TimerCount                                                                         *
+ *  Function:  TA0R of the running timer, the ticks since the last CCR0 event.         */
+static unsigned short TimerCount(void)
+{
+    uint64_t ticks = (Now + TimerPeriod - TimerNext) * TimerHz / 1000000000ULL;
+
+    return ticks > Registers[HOST_TA0CCR0] ? Registers[HOST_TA0CCR0] : (unsigned short) ticks;
+}
+
+/*  ReconfigureTimer                                                                   *
+ *  Function:  A stopped timer keeps its count, TACLR clears it. A timer started       *
+ *             again counts from zero, which is all the firmware does.                 */
+static void ReconfigureTimer(void)
+{
+    unsigned short ctl = Registers[HOST_TA0CTL];
+    uint64_t hz = (ctl & TASSEL_1) ? HOST_ACLK_HZ : HOST_MCLK_HZ;
+
+    if (TimerRunning)
+    {
+        Registers[HOST_TA0R] = TimerCount();
+    }
+    if (ctl & TACLR)
+    {
+        Registers[HOST_TA0R] = 0;
+    }
+
+    hz >>= (ctl & ID__MASK) >> 6;
+    hz /= (Registers[HOST_TA0EX0] & 0x7) + 1;
+    TimerRunning = (ctl & MC__MASK) == MC_1 && hz != 0;
+    TimerPeriod = ((uint64_t) Registers[HOST_TA0CCR0] + 1) * 1000000000ULL / (hz ? hz : 1);
+    TimerHz = hz;
+    if ((ctl & TACLR) || TimerNext <= Now)
+    {
+        TimerNext = Now + TimerPeriod;
+    }
+    Registers[HOST_TA0CTL] &= ~TACLR;
+    TimerSeen[0] = Registers[HOST_TA0CTL];
+    TimerSeen[1] = Registers[HOST_TA0CCR0];
+    TimerSeen[2] = Registers[HOST_TA0EX0];
+}
+
+/*  Commit                                                                             *
+ *  Function:  Apply the side effects of the preceding register write.                 */
+static void Commit(void)
+{
+    unsigned short ctl0 = Registers[HOST_SD14CTL0];
+
+    if (TxPending)
+    {
+        if (TxLength < HOST_FIFO_SIZE)
+        {
+            TxFifo[TxLength++] = Registers[HOST_RF13MTXF] & 0xFF;
+        }
+        if (TxPending == 2 && TxLength < HOST_FIFO_SIZE)
+        {
+            TxFifo[TxLength++] = Registers[HOST_RF13MTXF] >> 8;
+        }
+        TxPending = 0;
+    }
+
+    if (!(ctl0 & SD14EN))
+    {
+        Sd14Busy = 0;
+    }
+    else if (ctl0 & SD14SC)
+    {
+        Registers[HOST_SD14CTL0] &= ~SD14SC;
+        StartConversion();
+    }
+
+    if (Registers[HOST_TA0CTL] != TimerSeen[0] || Registers[HOST_TA0CCR0] != TimerSeen[1]
+            || Registers[HOST_TA0EX0] != TimerSeen[2])
+    {
+        ReconfigureTimer();
+    }
+}
+
+/*  AdvancePeripherals                                                                 *
+ *  Function:  Complete everything which is due at the current time.                   */
+static void AdvancePeripherals(void)
+{
+    while (Sd14Busy && Sd14Done <= Now)
+    {
+        unsigned channel = Registers[HOST_SD14CTL1] & SD14INCH_MASK;
+
+        if (Registers[HOST_SD14CTL0] & SD14IFG)
+        {
+            Registers[HOST_SD14CTL0] |= SD14OVIFG;  // previous result was not read in time
+        }
+        Registers[HOST_SD14MEM0] = (Inputs[channel] + NextNoise(channel)) & 0x3FFF;
+        Registers[HOST_SD14CTL0] |= SD14IFG;
+        host_statistics.conversions++;
+        if (Registers[HOST_SD14CTL0] & SD14SGL)
+        {
+            Sd14Busy = 0;
+        }
+        else
+        {
+            Sd14Done += HOST_SD14_CONVERSION_NS;
+        }
+    }
+    while (TimerRunning && TimerNext <= Now)
+    {
+        Registers[HOST_TA0CCTL0] |= CCIFG;
+        TimerNext += TimerPeriod;
+    }
+}
+
+static uint64_t NextEvent(void)
+{
+    uint64_t next = HOST_NO_EVENT;
+
+    if (Sd14Busy)
+    {
+        next = Sd14Done;
+    }
+    if (TimerRunning && (Registers[HOST_TA0CCTL0] & CCIE) && TimerNext < next)
+    {
+        next = TimerNext;
+    }
+    return next;
+}
+
+static void Access(void)
+{
+    Commit();
+    host_statistics.register_accesses++;
+    Account(HOST_CYCLES_PER_ACCESS);
+    AdvancePeripherals();
+}
+
+static void PrepareRead(enum host_register reg, int bytes)
+{
+    switch (reg)
+    {
+        case HOST_SD14IV:
+            if (Registers[HOST_SD14CTL0] & SD14OVIFG)
+            {
+                Registers[reg] = SD14IV__OV;
+            }
+            else if (Registers[HOST_SD14CTL0] & SD14IFG)
+            {
+                Registers[reg] = SD14IV__RES;
+            }
+            else
+            {
+                Registers[reg] = SD14IV__NONE;
+            }
+            break;
+        case HOST_RF13MRXF:
+            Registers[reg] = 0;
+            if (RxPosition < RxLength)
+            {
+                Registers[reg] = RxFifo[RxPosition++];
+            }
+            if (bytes == 2 && RxPosition < RxLength)
+            {
+                Registers[reg] |= (unsigned short) RxFifo[RxPosition++] << 8;
+            }
+            break;
+        case HOST_RF13MTXF:
+            TxPending = bytes;
+            break;
+        case HOST_TA0R:
+            if (TimerRunning)
+            {
+                Registers[reg] = TimerCount();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+unsigned short *host_register16(enum host_register reg)
+{
+    Access();
+    PrepareRead(reg, 2);
+    return &Registers[reg];
+}
+
+unsigned char *host_register8(enum host_register reg, int high)
+{
+    Access();
+    PrepareRead(reg, 1);
+    return (unsigned char *) &Registers[reg] + (high ? 1 : 0);
+}
+
+void host_rom_call(const char *code)
+{
+    (void) code;
+}
+
+void host_delay_cycles(unsigned long cycles)
+{
+    Commit();                               // a register write before the wait takes effect right away
+    Account(cycles);
+    AdvancePeripherals();
+}
+
+void host_disable_interrupt(void)
+{
+    InterruptsEnabled = 0;
+}
+
+void host_bic_sr_on_exit(unsigned short bits)
+{
+    if (bits & CPUOFF)
+    {
+        WakeRequested = 1;
+    }
+}
+
+/*  RunInterrupt                                                                       *
+ *  Function:  Service an interrupt like the CPU does, interrupts stay disabled until  *
+ *             RETI.                                                                   */
+static void RunInterrupt(enum host_interrupt kind)
+{
+    uint64_t start = host_statistics.register_accesses;
+    uint64_t start_cycles = host_statistics.active_cycles;
+    int enabled = InterruptsEnabled;
+
+    InterruptsEnabled = 0;
+    Account(HOST_CYCLES_INTERRUPT);
+    switch (kind)
+    {
+        case HOST_INTERRUPT_SD14:
+            host_firmware_sd14_isr();
+            break;
+        case HOST_INTERRUPT_TIMER0_A0:
+            Registers[HOST_TA0CCTL0] &= ~CCIFG;     // single source vector, cleared on entry
+            host_firmware_timer0_a0_isr();
+            break;
+        default:
+            break;
+    }
+    Commit();
+    InterruptsEnabled = enabled;
+    host_statistics.interrupts[kind]++;
+    host_statistics.interrupt_accesses[kind] += host_statistics.register_accesses - start;
+    host_statistics.interrupt_cycles[kind] += host_statistics.active_cycles - start_cycles;
+}
+
+/*  RunForeignInterrupt                                                                *
+ *  Function:  Stand in for the ISR of the sensor firmware when the handlers run as a  *
+ *             payload. It is not known what it does besides acknowledging, the        *
+ *             firmware never sees the event.                                          */
+static void RunForeignInterrupt(enum host_interrupt kind)
+{
+    Account(HOST_CYCLES_INTERRUPT);
+    if (kind == HOST_INTERRUPT_SD14)
+    {
+        Registers[HOST_SD14CTL0] &= ~(SD14IFG | SD14OVIFG);
+    }
+    else
+    {
+        Registers[HOST_TA0CCTL0] &= ~CCIFG;
+    }
+    host_statistics.interrupts[kind]++;
+}
+
+/*  ServicePending                                                                     *
+ *  Function:  Run the highest priority pending interrupt, returns 0 if none is        *
+ *             pending.                                                                */
+static int ServicePending(void)
+{
+    unsigned short ctl0 = Registers[HOST_SD14CTL0];
+    enum host_interrupt kind;
+
+    if ((ctl0 & SD14IE) && (ctl0 & (SD14IFG | SD14OVIFG)))
+    {
+        kind = HOST_INTERRUPT_SD14;
+    }
+    else if ((Registers[HOST_TA0CCTL0] & CCIE) && (Registers[HOST_TA0CCTL0] & CCIFG))
+    {
+        kind = HOST_INTERRUPT_TIMER0_A0;
+    }
+    else
+    {
+        return 0;
+    }
+    if (PayloadMode)
+    {
+        RunForeignInterrupt(kind);
+    }
+    else
+    {
+        RunInterrupt(kind);
+    }
+    return 1;
+}
+
+/*  Sleep                                                                              *
+ *  Function:  Stay in a low power mode and service interrupts until one of them       *
+ *             requests to wake up or the deadline is reached. Without a main loop the *
+ *             wakeup requests are ignored.                                            */
+static void Sleep(void)
+{
+    for (;;)
+    {
+        uint64_t next;
+
+        if (ServicePending())
+        {
+            host_statistics.wakeups++;
+            if (WakeRequested)
+            {
+                WakeRequested = 0;
+                if (MainRunning)
+                {
+                    return;
+                }
+            }
+            continue;
+        }
+        next = NextEvent();
+        if (next == HOST_NO_EVENT || next > Deadline)
+        {
+            host_statistics.sleep_ns += Deadline - Now;
+            Now = Deadline;
+            if (MainRunning)
+            {
+                longjmp(MainStop, 1);
+            }
+            return;
+        }
+        host_statistics.sleep_ns += next - Now;
+        Now = next;
+        AdvancePeripherals();
+    }
+}
+
+void host_bis_sr(unsigned short bits)
+{
+    Commit();
+    if (bits & GIE)
+    {
+        InterruptsEnabled = 1;
+    }
+    if (bits & CPUOFF)
+    {
+        host_statistics.sleeps++;
+        Sleep();
+    }
+}
+
+void host_reset(void)
+{
+    memset(Registers, 0, sizeof(Registers));
+    memset(TimerSeen, 0, sizeof(TimerSeen));
+    memset(&host_statistics, 0, sizeof(host_statistics));
+    memset(host_memory, 0xFF, sizeof(host_memory));
+    Now = 0;
+    InterruptsEnabled = 0;
+    WakeRequested = 0;
+    Sd14Busy = 0;
+    PayloadMode = 0;
+    TimerRunning = 0;
+    TimerNext = 0;
+    NoiseState = 1;
+    RxLength = RxPosition = TxLength = TxPending = 0;
+    host_firmware_install_driver_table();
+}
+
+uint64_t host_now(void)
+{
+    return Now;
+}
+
+void host_set_input(unsigned channel, uint16_t value, uint16_t noise)
+{
+    Inputs[channel & 0x7] = value;
+    Noise[channel & 0x7] = noise;
+}
+
+/*  host_set_payload_mode                                                              *
+ *  Function:  Run the handlers as a payload does on a sensor: the interrupt vectors   *
+ *             stay with the sensor firmware, so the ISRs of main.c never run. Do not  *
+ *             call host_run_main() in this mode, the main loop is not there either.   */
+void host_set_payload_mode(int enabled)
+{
+    PayloadMode = enabled;
+}
+
+void host_idle(uint64_t ns)
+{
+    Commit();
+    Deadline = Now + ns;
+    Sleep();
+}
+
+/*  host_run_main                                                                      *
+ *  Function:  Boot the firmware and let its main loop run for the given time. The     *
+ *             loop is left at its first sleep beyond that time, RAM and FRAM state    *
+ *             persists for subsequent commands.                                       */
+void host_run_main(uint64_t ns)
+{
+    Deadline = Now + ns;
+    MainRunning = 1;
+    if (setjmp(MainStop) == 0)
+    {
+        host_firmware_main();
+    }
+    MainRunning = 0;
+}
+
+/*  host_sd14_enabled                                                                  *
+ *  Function:  Whether the SD14 and with it the bias current of the thermistor is on.  */
+int host_sd14_enabled(void)
+{
+    Commit();
+    return (Registers[HOST_SD14CTL0] & SD14EN) != 0;
+}
+
+void host_read_block(uint16_t block, uint8_t *data)
+{
+    uint16_t i;
+
+    for (i = 0; i < HOST_BLOCK_SIZE; i++)
+    {
+        data[i] = *host_firmware_fram(HOST_FRAM_START + block * HOST_BLOCK_SIZE + i);
+    }
+}
+
+void host_write_block(uint16_t block, const uint8_t *data)
+{
+    uint16_t i;
+
+    for (i = 0; i < HOST_BLOCK_SIZE; i++)
+    {
+        *host_firmware_fram(HOST_FRAM_START + block * HOST_BLOCK_SIZE + i) = data[i];
+    }
+}
+
+static uint16_t Load16(uint16_t address)
+{
+    return host_memory[address] | ((uint16_t) host_memory[address + 1] << 8);
+}
+
+/*  host_rf_command                                                                    *
+ *  Function:  Dispatch a custom command like the ROM RF stack does: look the ID up in *
+ *             the driver table and call the handler from the RF13M interrupt with the *
+ *             parameters in the receive FIFO. The answer includes the flags byte.     */
+int host_rf_command(uint16_t id, const uint8_t *parameters, int parameters_length,
+                    uint8_t *response, int response_size)
+{
+    uint64_t start = host_statistics.register_accesses;
+    uint64_t start_cycles = host_statistics.active_cycles;
+    uint16_t address = 0;
+    uint16_t entry;
+    int enabled = InterruptsEnabled;
+    int length;
+
+    Commit();
+    if (parameters_length > HOST_FIFO_SIZE)
+    {
+        parameters_length = HOST_FIFO_SIZE;
+    }
+    memcpy(RxFifo, parameters, parameters_length);
+    RxLength = parameters_length;
+    RxPosition = 0;
+    TxLength = 0;
+
+    if (Load16(HOST_DRIVER_TABLE_START) == HOST_DRIVER_TABLE_KEY)
+    {
+        for (entry = HOST_DRIVER_TABLE_START - 2; Load16(entry) != HOST_DRIVER_TABLE_KEY; entry -= 4)
+        {
+            if (Load16(entry) == id)
+            {
+                address = Load16(entry - 2);
+                break;
+            }
+        }
+    }
+
+    InterruptsEnabled = 0;
+    Account(HOST_CYCLES_INTERRUPT);
+    if (address)
+    {
+        host_firmware_call_driver(address);
+        Commit();
+    }
+    else
+    {
+        TxFifo[0] = 0x01;   // error flag
+        TxFifo[1] = 0x01;   // command not supported
+        TxLength = 2;
+    }
+    InterruptsEnabled = enabled;
+    host_statistics.interrupts[HOST_INTERRUPT_RF13M]++;
+    host_statistics.interrupt_accesses[HOST_INTERRUPT_RF13M] += host_statistics.register_accesses - start;
+    host_statistics.interrupt_cycles[HOST_INTERRUPT_RF13M] += host_statistics.active_cycles - start_cycles;
+
+    length = TxLength < response_size ? TxLength : response_size;
+    memcpy(response, TxFifo, length);
+    return length;
+}
@@ -0,0 +1,79 @@
+/*
+ * host.h
+ *
+ * Interface of the host simulation of the firmware.
+ *
+ * The simulation keeps a clock in nanoseconds. Code running in active mode
+ * advances it according to a cycle model (see host.c), sleeping advances it to
+ * the next peripheral event. All figures are accumulated in host_statistics and
+ * can be reset between benchmark runs.
+ */
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <stdint.h>
+
+//================================================================
+
+#define HOST_MCLK_HZ                2000000UL   // DCO (4 MHz) divided by 2 as set up in DeviceInit
+#define HOST_ACLK_HZ                64000UL     // VLO divided by 4 as set up in DeviceInit
+#define HOST_CYCLES_PER_ACCESS      3           // cycle model: absolute addressing of a peripheral register
+#define HOST_CYCLES_INTERRUPT       11          // cycle model: interrupt latency (6) plus RETI (5)
+#define HOST_SD14_CONVERSION_NS     16000000ULL // 2 kHz SD14 clock, decimation by 32 at the fastest SD14RATE
+
+#define HOST_FIFO_SIZE              64
+#define HOST_FRAM_START             0xF860      // block 0 of the ISO 15693 memory
+#define HOST_BLOCK_SIZE             8
+
+typedef struct
+{
+    uint64_t active_cycles;                 // MCLK cycles in active mode according to the cycle model
+    uint64_t active_ns;                     // time spent in active mode according to the cycle model
+    uint64_t sleep_ns;                      // time spent in a low power mode
+    uint64_t register_accesses;             // peripheral register accesses
+    uint64_t conversions;                   // completed SD14 conversions
+    uint64_t sleeps;                        // low power mode entries
+    uint64_t wakeups;                       // interrupts serviced while sleeping
+    uint64_t interrupts[3];                 // serviced interrupts, see enum host_interrupt
+    uint64_t interrupt_accesses[3];         // register accesses of the serviced interrupts
+    uint64_t interrupt_cycles[3];           // modeled cycles of the serviced interrupts, entry and RETI included
+} HostStatistics;
+
+enum host_interrupt
+{
+    HOST_INTERRUPT_SD14,
+    HOST_INTERRUPT_TIMER0_A0,
+    HOST_INTERRUPT_RF13M
+};
+
+extern HostStatistics host_statistics;
+
+/* Simulation control */
+void host_reset(void);
+uint64_t host_now(void);
+void host_set_input(unsigned channel, uint16_t value, uint16_t noise);
+void host_set_payload_mode(int enabled);
+void host_idle(uint64_t ns);
+void host_run_main(uint64_t ns);
+int host_sd14_enabled(void);
+
+/* RF stack, the request holds everything behind the vendor code */
+int host_rf_command(uint16_t id, const uint8_t *parameters, int parameters_length,
+                    uint8_t *response, int response_size);
+
+/* Block access of the ROM RF stack, without cost since it runs in ROM */
+void host_read_block(uint16_t block, uint8_t *data);
+void host_write_block(uint16_t block, const uint8_t *data);
+
+/* Provided by firmware.c, which compiles main.c for the host */
+void host_firmware_main(void);
+void host_firmware_sd14_isr(void);
+void host_firmware_timer0_a0_isr(void);
+void host_firmware_install_driver_table(void);
+void host_firmware_call_driver(uint16_t address);
+uint16_t host_firmware_driver_count(void);
+uint16_t host_firmware_driver_id(uint16_t index);
+uint8_t *host_firmware_fram(uint16_t address);
+
+#endif
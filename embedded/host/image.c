@@ -0,0 +1,727 @@
+/*
+ * image.c
+ *
+ * Link main.c compiled by clang for the MSP430 (make size) into a firmware image in
+ * TI-TXT format, in place of the output of Code Composer Studio. The payload builder
+ * takes it like the image of Code Composer Studio, so the payload of the app can be
+ * rebuilt from the source (make payload FIRMWARE=firmware-msp430.txt):
+ *
+ *  - the code and constants reached from main, the interrupt service routines and
+ *    the driver table are placed back to back from the origin of FRAM_CODE, the
+ *    constants first as the TI linker does,
+ *  - objects with a fixed address (#pragma location, which clang ignores) are placed
+ *    with -p symbol=place, the place being a region of the MEMORY directive of the
+ *    linker command file or an address,
+ *  - the other variables are placed into RAM around the fixed ones,
+ *  - the driver table is built downwards from DRIVER_TABLE_START out of the pairs of
+ *    XxxCommandID and XxxCommandAddress in the order of main.c, between the keys,
+ *  - the interrupt service routines are entered with -v symbol=INTnn (#pragma vector
+ *    is ignored as well), the vector regions come from the linker command file,
+ *  - the peripheral registers are resolved with the file given with -r, written like
+ *    the peripheral memory map of Code Composer Studio (see msp430/rf430frl152h.cmd).
+ *
+ * Only FRAM is written to the image. Calls of runtime support functions (the library
+ * of the compiler) are left pointing to address 0 with a warning. The image has
+ * neither them nor the startup code and its reset vector stays empty, so it is meant
+ * for the payload builder and not for flashing a sensor.
+ *
+ * Usage: lazarus-image-linker [-p symbol=place]... [-v symbol=INTnn]... -r registers.cmd
+ *                             lnk_rf430frl152h_Lazarus.cmd firmware.o > firmware.txt
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//================================================================
+
+#define MEMORY_SIZE                 0x10000
+#define FRAM_START                  0xF840      // lock blocks, the image holds nothing below
+#define DRIVER_TABLE_START          0xFFCE      // DRIVER_TABLE_START in main.c
+#define COMMAND_ID_SUFFIX           "CommandID"
+#define COMMAND_ADDRESS_SUFFIX      "CommandAddress"
+#define CODE_REGION                 "FRAM_CODE"
+#define RAM_REGION                  "RAM"
+
+#define MAX_REGIONS                 64
+#define MAX_REGISTERS               128
+#define MAX_PLACEMENTS              32
+#define MAX_COMMANDS                16
+#define MAX_RUNTIME                 32
+#define NAME_SIZE                   32
+
+#define MSP430_CALL_IMMEDIATE       0x12B0      // call #address
+#define MSP430_BRANCH_IMMEDIATE     0x4030      // br #address, a tail call
+#define R_MSP430_16                 3
+#define R_MSP430_16_BYTE            5
+
+typedef struct
+{
+    char name[NAME_SIZE];
+    unsigned long origin;
+    unsigned long length;
+} Region;
+
+typedef struct
+{
+    char name[NAME_SIZE];
+    uint16_t address;
+} Register;
+
+typedef struct
+{
+    const char *symbol;
+    const char *place;
+} Placement;
+
+static uint8_t *Object;
+static size_t ObjectSize;
+static const Elf32_Shdr *Sections;
+static int SectionCount;
+static const Elf32_Sym *Symbols;
+static int SymbolCount;
+static const char *SymbolNames;
+static const char *SectionNames;
+
+static uint8_t *Reached;
+static uint8_t *Placed;
+static unsigned long *Address;
+static int *Pending;
+static int PendingCount;
+
+static Region Regions[MAX_REGIONS];
+static int RegionCount;
+static Register Registers[MAX_REGISTERS];
+static int RegisterCount;
+static Placement Placements[MAX_PLACEMENTS];
+static int PlacementCount;
+static Placement Vectors[MAX_PLACEMENTS];
+static int VectorCount;
+static const char *Runtime[MAX_RUNTIME];
+static int RuntimeCount;
+
+static uint8_t Image[MEMORY_SIZE];
+static uint8_t Written[MEMORY_SIZE];
+
+static void Fail(const char *message, const char *detail)
+{
+    fprintf(stderr, "lazarus-image-linker: %s%s%s\n", message, detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: lazarus-image-linker [-p symbol=place]... [-v symbol=INTnn]... -r registers.cmd\n"
+                    "                            lnk_rf430frl152h_Lazarus.cmd firmware.o > firmware.txt\n");
+    exit(2);
+}
+
+static const char *SectionName(int index)
+{
+    return SectionNames + Sections[index].sh_name;
+}
+
+static int Vector(int index)
+{
+    return strncmp(SectionName(index), "__interrupt_vector_", 19) == 0;
+}
+
+static int EndsWith(const char *name, const char *suffix)
+{
+    size_t length = strlen(name), count = strlen(suffix);
+
+    return length > count && strcmp(name + length - count, suffix) == 0;
+}
+
+static unsigned long Align(unsigned long address, int section)
+{
+    unsigned long align = Sections[section].sh_addralign ? Sections[section].sh_addralign : 1;
+
+    return (address + align - 1) / align * align;
+}
+
+/*  ReadObject                                                                         *
+ *  Function:  Load the object file and locate its section and symbol tables.         */
+static void ReadObject(const char *path)
+{
+    FILE *input = fopen(path, "rb");
+    const Elf32_Ehdr *header;
+    int i;
+
+    if (input == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    fseek(input, 0, SEEK_END);
+    ObjectSize = ftell(input);
+    rewind(input);
+    Object = malloc(ObjectSize);
+    if (Object == NULL || fread(Object, 1, ObjectSize, input) != ObjectSize)
+    {
+        Fail("reading failed", path);
+    }
+    fclose(input);
+
+    header = (const Elf32_Ehdr *) Object;
+    if (ObjectSize < sizeof(*header) || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0
+            || header->e_ident[EI_CLASS] != ELFCLASS32 || header->e_ident[EI_DATA] != ELFDATA2LSB
+            || header->e_type != ET_REL || header->e_machine != EM_MSP430)
+    {
+        Fail("not a relocatable MSP430 object", path);
+    }
+    Sections = (const Elf32_Shdr *) (Object + header->e_shoff);
+    SectionCount = header->e_shnum;
+    SectionNames = (const char *) Object + Sections[header->e_shstrndx].sh_offset;
+    for (i = 0; i < SectionCount; i++)
+    {
+        if (Sections[i].sh_type == SHT_SYMTAB)
+        {
+            Symbols = (const Elf32_Sym *) (Object + Sections[i].sh_offset);
+            SymbolCount = Sections[i].sh_size / sizeof(Elf32_Sym);
+            SymbolNames = (const char *) Object + Sections[Sections[i].sh_link].sh_offset;
+        }
+    }
+    if (Symbols == NULL)
+    {
+        Fail("no symbol table", path);
+    }
+    Reached = calloc(SectionCount, 1);
+    Placed = calloc(SectionCount, 1);
+    Address = calloc(SectionCount, sizeof(unsigned long));
+    Pending = malloc(SectionCount * sizeof(int));
+}
+
+/*  ReadRegions                                                                        *
+ *  Function:  Take the regions of the MEMORY directive of the linker command file,    *
+ *             lines of the form "NAME : origin = 0x..., length = 0x...".              */
+static void ReadRegions(const char *path)
+{
+    FILE *input = fopen(path, "r");
+    char line[256];
+
+    if (input == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), input) != NULL && RegionCount < MAX_REGIONS)
+    {
+        Region *region = &Regions[RegionCount];
+        const char *o = strstr(line, "origin");
+        const char *l = strstr(line, "length");
+
+        if (o == NULL || l == NULL || strchr(o, '=') == NULL || strchr(l, '=') == NULL
+                || sscanf(line, " %31[A-Za-z0-9_] :", region->name) != 1)
+        {
+            continue;                       // also skips the regions commented out with //
+        }
+        region->origin = strtoul(strchr(o, '=') + 1, NULL, 0);
+        region->length = strtoul(strchr(l, '=') + 1, NULL, 0);
+        RegionCount++;
+    }
+    fclose(input);
+}
+
+/*  ReadRegisters                                                                      *
+ *  Function:  Take the register addresses, lines of the form "NAME = 0x...;".         */
+static void ReadRegisters(const char *path)
+{
+    FILE *input = fopen(path, "r");
+    char line[256];
+
+    if (input == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        Register *reg = &Registers[RegisterCount];
+        unsigned address;
+
+        if (sscanf(line, " %31[A-Za-z0-9_] = %x ;", reg->name, &address) != 2)
+        {
+            continue;
+        }
+        if (RegisterCount == MAX_REGISTERS)
+        {
+            Fail("too many registers", path);
+        }
+        reg->address = (uint16_t) address;
+        RegisterCount++;
+    }
+    fclose(input);
+}
+
+static const Region *FindRegion(const char *name)
+{
+    int i;
+
+    for (i = 0; i < RegionCount; i++)
+    {
+        if (strcmp(Regions[i].name, name) == 0)
+        {
+            return &Regions[i];
+        }
+    }
+    return NULL;
+}
+
+/*  FindSymbol                                                                         *
+ *  Function:  The defined symbol with the given name, the program fails without.      */
+static const Elf32_Sym *FindSymbol(const char *name)
+{
+    int i;
+
+    for (i = 1; i < SymbolCount; i++)
+    {
+        if (Symbols[i].st_shndx != SHN_UNDEF && Symbols[i].st_shndx < SectionCount
+                && strcmp(SymbolNames + Symbols[i].st_name, name) == 0)
+        {
+            return &Symbols[i];
+        }
+    }
+    Fail("no such symbol", name);
+    return NULL;
+}
+
+static void Reach(int index)
+{
+    if (index > 0 && index < SectionCount && !Reached[index] && !Vector(index))
+    {
+        Reached[index] = 1;
+        Pending[PendingCount++] = index;
+    }
+}
+
+/*  Follow                                                                             *
+ *  Function:  Reach everything the relocations of a reached section refer to.         */
+static void Follow(int section)
+{
+    int i, j;
+
+    for (i = 0; i < SectionCount; i++)
+    {
+        const Elf32_Rela *rela;
+
+        if (Sections[i].sh_type != SHT_RELA || (int) Sections[i].sh_info != section)
+        {
+            continue;
+        }
+        rela = (const Elf32_Rela *) (Object + Sections[i].sh_offset);
+        for (j = 0; j < (int) (Sections[i].sh_size / sizeof(Elf32_Rela)); j++)
+        {
+            const Elf32_Sym *symbol = &Symbols[ELF32_R_SYM(rela[j].r_info)];
+
+            if (symbol->st_shndx != SHN_UNDEF && symbol->st_shndx < SectionCount)
+            {
+                Reach(symbol->st_shndx);
+            }
+        }
+    }
+}
+
+/*  Overlap                                                                            *
+ *  Function:  A placed section the range would overlap, 0 if there is none.           */
+static int Overlap(unsigned long address, unsigned long size)
+{
+    int i;
+
+    for (i = 1; i < SectionCount; i++)
+    {
+        if (Placed[i] && size > 0 && Sections[i].sh_size > 0
+                && address < Address[i] + Sections[i].sh_size && Address[i] < address + size)
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+static void Place(int section, unsigned long address)
+{
+    int other = Overlap(address, Sections[section].sh_size);
+
+    if (address + Sections[section].sh_size > MEMORY_SIZE)
+    {
+        Fail("section does not fit into the address space", SectionName(section));
+    }
+    if (other != 0)
+    {
+        fprintf(stderr, "lazarus-image-linker: %s overlaps %s\n", SectionName(section), SectionName(other));
+        exit(1);
+    }
+    Reach(section);
+    Placed[section] = 1;
+    Address[section] = address;
+}
+
+/*  PlaceFixed                                                                         *
+ *  Function:  Place the objects given with -p at a region or an address.              */
+static void PlaceFixed(void)
+{
+    int i;
+
+    for (i = 0; i < PlacementCount; i++)
+    {
+        const Region *region = FindRegion(Placements[i].place);
+        char *end = "";
+        unsigned long address = region ? region->origin : strtoul(Placements[i].place, &end, 0);
+
+        if (*end != '\0')
+        {
+            Fail("neither a region nor an address", Placements[i].place);
+        }
+        Place(FindSymbol(Placements[i].symbol)->st_shndx, address);
+    }
+}
+
+/*  PlaceDriverTable                                                                   *
+ *  Function:  Lay out the driver table from DRIVER_TABLE_START downwards, the command *
+ *             IDs in the order main.c defines them, and return where it ends.         */
+static unsigned long PlaceDriverTable(void)
+{
+    unsigned long address = DRIVER_TABLE_START;
+    int commands = 0;
+    int section;
+
+    Place(FindSymbol("START_KEY")->st_shndx, address);
+    for (section = 1; section < SectionCount; section++)
+    {
+        char name[NAME_SIZE + 8];
+        int i;
+
+        for (i = 1; i < SymbolCount; i++)
+        {
+            const char *symbol = SymbolNames + Symbols[i].st_name;
+
+            if (Symbols[i].st_shndx == section && ELF32_ST_TYPE(Symbols[i].st_info) == STT_OBJECT
+                    && EndsWith(symbol, COMMAND_ID_SUFFIX) && strlen(symbol) < NAME_SIZE)
+            {
+                break;
+            }
+        }
+        if (i == SymbolCount)
+        {
+            continue;
+        }
+        if (++commands > MAX_COMMANDS)
+        {
+            Fail("too many commands in the driver table", NULL);
+        }
+        strcpy(name, SymbolNames + Symbols[i].st_name);
+        strcpy(name + strlen(name) - strlen(COMMAND_ID_SUFFIX), COMMAND_ADDRESS_SUFFIX);
+        Place(section, address - 2);
+        Place(FindSymbol(name)->st_shndx, address - 4);
+        address -= 4;
+    }
+    Place(FindSymbol("END_KEY")->st_shndx, address - 2);
+    return address - 2;
+}
+
+/*  PlaceCode                                                                          *
+ *  Function:  Put the reached constants, then the reached code, back to back from the *
+ *             origin of FRAM_CODE up to the driver table.                             */
+static void PlaceCode(unsigned long limit)
+{
+    const Region *code = FindRegion(CODE_REGION);
+    unsigned long address;
+    int executable, i;
+
+    if (code == NULL)
+    {
+        Fail("no " CODE_REGION " in the MEMORY directive", NULL);
+    }
+    address = code->origin;
+    for (executable = 0; executable < 2; executable++)
+    {
+        for (i = 1; i < SectionCount; i++)
+        {
+            if (!Reached[i] || Placed[i] || !(Sections[i].sh_flags & SHF_ALLOC)
+                    || (Sections[i].sh_flags & SHF_WRITE)
+                    || ((Sections[i].sh_flags & SHF_EXECINSTR) != 0) != executable)
+            {
+                continue;
+            }
+            address = Align(address, i);
+            Place(i, address);
+            address += Sections[i].sh_size;
+        }
+    }
+    if (address > limit)
+    {
+        fprintf(stderr, "lazarus-image-linker: " CODE_REGION " overflows into the driver table by %lu bytes\n",
+                address - limit);
+        exit(1);
+    }
+}
+
+/*  PlaceVariables                                                                     *
+ *  Function:  Put the reached variables into the first gap of RAM between the ones    *
+ *             placed with -p. Initial values need the startup code, which the image   *
+ *             lacks, they are reported.                                               */
+static void PlaceVariables(void)
+{
+    const Region *ram = FindRegion(RAM_REGION);
+    int i;
+
+    if (ram == NULL)
+    {
+        Fail("no " RAM_REGION " in the MEMORY directive", NULL);
+    }
+    for (i = 1; i < SectionCount; i++)
+    {
+        unsigned long address = Align(ram->origin, i);
+        int other;
+
+        if (!Reached[i] || Placed[i] || !(Sections[i].sh_flags & SHF_ALLOC) || !(Sections[i].sh_flags & SHF_WRITE))
+        {
+            continue;
+        }
+        if (Sections[i].sh_type == SHT_PROGBITS)
+        {
+            fprintf(stderr, "lazarus-image-linker: warning: initial values of %s are not in the image\n",
+                    SectionName(i));
+        }
+        while ((other = Overlap(address, Sections[i].sh_size)) != 0)
+        {
+            address = Align(Address[other] + Sections[other].sh_size, i);
+        }
+        if (address + Sections[i].sh_size > ram->origin + ram->length)
+        {
+            Fail("RAM overflows", SectionName(i));
+        }
+        Place(i, address);
+    }
+}
+
+/*  Called                                                                             *
+ *  Function:  Whether the relocated word is the operand of a call or a branch.        */
+static int Called(int section, Elf32_Addr offset)
+{
+    const uint8_t *code = Object + Sections[section].sh_offset;
+    uint16_t opcode;
+
+    if (!(Sections[section].sh_flags & SHF_EXECINSTR) || offset < 2 || offset > Sections[section].sh_size)
+    {
+        return 0;
+    }
+    opcode = code[offset - 2] | (code[offset - 1] << 8);
+    return opcode == MSP430_CALL_IMMEDIATE || opcode == MSP430_BRANCH_IMMEDIATE;
+}
+
+static void AddRuntime(const char *name)
+{
+    int i;
+
+    for (i = 0; i < RuntimeCount; i++)
+    {
+        if (strcmp(Runtime[i], name) == 0)
+        {
+            return;
+        }
+    }
+    if (RuntimeCount < MAX_RUNTIME)
+    {
+        Runtime[RuntimeCount++] = name;
+        fprintf(stderr, "lazarus-image-linker: warning: runtime support function %s is not in the image, "
+                        "calls go to address 0\n", name);
+    }
+}
+
+/*  Resolve                                                                            *
+ *  Function:  The address a relocation refers to: a placed section, a register or     *
+ *             runtime support.                                                        */
+static unsigned long Resolve(int section, const Elf32_Rela *rela)
+{
+    const Elf32_Sym *symbol = &Symbols[ELF32_R_SYM(rela->r_info)];
+    const char *name = SymbolNames + symbol->st_name;
+    int i;
+
+    if (symbol->st_shndx != SHN_UNDEF)
+    {
+        if (symbol->st_shndx >= SectionCount || !Placed[symbol->st_shndx])
+        {
+            Fail("reference to a section which is not placed", SectionName(section));
+        }
+        return Address[symbol->st_shndx] + symbol->st_value + rela->r_addend;
+    }
+    for (i = 0; i < RegisterCount; i++)
+    {
+        if (strcmp(Registers[i].name, name) == 0)
+        {
+            return Registers[i].address + rela->r_addend;
+        }
+    }
+    if (!Called(section, rela->r_offset))
+    {
+        Fail("unknown register", name);
+    }
+    AddRuntime(name);
+    return 0;
+}
+
+/*  Load                                                                               *
+ *  Function:  Copy the placed sections in FRAM into the image and relocate them.      *
+ *             Variables placed in FRAM (#pragma PERSISTENT) start out zero.           */
+static void Load(void)
+{
+    int i, j;
+
+    for (i = 1; i < SectionCount; i++)
+    {
+        if (!Placed[i] || Address[i] < FRAM_START || Sections[i].sh_size == 0)
+        {
+            continue;
+        }
+        if (Sections[i].sh_type == SHT_PROGBITS)
+        {
+            memcpy(&Image[Address[i]], Object + Sections[i].sh_offset, Sections[i].sh_size);
+        }
+        memset(&Written[Address[i]], 1, Sections[i].sh_size);
+    }
+    for (i = 1; i < SectionCount; i++)
+    {
+        int target = Sections[i].sh_info;
+        const Elf32_Rela *rela;
+
+        if (Sections[i].sh_type != SHT_RELA || target >= SectionCount || !Placed[target]
+                || Address[target] < FRAM_START)
+        {
+            continue;
+        }
+        rela = (const Elf32_Rela *) (Object + Sections[i].sh_offset);
+        for (j = 0; j < (int) (Sections[i].sh_size / sizeof(Elf32_Rela)); j++)
+        {
+            unsigned long address = Address[target] + rela[j].r_offset;
+            unsigned long value = Resolve(target, &rela[j]);
+            int type = ELF32_R_TYPE(rela[j].r_info);
+
+            if (type != R_MSP430_16 && type != R_MSP430_16_BYTE)
+            {
+                Fail("unsupported relocation", SectionName(target));
+            }
+            Image[address] = value & 0xFF;
+            Image[(address + 1) & 0xFFFF] = (value >> 8) & 0xFF;
+        }
+    }
+}
+
+/*  SetVectors                                                                         *
+ *  Function:  Enter the interrupt service routines given with -v.                     */
+static void SetVectors(void)
+{
+    int i;
+
+    for (i = 0; i < VectorCount; i++)
+    {
+        const Region *region = FindRegion(Vectors[i].place);
+        const Elf32_Sym *symbol = FindSymbol(Vectors[i].symbol);
+        unsigned long address = Address[symbol->st_shndx] + symbol->st_value;
+
+        if (region == NULL || region->length != 2)
+        {
+            Fail("not an interrupt vector", Vectors[i].place);
+        }
+        Image[region->origin] = address & 0xFF;
+        Image[region->origin + 1] = (address >> 8) & 0xFF;
+        Written[region->origin] = Written[region->origin + 1] = 1;
+    }
+}
+
+static void WriteTiTxt(FILE *output)
+{
+    unsigned long address = 0;
+    int segments = 0;
+
+    while (address < MEMORY_SIZE)
+    {
+        unsigned long end, i;
+
+        if (!Written[address])
+        {
+            address++;
+            continue;
+        }
+        for (end = address; end < MEMORY_SIZE && Written[end]; end++)
+        {
+        }
+        fprintf(output, "%s@%04lx\n", segments++ ? "\n" : "", address);
+        for (i = address; i < end; i++)
+        {
+            fprintf(output, "%02X%c", Image[i], ((i - address) % 16 == 15 || i + 1 == end) ? '\n' : ' ');
+        }
+        address = end;
+    }
+    fprintf(output, "q\n");
+}
+
+static void AddPlacement(Placement *list, int *count, char *argument)
+{
+    char *separator = strchr(argument, '=');
+
+    if (separator == NULL || *count == MAX_PLACEMENTS)
+    {
+        Usage();
+    }
+    *separator = '\0';
+    list[*count].symbol = argument;
+    list[*count].place = separator + 1;
+    (*count)++;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *registers = NULL;
+    unsigned long limit;
+    int option, i;
+
+    while ((option = getopt(argc, argv, "p:v:r:")) != -1)
+    {
+        switch (option)
+        {
+            case 'p':
+                AddPlacement(Placements, &PlacementCount, optarg);
+                break;
+            case 'v':
+                AddPlacement(Vectors, &VectorCount, optarg);
+                break;
+            case 'r':
+                registers = optarg;
+                break;
+            default:
+                Usage();
+        }
+    }
+    if (argc - optind != 2 || registers == NULL)
+    {
+        Usage();
+    }
+    ReadRegions(argv[optind]);
+    ReadRegisters(registers);
+    ReadObject(argv[optind + 1]);
+
+    PlaceFixed();
+    limit = PlaceDriverTable();
+    Reach(FindSymbol("main")->st_shndx);
+    for (i = 0; i < VectorCount; i++)
+    {
+        Reach(FindSymbol(Vectors[i].symbol)->st_shndx);
+    }
+    while (PendingCount > 0)
+    {
+        Follow(Pending[--PendingCount]);
+    }
+    PlaceCode(limit);
+    PlaceVariables();
+    Load();
+    SetVectors();
+    WriteTiTxt(stdout);
+    return 0;
+}
@@ -0,0 +1,414 @@
+/*
+ * linker.c
+ *
+ * Add payload modules to a sensor without rewriting what is installed there.
+ *
+ * Starts from the image installed on the sensor (the TI-TXT payload written last,
+ * or the merged image of the previous run of the linker), places every module in
+ * the first free blocks of the code area between PAYLOAD_CODE_ADDRESS and the
+ * dispatch table and relocates it there. The commands of the modules are merged
+ * into the dispatch table: entries of the sensor firmware and of code installed
+ * before are kept, a module providing a command which is already registered takes
+ * it over. The table grows downwards by one entry per new command.
+ *
+ * The output is a delta payload with just the blocks of the modules and the table
+ * blocks which changed, plus block 39 which the app requires in every payload. It
+ * only ever touches the code area, the table and block 39, so it keeps the rules
+ * the app checks before writing (see TITXTParser.kt). With -o the merged image is
+ * written as well, as the starting point for the next module.
+ *
+ * Usage: lazarus-module-linker [-o merged.txt] installed.txt module.txt... > delta.txt
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "module.h"
+#include "tag.h"
+
+//================================================================
+
+#define PAYLOAD_CODE_ADDRESS        0xFDA0      // as in payload.c
+#define SENSOR_TABLE_START          0xFFCE
+#define SENSOR_TABLE_KEY            0xABAB
+#define MAX_ENTRIES                 32
+#define MAX_MODULES                 8
+#define THERMOMETER_PROGRAM_KEY     0x8001      // Util.thermometerProgramKey of the app
+#define PROGRAM_KEY_OFFSET          4           // within block 39
+
+#define OFFSET(address)             ((address) - TAG_FRAM_START)
+#define BLOCK(address)              (OFFSET(address) / TAG_BLOCK_SIZE)
+
+static uint8_t Installed[TAG_BLOCKS * TAG_BLOCK_SIZE];
+static uint8_t InstalledWritten[TAG_BLOCKS];
+static uint8_t Image[TAG_BLOCKS * TAG_BLOCK_SIZE];
+static uint8_t Written[TAG_BLOCKS];
+static uint8_t Changed[TAG_BLOCKS];
+static Module Modules[MAX_MODULES];
+
+static struct
+{
+    uint16_t id;
+    uint16_t address;
+} Entries[MAX_ENTRIES];
+static int EntryCount;
+
+static void Fail(const char *message, const char *detail)
+{
+    fprintf(stderr, "lazarus-module-linker: %s%s%s\n", message, detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
+
+static uint16_t Load16(uint16_t address)
+{
+    return Image[OFFSET(address)] | (Image[OFFSET(address) + 1] << 8);
+}
+
+static void Store16(uint16_t address, uint16_t value)
+{
+    Image[OFFSET(address)] = value & 0xFF;
+    Image[OFFSET(address) + 1] = value >> 8;
+}
+
+/*  ReadTable                                                                          *
+ *  Function:  Collect the entries of the dispatch table of the installed image.       */
+static void ReadTable(void)
+{
+    uint16_t entry;
+
+    if (!Written[BLOCK(SENSOR_TABLE_START)] || Load16(SENSOR_TABLE_START) != SENSOR_TABLE_KEY)
+    {
+        Fail("the installed image has no dispatch table", NULL);
+    }
+    for (entry = SENSOR_TABLE_START - 2; Load16(entry) != SENSOR_TABLE_KEY; entry -= 4)
+    {
+        if (EntryCount == MAX_ENTRIES || !Written[BLOCK(entry - 2)])
+        {
+            Fail("the dispatch table of the installed image is not terminated", NULL);
+        }
+        Entries[EntryCount].id = Load16(entry);
+        Entries[EntryCount].address = Load16(entry - 2);
+        EntryCount++;
+    }
+}
+
+static int Registered(uint16_t id)
+{
+    int i;
+
+    for (i = 0; i < EntryCount; i++)
+    {
+        if (Entries[i].id == id)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*  Register                                                                           *
+ *  Function:  Point a command to a handler, taking over an existing entry.            */
+static void Register(uint16_t id, uint16_t address)
+{
+    int i;
+
+    for (i = 0; i < EntryCount; i++)
+    {
+        if (Entries[i].id == id)
+        {
+            fprintf(stderr, "lazarus-module-linker: command %02X moves from 0x%04X to 0x%04X\n",
+                    id, Entries[i].address, address);
+            Entries[i].address = address;
+            return;
+        }
+    }
+    if (EntryCount == MAX_ENTRIES)
+    {
+        Fail("too many commands", NULL);
+    }
+    Entries[EntryCount].id = id;
+    Entries[EntryCount].address = address;
+    EntryCount++;
+}
+
+/*  TableEnd                                                                           *
+ *  Function:  Address of the end key once the table has the given number of entries.  */
+static uint16_t TableEnd(int entries)
+{
+    return SENSOR_TABLE_START - 4 * entries - 2;
+}
+
+/*  Place                                                                              *
+ *  Function:  First fit of the module into free blocks of the code area, which ends   *
+ *             below the block holding the end key of the table.                       */
+static uint16_t Place(const Module *module, int limit)
+{
+    int blocks = (module->size + TAG_BLOCK_SIZE - 1) / TAG_BLOCK_SIZE;
+    int first, i;
+
+    for (first = BLOCK(PAYLOAD_CODE_ADDRESS); first + blocks <= limit; first++)
+    {
+        for (i = 0; i < blocks && !Written[first + i]; i++)
+        {
+        }
+        if (i == blocks)
+        {
+            return TAG_FRAM_START + first * TAG_BLOCK_SIZE;
+        }
+        first += i;
+    }
+    Fail("no room for the module in the code area", NULL);
+    return 0;
+}
+
+/*  ReadInstalled                                                                      *
+ *  Function:  Load the installed image, the format consists of "@address" lines       *
+ *             followed by hex bytes and is terminated by "q". The app checked the     *
+ *             layout before writing it, only the program key is checked here.         */
+static void ReadInstalled(const char *path)
+{
+    FILE *input = fopen(path, "r");
+    const uint8_t *key = &Image[TAG_PROGRAM_KEY_BLOCK * TAG_BLOCK_SIZE + PROGRAM_KEY_OFFSET];
+    char token[16];
+    long address = -1;
+
+    if (input == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    while (fscanf(input, "%15s", token) == 1)
+    {
+        char *end;
+        unsigned long value;
+
+        if (token[0] == 'q' && token[1] == '\0')
+        {
+            fclose(input);
+            if (!Written[TAG_PROGRAM_KEY_BLOCK] || (key[0] | (key[1] << 8)) != THERMOMETER_PROGRAM_KEY)
+            {
+                Fail(path, "payload has wrong program key");
+            }
+            return;
+        }
+        if (token[0] == '@')
+        {
+            address = strtoul(token + 1, &end, 16);
+            if (*end != '\0' || address < TAG_FRAM_START || address % TAG_BLOCK_SIZE != 0
+                || address >= TAG_FRAM_START + TAG_BLOCKS * TAG_BLOCK_SIZE)
+            {
+                Fail(path, "section is not a block of the FRAM");
+            }
+            continue;
+        }
+        value = strtoul(token, &end, 16);
+        if (*end != '\0' || strlen(token) != 2 || address < 0 || address >= TAG_FRAM_START + TAG_BLOCKS * TAG_BLOCK_SIZE)
+        {
+            Fail(path, "malformed byte");
+        }
+        Image[OFFSET(address)] = (uint8_t) value;
+        Written[BLOCK(address)] = 1;
+        address++;
+    }
+    Fail(path, "input was not correctly terminated");
+}
+
+/*  WriteBlocks                                                                        *
+ *  Function:  Write the selected blocks as TI-TXT, one section per run.               */
+static void WriteBlocks(FILE *output, const uint8_t *selected)
+{
+    int block = 0;
+    int sections = 0;
+    int i;
+
+    while (block < TAG_BLOCKS)
+    {
+        int end = block;
+
+        if (!selected[block])
+        {
+            block++;
+            continue;
+        }
+        while (end < TAG_BLOCKS && selected[end])
+        {
+            end++;
+        }
+        fprintf(output, "%s@%04x\n", sections++ ? "\n" : "", TAG_FRAM_START + block * TAG_BLOCK_SIZE);
+        for (i = 0; i < (end - block) * TAG_BLOCK_SIZE; i++)
+        {
+            fprintf(output, "%02X%c", Image[block * TAG_BLOCK_SIZE + i],
+                    (i % 16 == 15 || i + 1 == (end - block) * TAG_BLOCK_SIZE) ? '\n' : ' ');
+        }
+        block = end;
+    }
+    fprintf(output, "q\n");
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: lazarus-module-linker [-o merged.txt] installed.txt module.txt... > delta.txt\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *merged = NULL;
+    const char *error;
+    uint16_t added[MAX_ENTRIES];
+    int module_count, table_blocks, module_blocks, total;
+    int added_count = 0;
+    int limit;
+    uint16_t entry;
+    FILE *output;
+    int option, m, i;
+
+    while ((option = getopt(argc, argv, "o:")) != -1)
+    {
+        switch (option)
+        {
+            case 'o':
+                merged = optarg;
+                break;
+            default:
+                Usage();
+        }
+    }
+    module_count = argc - optind - 1;
+    if (module_count < 1 || module_count > MAX_MODULES)
+    {
+        Usage();
+    }
+
+    ReadInstalled(argv[optind]);
+    memcpy(Installed, Image, sizeof(Installed));
+    memcpy(InstalledWritten, Written, sizeof(InstalledWritten));
+    ReadTable();
+
+    for (m = 0; m < module_count; m++)
+    {
+        FILE *input = fopen(argv[optind + 1 + m], "r");
+
+        if (input == NULL)
+        {
+            perror(argv[optind + 1 + m]);
+            return 1;
+        }
+        if (module_read(input, &Modules[m], &error) < 0)
+        {
+            Fail(argv[optind + 1 + m], error);
+        }
+        fclose(input);
+    }
+
+    // the code area ends below the table as it will be once every module is registered
+    for (m = 0; m < module_count; m++)
+    {
+        for (i = 0; i < Modules[m].command_count; i++)
+        {
+            uint16_t id = Modules[m].command_ids[i];
+            int k;
+
+            for (k = 0; k < added_count && added[k] != id; k++)
+            {
+            }
+            if (k == added_count && !Registered(id))
+            {
+                if (EntryCount + added_count == MAX_ENTRIES)
+                {
+                    Fail("too many commands", NULL);
+                }
+                added[added_count++] = id;
+            }
+        }
+    }
+    limit = BLOCK(TableEnd(EntryCount + added_count));
+    for (i = limit; i < BLOCK(TableEnd(EntryCount)); i++)
+    {
+        if (Written[i])
+        {
+            Fail("the dispatch table would grow into installed code", NULL);
+        }
+    }
+
+    for (m = 0; m < module_count; m++)
+    {
+        Module *module = &Modules[m];
+        uint16_t address = Place(module, limit);
+        int blocks = (module->size + TAG_BLOCK_SIZE - 1) / TAG_BLOCK_SIZE;
+
+        module_relocate(module, address);
+        memset(&Image[OFFSET(address)], 0, blocks * TAG_BLOCK_SIZE);
+        memcpy(&Image[OFFSET(address)], module->code, module->size);
+        for (i = 0; i < blocks; i++)
+        {
+            Written[BLOCK(address) + i] = 1;
+            Changed[BLOCK(address) + i] = 1;
+        }
+        for (i = 0; i < module->command_count; i++)
+        {
+            Register(module->command_ids[i], address + module->command_offsets[i]);
+        }
+        fprintf(stderr, "lazarus-module-linker: %s at 0x%04X (%u bytes)\n", argv[optind + 1 + m],
+                address, module->size);
+    }
+
+    // rewrite the table and find the blocks which differ from the installed image
+    for (i = limit; i <= BLOCK(SENSOR_TABLE_START); i++)
+    {
+        if (!Written[i])
+        {
+            memset(&Image[i * TAG_BLOCK_SIZE], 0, TAG_BLOCK_SIZE);      // free code area, as padded by the payloads
+        }
+        Written[i] = 1;
+    }
+    entry = SENSOR_TABLE_START;
+    Store16(entry, SENSOR_TABLE_KEY);
+    for (i = 0; i < EntryCount; i++)
+    {
+        entry -= 4;
+        Store16(entry + 2, Entries[i].id);
+        Store16(entry, Entries[i].address);
+    }
+    Store16(entry - 2, SENSOR_TABLE_KEY);
+    table_blocks = 0;
+    for (i = limit; i <= BLOCK(SENSOR_TABLE_START); i++)
+    {
+        if (!InstalledWritten[i] || memcmp(&Image[i * TAG_BLOCK_SIZE], &Installed[i * TAG_BLOCK_SIZE], TAG_BLOCK_SIZE) != 0)
+        {
+            Changed[i] = 1;
+            table_blocks++;
+        }
+    }
+    Changed[TAG_PROGRAM_KEY_BLOCK] = 1;
+
+    module_blocks = 0;
+    total = 0;
+    for (i = 0; i < TAG_BLOCKS; i++)
+    {
+        module_blocks += Changed[i];
+        total += Written[i];
+    }
+    module_blocks -= table_blocks + 1;
+
+    WriteBlocks(stdout, Changed);
+
+    if (merged != NULL)
+    {
+        output = fopen(merged, "w");
+        if (output == NULL)
+        {
+            perror(merged);
+            return 1;
+        }
+        WriteBlocks(output, Written);
+        fclose(output);
+    }
+    fprintf(stderr, "lazarus-module-linker: %d module block(s), %d table block(s) and block 39 instead of %d blocks\n",
+            module_blocks, table_blocks, total);
+    return 0;
+}
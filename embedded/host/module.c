@@ -0,0 +1,143 @@
+/*
+ * module.c
+ *
+ * Reading and relocating payload modules, see module.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "module.h"
+
+//================================================================
+
+static int Fail(const char **error, const char *reason)
+{
+    *error = reason;
+    return -1;
+}
+
+static void Add16(uint8_t *p, uint16_t value)
+{
+    uint16_t word = (uint16_t) (p[0] | (p[1] << 8)) + value;
+
+    p[0] = word & 0xFF;
+    p[1] = word >> 8;
+}
+
+int module_read(FILE *input, Module *module, const char **error)
+{
+    char keyword[16];
+    unsigned first, second;
+    int have_size = 0;
+    unsigned length = 0;
+    int i;
+
+    memset(module, 0, sizeof(*module));
+    if (fscanf(input, "%15s", keyword) != 1 || strcmp(keyword, "module") != 0)
+    {
+        return Fail(error, "not a module");
+    }
+    while (fscanf(input, "%15s", keyword) == 1)
+    {
+        if (strcmp(keyword, "origin") == 0 && fscanf(input, "%x", &first) == 1 && first <= 0xFFFF)
+        {
+            module->origin = (uint16_t) first;
+        }
+        else if (strcmp(keyword, "size") == 0 && fscanf(input, "%x", &first) == 1 && first <= MODULE_MAX_SIZE)
+        {
+            module->size = (uint16_t) first;
+            have_size = 1;
+        }
+        else if (strcmp(keyword, "command") == 0 && fscanf(input, "%x %x", &first, &second) == 2)
+        {
+            if (module->command_count == MODULE_MAX_COMMANDS)
+            {
+                return Fail(error, "too many commands");
+            }
+            module->command_ids[module->command_count] = (uint16_t) first;
+            module->command_offsets[module->command_count++] = (uint16_t) second;
+        }
+        else if (strcmp(keyword, "absolute") == 0 && fscanf(input, "%x", &first) == 1)
+        {
+            if (module->absolute_count == MODULE_MAX_RELOCATIONS)
+            {
+                return Fail(error, "too many relocations");
+            }
+            module->absolute[module->absolute_count++] = (uint16_t) first;
+        }
+        else if (strcmp(keyword, "relative") == 0 && fscanf(input, "%x", &first) == 1)
+        {
+            if (module->relative_count == MODULE_MAX_RELOCATIONS)
+            {
+                return Fail(error, "too many relocations");
+            }
+            module->relative[module->relative_count++] = (uint16_t) first;
+        }
+        else if (strcmp(keyword, "code") == 0)
+        {
+            break;
+        }
+        else
+        {
+            return Fail(error, "malformed line");
+        }
+    }
+    if (!have_size)
+    {
+        return Fail(error, "size missing");
+    }
+    while (fscanf(input, "%15s", keyword) == 1 && strcmp(keyword, "end") != 0)
+    {
+        char *rest;
+        unsigned long value = strtoul(keyword, &rest, 16);
+
+        if (*rest != '\0' || strlen(keyword) != 2 || length == module->size)
+        {
+            return Fail(error, "malformed code");
+        }
+        module->code[length++] = (uint8_t) value;
+    }
+    if (length != module->size || strcmp(keyword, "end") != 0)
+    {
+        return Fail(error, "code does not match the size");
+    }
+    for (i = 0; i < module->command_count; i++)
+    {
+        if (module->command_offsets[i] >= module->size || module->command_offsets[i] & 1)
+        {
+            return Fail(error, "handler outside of the code");
+        }
+    }
+    for (i = 0; i < module->absolute_count; i++)
+    {
+        if (module->absolute[i] + 2 > module->size)
+        {
+            return Fail(error, "relocation outside of the code");
+        }
+    }
+    for (i = 0; i < module->relative_count; i++)
+    {
+        if (module->relative[i] + 2 > module->size)
+        {
+            return Fail(error, "relocation outside of the code");
+        }
+    }
+    return 0;
+}
+
+void module_relocate(Module *module, uint16_t address)
+{
+    uint16_t distance = address - module->origin;
+    int i;
+
+    for (i = 0; i < module->absolute_count; i++)
+    {
+        Add16(&module->code[module->absolute[i]], distance);
+    }
+    for (i = 0; i < module->relative_count; i++)
+    {
+        Add16(&module->code[module->relative[i]], (uint16_t) -distance);
+    }
+    module->origin = address;
+}
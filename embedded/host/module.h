@@ -0,0 +1,56 @@
+/*
+ * module.h
+ *
+ * Format of payload modules, code which the module linker can add to a sensor
+ * next to the code already installed there.
+ *
+ * A module is text, one item per line:
+ *
+ *   module
+ *   origin fda0            address the code was laid out for
+ *   size 002e              code bytes
+ *   command b3 0000        custom command ID and offset of its handler
+ *   absolute 0012          offset of a word holding an address within the code
+ *   relative 001a          offset of a PC relative word pointing outside the code
+ *   code
+ *   92 42 06 08 ...        the code as hex bytes
+ *   end
+ *
+ * When the code moves by some distance, absolute words move along with it and
+ * relative words move the opposite way, everything else is position independent.
+ * lazarus-payload-builder -m writes modules from the firmware.
+ */
+
+#ifndef MODULE_H_
+#define MODULE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+//================================================================
+
+#define MODULE_MAX_COMMANDS         16
+#define MODULE_MAX_RELOCATIONS      64
+#define MODULE_MAX_SIZE             0x400
+
+typedef struct
+{
+    uint16_t origin;
+    uint16_t size;
+    int command_count;
+    uint16_t command_ids[MODULE_MAX_COMMANDS];
+    uint16_t command_offsets[MODULE_MAX_COMMANDS];
+    int absolute_count;
+    uint16_t absolute[MODULE_MAX_RELOCATIONS];
+    int relative_count;
+    uint16_t relative[MODULE_MAX_RELOCATIONS];
+    uint8_t code[MODULE_MAX_SIZE];
+} Module;
+
+/* Returns 0 on success, otherwise -1 with the reason in error */
+int module_read(FILE *input, Module *module, const char **error);
+
+/* Move the code to the given address by applying the relocations */
+void module_relocate(Module *module, uint16_t address);
+
+#endif
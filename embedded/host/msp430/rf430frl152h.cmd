@@ -0,0 +1,52 @@
+/*
+ * rf430frl152h.cmd
+ *
+ * Addresses of the peripheral registers main.c uses, in the format of the peripheral
+ * memory map Code Composer Studio includes into the linker command file
+ * (-l rf430frl152h.cmd). Only the image linker reads it (make image, see image.c),
+ * the host build routes the registers through the mock of rf430frl152h.h.
+ *
+ * SD14CTL0, SD14CTL1, SD14MEM0 and RF13MTXF (with RF13MTXF_L) appear in the payload
+ * built with Code Composer Studio before the payload builder existed. The other
+ * addresses follow the register layout of the family user's guide and have not
+ * been compared with a map file of Code Composer Studio.
+ */
+
+/* Watchdog */
+WDTCTL             = 0x015C;
+
+/* Port 1 */
+P1DIR              = 0x0204;
+P1REN              = 0x0206;
+P1SEL0             = 0x020A;
+P1SEL1             = 0x020C;
+
+/* Clock system */
+CCSCTL0            = 0x0160;
+CCSCTL0_H          = 0x0161;
+CCSCTL1            = 0x0162;
+CCSCTL4            = 0x0168;
+CCSCTL5            = 0x016A;
+CCSCTL6            = 0x016C;
+CCSCTL8            = 0x0170;
+
+/* Timer0_A3 */
+TA0CTL             = 0x0340;
+TA0CCTL0           = 0x0342;
+TA0R               = 0x0350;
+TA0CCR0            = 0x0352;
+TA0EX0             = 0x0360;
+
+/* SD14 */
+SD14CTL0           = 0x0700;
+SD14CTL1           = 0x0702;
+SD14MEM0           = 0x0704;
+SD14IV             = 0x070C;
+
+/* RF13M */
+RF13MCTL           = 0x0800;
+RF13MINT           = 0x0802;
+RF13MRXF           = 0x0806;
+RF13MRXF_L         = 0x0806;
+RF13MTXF           = 0x0808;
+RF13MTXF_L         = 0x0808;
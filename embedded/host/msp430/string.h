@@ -0,0 +1,15 @@
+/*
+ * string.h
+ *
+ * The part of the C library header which main.c uses, for the freestanding
+ * MSP430 build of make size. The runtime support library provides memset.
+ */
+
+#ifndef HOST_MSP430_STRING_H_
+#define HOST_MSP430_STRING_H_
+
+typedef __SIZE_TYPE__ size_t;
+
+void *memset(void *s, int c, size_t n);
+
+#endif
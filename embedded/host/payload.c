@@ -0,0 +1,1009 @@
+/*
+ * payload.c
+ *
+ * Build the payload which reprograms a sensor from the TI-TXT output of the
+ * firmware build. This automates the steps described in doc/Image_creation.md:
+ *
+ *  - the handlers registered in the driver table of the firmware, together with
+ *    every function they call, are copied back to back to the code segment of the
+ *    payload (0xfda0 by default) and relocated to their new address,
+ *  - the custom command dispatch table of the sensor is rewritten with the
+ *    entries of the sensor firmware plus one entry per handler,
+ *  - block 39 receives the program key of the thermometer,
+ *  - every segment is padded to whole 8 byte blocks, nothing else is padded.
+ *
+ * The interrupt vectors stay with the sensor firmware, so handlers which rely on
+ * the interrupt service routines of the firmware image can not work as a payload.
+ * Every handler whose code shares a variable (RAM or FRAM data) with code reached
+ * from an interrupt vector of the image is left out with a warning, such commands
+ * only work on a fully flashed image.
+ *
+ * Additional areas of the firmware image can be deployed with -k. If they cover
+ * the header (blocks 0 to 2) its CRC is filled in, in either case the result is
+ * checked with the rules the app applies before writing a payload.
+ *
+ * Constant data the handlers read, like the temperature lookup table, is not at a
+ * usable place on a sensor. Areas given with -d are copied behind the code like a
+ * function and every operand pointing into them is adjusted, including the base
+ * of indexed operands.
+ *
+ * With -m the code is written as a module instead (see module.h), which the module
+ * linker can add to a sensor next to the code already installed there. Nothing
+ * besides the code, the data areas given with -d and the commands goes into a
+ * module.
+ *
+ * Relocation decodes the MSP430 instructions of each handler. Relative jumps,
+ * calls and branches to code, PC relative (symbolic) operands and immediate or
+ * absolute operands pointing into copied code or data are adjusted. Indirect
+ * branches and MSP430X instructions are rejected since their targets can not be
+ * followed.
+ *
+ * Usage: lazarus-payload-builder [-a address] [-c id:newid]... [-d start:end]...
+ *                                [-k start:end]... firmware.txt > payload.txt
+ *        lazarus-payload-builder -m [-c id:newid]... [-d start:end]... firmware.txt > module.txt
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "module.h"
+
+//================================================================
+
+#define MEMORY_SIZE                 0x10000
+#define FRAM_START                  0xF860      // block 0 as seen via NFC
+#define BLOCK_SIZE                  8
+#define HEADER_SIZE                 0x18        // blocks 0 to 2, protected by a CRC
+#define ROM_END                     0x8000
+#define RAM_START                   0x1C00
+#define RAM_END                     0x2000
+#define VECTOR_TABLE_START          0xFFE0      // INT00
+#define RESET_VECTOR                0xFFFE      // not an interrupt, main() is not deployed anyway
+
+#define PAYLOAD_CODE_ADDRESS        0xFDA0
+#define PROGRAM_KEY_BLOCK           39
+#define PROGRAM_KEY_OFFSET          4
+#define THERMOMETER_PROGRAM_KEY     0x8001
+
+#define FIRMWARE_TABLE_START        0xFFCE      // DRIVER_TABLE_START in main.c
+#define FIRMWARE_TABLE_KEY          0xCECE      // DRIVER_TABLE_KEY in main.c
+#define SENSOR_TABLE_START          0xFFCE      // same location in the sensor firmware
+#define SENSOR_TABLE_KEY            0xABAB
+
+#define MAX_FUNCTIONS               32
+#define MAX_HANDLERS                16
+#define MAX_SEGMENTS                8
+
+#define OPCODE_RET                  0x4130      // MOV @SP+, PC
+#define OPCODE_RETI                 0x1300
+#define OPCODE_CALL_IMMEDIATE       0x12B0      // CALL #address
+#define OPCODE_BR_IMMEDIATE         0x4030      // MOV #address, PC
+
+/* Entries of the dispatch table of the sensor firmware, they have to be kept */
+static const struct
+{
+    uint16_t id;
+    uint16_t address;
+} SensorCommands[] = {
+    { 0x00A0, 0x5724 },
+    { 0x00A1, 0xF9BA },
+    { 0x00A2, 0x5A56 },
+    { 0x00A3, 0xFBCA },
+    { 0x00A4, 0x5A2C },
+};
+
+enum operand_mode
+{
+    OPERAND_NONE,
+    OPERAND_IMMEDIATE,
+    OPERAND_ABSOLUTE,
+    OPERAND_SYMBOLIC,
+    OPERAND_INDEXED
+};
+
+typedef struct
+{
+    uint16_t length;                        // in bytes including extension words
+    enum operand_mode operands[2];          // kind of the extension words following the opcode
+    int jump;                               // relative jump, target in 'target'
+    int call;                               // CALL #target
+    int branch;                             // BR #target
+    int terminates;                         // execution does not continue behind it
+    int computed;                           // writes PC from a register (jump table)
+    uint16_t target;
+} Instruction;
+
+typedef struct
+{
+    uint16_t start;                         // address in the firmware image
+    uint16_t end;
+    uint16_t relocated;                     // address in the payload
+    int data;                               // an area given with -d, copied verbatim
+} Function;
+
+typedef struct
+{
+    uint16_t id;
+    uint16_t newId;
+} Mapping;
+
+typedef struct
+{
+    uint16_t start;
+    uint16_t length;
+} Segment;
+
+static uint8_t Image[MEMORY_SIZE];          // firmware as read from the TI-TXT file
+static uint8_t Defined[MEMORY_SIZE];
+static uint8_t Output[MEMORY_SIZE];         // payload under construction
+static Function Functions[MAX_FUNCTIONS];
+static int FunctionCount;
+static Segment Segments[MAX_SEGMENTS];
+static int SegmentCount;
+static Mapping Mappings[MAX_HANDLERS];
+static int MappingCount;
+static int ModuleMode;                      // -m, collect the relocations instead of fixing the position
+static uint16_t AbsoluteRelocations[MODULE_MAX_RELOCATIONS];
+static int AbsoluteCount;
+static uint16_t RelativeRelocations[MODULE_MAX_RELOCATIONS];
+static int RelativeCount;
+static uint8_t InterruptData[MEMORY_SIZE];  // variables used by the interrupt service routines
+
+static void Fail(const char *message, unsigned value)
+{
+    fprintf(stderr, "lazarus-payload-builder: ");
+    fprintf(stderr, message, value);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void Warn(const char *message, unsigned value)
+{
+    fprintf(stderr, "lazarus-payload-builder: warning: ");
+    fprintf(stderr, message, value);
+    fprintf(stderr, "\n");
+}
+
+static uint16_t Load16(const uint8_t *memory, uint32_t address)
+{
+    return memory[address & 0xFFFF] | ((uint16_t) memory[(address + 1) & 0xFFFF] << 8);
+}
+
+static void Store16(uint8_t *memory, uint32_t address, uint16_t value)
+{
+    memory[address & 0xFFFF] = value & 0xFF;
+    memory[(address + 1) & 0xFFFF] = value >> 8;
+}
+
+static uint16_t Fetch16(uint16_t address)
+{
+    if (!Defined[address] || !Defined[(address + 1) & 0xFFFF])
+    {
+        Fail("code at 0x%04X is not part of the firmware image", address);
+    }
+    return Load16(Image, address);
+}
+
+/*  ReadTiTxt                                                                          *
+ *  Function:  Load the firmware image, the format consists of "@address" lines        *
+ *             followed by hex bytes and is terminated by "q".                         */
+static void ReadTiTxt(FILE *input)
+{
+    char token[16];
+    long address = -1;
+
+    while (fscanf(input, "%15s", token) == 1)
+    {
+        char *end;
+        unsigned long value;
+
+        if (token[0] == 'q' && token[1] == '\0')
+        {
+            return;
+        }
+        if (token[0] == '@')
+        {
+            address = strtoul(token + 1, &end, 16);
+            if (*end != '\0' || address >= MEMORY_SIZE)
+            {
+                Fail("malformed address in firmware image", 0);
+            }
+            continue;
+        }
+        value = strtoul(token, &end, 16);
+        if (*end != '\0' || strlen(token) != 2 || address < 0 || address >= MEMORY_SIZE)
+        {
+            Fail("malformed byte in firmware image", 0);
+        }
+        Image[address] = (uint8_t) value;
+        Defined[address] = 1;
+        address++;
+    }
+    Fail("firmware image is not terminated by q", 0);
+}
+
+static enum operand_mode SourceMode(unsigned as, unsigned reg)
+{
+    if (as == 1 && reg != 3)
+    {
+        return reg == 0 ? OPERAND_SYMBOLIC : (reg == 2 ? OPERAND_ABSOLUTE : OPERAND_INDEXED);
+    }
+    if (as == 3 && reg == 0)
+    {
+        return OPERAND_IMMEDIATE;
+    }
+    return OPERAND_NONE;                    // register, indirect or constant generator
+}
+
+/*  Decode                                                                             *
+ *  Function:  Decode the instruction at the given address of the firmware image.     */
+static Instruction Decode(uint16_t address)
+{
+    uint16_t word = Fetch16(address);
+    Instruction instruction;
+    int i;
+
+    memset(&instruction, 0, sizeof(instruction));
+    instruction.length = 2;
+
+    if ((word & 0xE000) == 0x2000)
+    {
+        int offset = word & 0x03FF;
+
+        if (offset & 0x0200)
+        {
+            offset -= 0x0400;
+        }
+        instruction.jump = 1;
+        instruction.terminates = ((word >> 10) & 0x7) == 7;     // JMP
+        instruction.target = (uint16_t) (address + 2 + 2 * offset);
+        return instruction;
+    }
+    if (word >= 0x4000)
+    {
+        unsigned src = (word >> 8) & 0xF;
+        unsigned dst = word & 0xF;
+        unsigned ad = (word >> 7) & 0x1;
+
+        instruction.operands[0] = SourceMode((word >> 4) & 0x3, src);
+        if (ad)
+        {
+            instruction.operands[1] = dst == 0 ? OPERAND_SYMBOLIC : (dst == 2 ? OPERAND_ABSOLUTE : OPERAND_INDEXED);
+        }
+        if (word == OPCODE_RET)
+        {
+            instruction.terminates = 1;
+        }
+        else if (word == OPCODE_BR_IMMEDIATE)
+        {
+            instruction.branch = 1;
+            instruction.terminates = 1;
+            instruction.target = Fetch16(address + 2);
+        }
+        else if (dst == 0 && !ad && (word >> 12) != 0x9 && (word >> 12) != 0xB)
+        {
+            // anything else writing PC, CMP and BIT only read it
+            if ((word >> 12) == 0x5 && ((instruction.operands[0] == OPERAND_NONE && ((word >> 4) & 0x3) == 0)
+                    || instruction.operands[0] == OPERAND_ABSOLUTE))
+            {
+                instruction.computed = 1;       // ADD Rn, PC or ADD &IV, PC dispatching into a table of jumps
+            }
+            else
+            {
+                Fail("indirect branch at 0x%04X can not be relocated", address);
+            }
+        }
+    }
+    else if ((word & 0xFC00) == 0x1000 && ((word >> 7) & 0x7) != 7)
+    {
+        instruction.operands[0] = SourceMode((word >> 4) & 0x3, word & 0xF);
+        if (word == OPCODE_RETI)
+        {
+            instruction.terminates = 1;
+        }
+        else if (word == OPCODE_CALL_IMMEDIATE)
+        {
+            instruction.call = 1;
+            instruction.target = Fetch16(address + 2);
+        }
+        else if (((word >> 7) & 0x7) == 5 && (word & 0xF) != 0)
+        {
+            if (instruction.operands[0] != OPERAND_ABSOLUTE || Fetch16(address + 2) < ROM_END)
+            {
+                // calls through a pointer are only followed when it points to ROM code
+                Fail("indirect call at 0x%04X can not be relocated", address);
+            }
+        }
+    }
+    else
+    {
+        Fail("unsupported instruction at 0x%04X (MSP430X?)", address);
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        if (instruction.operands[i] != OPERAND_NONE)
+        {
+            instruction.length += 2;
+        }
+    }
+    return instruction;
+}
+
+static int IsFirmwareCode(uint16_t address)
+{
+    return address >= FRAM_START && Defined[address];
+}
+
+static int FindFunction(uint16_t address)
+{
+    int i;
+
+    for (i = 0; i < FunctionCount; i++)
+    {
+        if (address >= Functions[i].start && address < Functions[i].end)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int AddFunction(uint16_t start);
+
+/*  Follow                                                                             *
+ *  Function:  Make sure code reached from a function is copied as well.               */
+static void Follow(uint16_t target, uint16_t from)
+{
+    if (target < ROM_END)
+    {
+        return;                             // ROM routines stay where they are
+    }
+    if (!IsFirmwareCode(target))
+    {
+        Fail("branch at 0x%04X leaves the firmware image", from);
+    }
+    if (FindFunction(target) < 0)
+    {
+        AddFunction(target);
+    }
+}
+
+/*  AddFunction                                                                        *
+ *  Function:  Determine the extent of a function by a linear sweep. It ends at the    *
+ *             first RET, RETI or unconditional jump behind which no jump of the       *
+ *             function lands. Called functions are added recursively.                 */
+static int AddFunction(uint16_t start)
+{
+    uint16_t address = start;
+    uint16_t reach = start;
+    int index;
+
+    if (FunctionCount == MAX_FUNCTIONS)
+    {
+        Fail("too many functions (more than %u)", MAX_FUNCTIONS);
+    }
+    if (start & 1)
+    {
+        Fail("function at odd address 0x%04X", start);
+    }
+    index = FunctionCount++;
+    Functions[index].start = start;
+    Functions[index].end = 0xFFFF;          // claimed while sweeping to stop recursion
+
+    for (;;)
+    {
+        Instruction instruction = Decode(address);
+
+        if (instruction.jump && instruction.target > reach)
+        {
+            reach = instruction.target;
+        }
+        address += instruction.length;
+        if (instruction.computed && address + 2 > reach)
+        {
+            reach = address + 2;            // at least the first entry of the table
+        }
+        if (instruction.terminates && address > reach)
+        {
+            break;
+        }
+    }
+    Functions[index].end = address;
+
+    // now that the extent is known follow everything leaving it
+    for (address = start; address < Functions[index].end; )
+    {
+        Instruction instruction = Decode(address);
+
+        if (instruction.call || instruction.branch
+                || (instruction.jump && (instruction.target < start || instruction.target >= Functions[index].end)))
+        {
+            Follow(instruction.target, address);
+        }
+        address += instruction.length;
+    }
+    return index;
+}
+
+/*  Relocate                                                                           *
+ *  Function:  Translate an address of the firmware image into the payload, addresses  *
+ *             outside of copied code are kept.                                        */
+static uint16_t Relocate(uint16_t address)
+{
+    int index = FindFunction(address);
+
+    if (index < 0)
+    {
+        return address;
+    }
+    return Functions[index].relocated + (address - Functions[index].start);
+}
+
+/*  AddRelocation                                                                      *
+ *  Function:  Remember a word of the payload which depends on where the module ends   *
+ *             up, as an offset from the start of the code.                            */
+static void AddRelocation(uint16_t *relocations, int *count, uint16_t address)
+{
+    if (!ModuleMode)
+    {
+        return;
+    }
+    if (*count == MODULE_MAX_RELOCATIONS)
+    {
+        Fail("too many relocations (more than %u)", MODULE_MAX_RELOCATIONS);
+    }
+    relocations[(*count)++] = address - Functions[0].relocated;
+}
+
+/*  IsVariable                                                                         *
+ *  Function:  Whether an operand address refers to data of the firmware, peripheral   *
+ *             registers and code do not count.                                        */
+static int IsVariable(uint16_t address)
+{
+    if (address >= RAM_START && address < RAM_END)
+    {
+        return 1;
+    }
+    return address >= FRAM_START && address < FIRMWARE_TABLE_START - 0x40 && Defined[address]
+            && FindFunction(address) < 0;
+}
+
+/*  ScanVariables                                                                      *
+ *  Function:  Visit the variables used by the collected functions. They are marked in *
+ *             'mark' if given, the first one already set in 'check' is returned, zero *
+ *             if there is none.                                                       */
+static uint16_t ScanVariables(uint8_t *mark, const uint8_t *check)
+{
+    int index;
+
+    for (index = 0; index < FunctionCount; index++)
+    {
+        uint16_t address = Functions[index].start;
+
+        while (!Functions[index].data && address < Functions[index].end)
+        {
+            Instruction instruction = Decode(address);
+            uint16_t extension = address + 2;
+            int i;
+
+            for (i = 0; i < 2; i++)
+            {
+                uint16_t variable;
+
+                if (instruction.operands[i] == OPERAND_NONE)
+                {
+                    continue;
+                }
+                variable = Fetch16(extension);
+                if (instruction.operands[i] == OPERAND_SYMBOLIC)
+                {
+                    variable += extension;
+                }
+                extension += 2;
+                if (!IsVariable(variable))
+                {
+                    continue;
+                }
+                if (check && (check[variable] || check[(variable + 1) & 0xFFFF]))
+                {
+                    return variable;
+                }
+                if (mark)
+                {
+                    mark[variable] = mark[(variable + 1) & 0xFFFF] = 1;  // the word around it
+                }
+            }
+            address += instruction.length;
+        }
+    }
+    return 0;
+}
+
+static void CheckDataReference(uint16_t address, uint16_t from)
+{
+    if (address >= FRAM_START && Defined[address] && FindFunction(address) < 0 && address < FIRMWARE_TABLE_START - 0x40)
+    {
+        Warn("code at 0x%04X uses FRAM data of the firmware image which is not deployed", from);
+    }
+}
+
+/*  CopyFunction                                                                       *
+ *  Function:  Copy a function to its place in the payload and adjust everything which *
+ *             depends on its position.                                                */
+static void CopyFunction(const Function *function)
+{
+    uint16_t address = function->start;
+
+    memcpy(&Output[function->relocated], &Image[function->start], function->end - function->start);
+    while (!function->data && address < function->end)
+    {
+        Instruction instruction = Decode(address);
+        uint16_t relocated = Relocate(address);
+        uint16_t extension = address + 2;
+        int i;
+
+        if (instruction.jump)
+        {
+            int offset = ((int) Relocate(instruction.target) - (int) relocated - 2) / 2;
+
+            if (offset < -512 || offset > 511)
+            {
+                Fail("relocated jump at 0x%04X is out of range", address);
+            }
+            if (ModuleMode && FindFunction(instruction.target) < 0)
+            {
+                Fail("jump at 0x%04X leaves the module", address);
+            }
+            Store16(Output, relocated, (Fetch16(address) & 0xFC00) | (offset & 0x03FF));
+        }
+        for (i = 0; i < 2; i++)
+        {
+            uint16_t value;
+
+            if (instruction.operands[i] == OPERAND_NONE)
+            {
+                continue;
+            }
+            value = Fetch16(extension);
+            switch (instruction.operands[i])
+            {
+                case OPERAND_IMMEDIATE:
+                case OPERAND_ABSOLUTE:
+                    if (instruction.operands[i] == OPERAND_ABSOLUTE)
+                    {
+                        CheckDataReference(value, address);
+                    }
+                    Store16(Output, Relocate(extension), Relocate(value));
+                    if (FindFunction(value) >= 0)
+                    {
+                        AddRelocation(AbsoluteRelocations, &AbsoluteCount, Relocate(extension));
+                    }
+                    break;
+                case OPERAND_SYMBOLIC:
+                {
+                    uint16_t target = extension + value;
+
+                    CheckDataReference(target, address);
+                    Store16(Output, Relocate(extension), Relocate(target) - Relocate(extension));
+                    if (FindFunction(target) < 0)
+                    {
+                        AddRelocation(RelativeRelocations, &RelativeCount, Relocate(extension));
+                    }
+                    break;
+                }
+                case OPERAND_INDEXED:
+                {
+                    int index = FindFunction(value);
+
+                    // only the base of a table is an address, small offsets are not
+                    if (index >= 0 && Functions[index].data)
+                    {
+                        Store16(Output, Relocate(extension), Relocate(value));
+                        AddRelocation(AbsoluteRelocations, &AbsoluteCount, Relocate(extension));
+                    }
+                    else
+                    {
+                        CheckDataReference(value, address);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+            extension += 2;
+        }
+        address += instruction.length;
+    }
+}
+
+/*  AddData                                                                            *
+ *  Function:  Take an area of constant data of the firmware image along with the      *
+ *             code, it is laid out behind the functions collected so far.             */
+static void AddData(uint16_t start, uint16_t end)
+{
+    uint16_t address;
+
+    if (FunctionCount == MAX_FUNCTIONS)
+    {
+        Fail("too many functions (more than %u)", MAX_FUNCTIONS);
+    }
+    if ((start | end) & 1)
+    {
+        Fail("data area at 0x%04X is not word aligned", start);
+    }
+    for (address = start; address < end; address++)
+    {
+        if (!Defined[address] || FindFunction(address) >= 0)
+        {
+            Fail("data area contains 0x%04X which is code or not part of the firmware image", address);
+        }
+    }
+    Functions[FunctionCount].start = start;
+    Functions[FunctionCount].end = end;
+    Functions[FunctionCount].data = 1;
+    FunctionCount++;
+}
+
+static void AddSegment(uint16_t start, uint16_t end)
+{
+    int i;
+
+    start &= ~(BLOCK_SIZE - 1);
+    end = (end + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+    for (i = 0; i < SegmentCount; i++)
+    {
+        if (start < Segments[i].start + Segments[i].length && Segments[i].start < end)
+        {
+            Fail("segment at 0x%04X overlaps another one", start);
+        }
+    }
+    if (SegmentCount == MAX_SEGMENTS)
+    {
+        Fail("too many segments (more than %u)", MAX_SEGMENTS);
+    }
+    Segments[SegmentCount].start = start;
+    Segments[SegmentCount].length = end - start;
+    SegmentCount++;
+}
+
+/*  Checksum                                                                           *
+ *  Function:  CRC-16/MCRF4XX with the bits of the result reversed as the sensor       *
+ *             firmware expects it, see CRC.kt of the app.                             */
+static uint16_t Checksum(const uint8_t *data, unsigned length)
+{
+    uint16_t crc = 0xFFFF;
+    uint16_t reversed = 0;
+    unsigned i, bit;
+
+    for (i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+        }
+    }
+    for (bit = 0; bit < 16; bit++)
+    {
+        reversed = (reversed << 1) | (crc & 1);
+        crc >>= 1;
+    }
+    return reversed;
+}
+
+/*  CheckPayload                                                                       *
+ *  Function:  Apply the checks of DeliveryPlan in the app, so a payload which builds  *
+ *             is also accepted for writing.                                           */
+static void CheckPayload(void)
+{
+    uint16_t keyAddress = FRAM_START + PROGRAM_KEY_BLOCK * BLOCK_SIZE + PROGRAM_KEY_OFFSET;
+    int keyFound = 0;
+    int i;
+
+    for (i = 0; i < SegmentCount; i++)
+    {
+        uint16_t start = Segments[i].start;
+        uint32_t end = (uint32_t) start + Segments[i].length;
+
+        if (start < FRAM_START)
+        {
+            Fail("segment at 0x%04X is outside of the sensor memory", start);
+        }
+        if (start < FRAM_START + HEADER_SIZE && (start != FRAM_START || end < FRAM_START + HEADER_SIZE))
+        {
+            Fail("segment at 0x%04X must contain all or none of the header", start);
+        }
+        if (start == FRAM_START && Load16(Output, FRAM_START) != Checksum(&Output[FRAM_START + 2], HEADER_SIZE - 2))
+        {
+            Fail("header fails checksum", 0);
+        }
+        if (keyAddress >= start && keyAddress < end)
+        {
+            keyFound = Load16(Output, keyAddress) == THERMOMETER_PROGRAM_KEY;
+        }
+    }
+    if (!keyFound)
+    {
+        Fail("payload lacks the program key", 0);
+    }
+}
+
+static void WriteTiTxt(FILE *output)
+{
+    int i, j;
+
+    for (i = 0; i < SegmentCount; i++)
+    {
+        fprintf(output, "%s@%04x\n", i ? "\n" : "", Segments[i].start);
+        for (j = 0; j < Segments[i].length; j++)
+        {
+            fprintf(output, "%02X%c", Output[Segments[i].start + j], (j % 16 == 15 || j + 1 == Segments[i].length) ? '\n' : ' ');
+        }
+    }
+    fprintf(output, "q\n");
+}
+
+/*  WriteModule                                                                        *
+ *  Function:  Write the code laid out from the given address in the module format.    */
+static void WriteModule(FILE *output, uint16_t start, uint16_t end, const uint16_t *ids,
+                        const uint16_t *handlers, int count)
+{
+    int i;
+
+    fprintf(output, "module\norigin %04x\nsize %04x\n", start, end - start);
+    for (i = 0; i < count; i++)
+    {
+        fprintf(output, "command %04x %04x\n", ids[i], Relocate(handlers[i]) - start);
+    }
+    for (i = 0; i < AbsoluteCount; i++)
+    {
+        fprintf(output, "absolute %04x\n", AbsoluteRelocations[i]);
+    }
+    for (i = 0; i < RelativeCount; i++)
+    {
+        fprintf(output, "relative %04x\n", RelativeRelocations[i]);
+    }
+    fprintf(output, "code\n");
+    for (i = 0; i < end - start; i++)
+    {
+        fprintf(output, "%02X%c", Output[start + i], (i % 16 == 15 || i + 1 == end - start) ? '\n' : ' ');
+    }
+    fprintf(output, "end\n");
+}
+
+static uint16_t MapId(uint16_t id)
+{
+    int i;
+
+    for (i = 0; i < MappingCount; i++)
+    {
+        if (Mappings[i].id == id)
+        {
+            return Mappings[i].newId;
+        }
+    }
+    return id;
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: lazarus-payload-builder [-a address] [-c id:newid]... [-d start:end]... [-k start:end]...\n"
+                    "                               firmware.txt\n"
+                    "       lazarus-payload-builder -m [-c id:newid]... [-d start:end]... firmware.txt\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long codeAddress = PAYLOAD_CODE_ADDRESS;
+    unsigned long keep[MAX_SEGMENTS][2];
+    int keepCount = 0;
+    unsigned long data[MAX_SEGMENTS][2];
+    int dataCount = 0;
+    uint16_t handlerIds[MAX_HANDLERS];
+    uint16_t handlers[MAX_HANDLERS];
+    int handlerCount = 0;
+    int registered = 0;
+    uint16_t entry, address, tableStart, codeEnd;
+    FILE *input;
+    int option, i;
+
+    while ((option = getopt(argc, argv, "a:c:d:k:m")) != -1)
+    {
+        unsigned long first, second;
+
+        switch (option)
+        {
+            case 'a':
+                codeAddress = strtoul(optarg, NULL, 16);
+                break;
+            case 'c':
+                if (sscanf(optarg, "%lx:%lx", &first, &second) != 2 || MappingCount == MAX_HANDLERS)
+                {
+                    Usage();
+                }
+                Mappings[MappingCount].id = (uint16_t) first;
+                Mappings[MappingCount].newId = (uint16_t) second;
+                MappingCount++;
+                break;
+            case 'd':
+                if (sscanf(optarg, "%lx:%lx", &first, &second) != 2 || first >= second || second > MEMORY_SIZE
+                        || dataCount == MAX_SEGMENTS)
+                {
+                    Usage();
+                }
+                data[dataCount][0] = first;
+                data[dataCount][1] = second;
+                dataCount++;
+                break;
+            case 'k':
+                if (sscanf(optarg, "%lx:%lx", &first, &second) != 2 || first >= second || second > MEMORY_SIZE
+                        || keepCount == MAX_SEGMENTS)
+                {
+                    Usage();
+                }
+                keep[keepCount][0] = first;
+                keep[keepCount][1] = second;
+                keepCount++;
+                break;
+            case 'm':
+                ModuleMode = 1;
+                break;
+            default:
+                Usage();
+        }
+    }
+    if (optind + 1 != argc || codeAddress % BLOCK_SIZE != 0 || (ModuleMode && keepCount != 0))
+    {
+        Usage();
+    }
+    input = fopen(argv[optind], "r");
+    if (!input)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    ReadTiTxt(input);
+    fclose(input);
+
+    // variables of the interrupt service routines, which are not deployed
+    for (address = VECTOR_TABLE_START; address < RESET_VECTOR; address += 2)
+    {
+        uint16_t isr = Load16(Image, address);
+
+        if (Defined[address] && isr >= ROM_END && IsFirmwareCode(isr) && FindFunction(isr) < 0)
+        {
+            AddFunction(isr);
+        }
+    }
+    ScanVariables(InterruptData, NULL);
+
+    // collect the handlers from the driver table of the firmware
+    if (Load16(Image, FIRMWARE_TABLE_START) != FIRMWARE_TABLE_KEY)
+    {
+        Fail("no driver table at 0x%04X", FIRMWARE_TABLE_START);
+    }
+    for (entry = FIRMWARE_TABLE_START - 2; Load16(Image, entry) != FIRMWARE_TABLE_KEY; entry -= 4)
+    {
+        uint16_t id = Load16(Image, entry);
+        uint16_t variable;
+
+        if (registered++ == MAX_HANDLERS || !Defined[entry])
+        {
+            Fail("driver table ending at 0x%04X is not terminated", entry);
+        }
+        FunctionCount = 0;
+        AddFunction(Load16(Image, entry - 2));
+        variable = ScanVariables(NULL, InterruptData);
+        if (variable)
+        {
+            Warn("command %02X shares data with an interrupt service routine and only works on a fully flashed image, left out", id);
+            Warn("shared variable at 0x%04X", variable);
+            continue;
+        }
+        handlerIds[handlerCount] = MapId(id);
+        handlers[handlerCount] = Load16(Image, entry - 2);
+        handlerCount++;
+    }
+    if (handlerCount == 0)
+    {
+        Fail("no handler can be deployed", 0);
+    }
+    FunctionCount = 0;
+    for (i = 0; i < handlerCount; i++)
+    {
+        if (FindFunction(handlers[i]) < 0)
+        {
+            AddFunction(handlers[i]);
+        }
+    }
+    for (i = 0; i < dataCount; i++)
+    {
+        AddData((uint16_t) data[i][0], (uint16_t) data[i][1]);
+    }
+
+    // lay out the code, each function only needs word alignment
+    address = (uint16_t) codeAddress;
+    for (i = 0; i < FunctionCount; i++)
+    {
+        Functions[i].relocated = address;
+        address += Functions[i].end - Functions[i].start;
+    }
+    tableStart = SENSOR_TABLE_START - 4 * (handlerCount + sizeof(SensorCommands) / sizeof(SensorCommands[0])) - 2;
+    if (address > (tableStart & ~(BLOCK_SIZE - 1)))
+    {
+        Fail("code does not fit below the dispatch table (ends at 0x%04X)", address);
+    }
+    for (i = 0; i < FunctionCount; i++)
+    {
+        CopyFunction(&Functions[i]);
+    }
+    codeEnd = address;
+    if (ModuleMode)
+    {
+        WriteModule(stdout, (uint16_t) codeAddress, codeEnd, handlerIds, handlers, handlerCount);
+        fprintf(stderr, "lazarus-payload-builder: module with %d handler(s), %d function(s), %u bytes of code and data\n",
+                handlerCount, FunctionCount - dataCount, (unsigned) (codeEnd - codeAddress));
+        return 0;
+    }
+    AddSegment((uint16_t) codeAddress, codeEnd);
+
+    // the dispatch table grows downwards from SENSOR_TABLE_START
+    entry = SENSOR_TABLE_START;
+    Store16(Output, entry, SENSOR_TABLE_KEY);
+    for (i = 0; i < (int) (sizeof(SensorCommands) / sizeof(SensorCommands[0])); i++)
+    {
+        entry -= 4;
+        Store16(Output, entry + 2, SensorCommands[i].id);
+        Store16(Output, entry, SensorCommands[i].address);
+    }
+    for (i = 0; i < handlerCount; i++)
+    {
+        entry -= 4;
+        Store16(Output, entry + 2, handlerIds[i]);
+        Store16(Output, entry, Relocate(handlers[i]));
+    }
+    Store16(Output, entry - 2, SENSOR_TABLE_KEY);
+    AddSegment(entry - 2, SENSOR_TABLE_START + 2);
+
+    // program key in block 39
+    address = FRAM_START + PROGRAM_KEY_BLOCK * BLOCK_SIZE;
+    Store16(Output, address + PROGRAM_KEY_OFFSET, THERMOMETER_PROGRAM_KEY);
+    AddSegment(address, address + BLOCK_SIZE);
+
+    // areas taken over from the firmware image
+    for (i = 0; i < keepCount; i++)
+    {
+        AddSegment((uint16_t) keep[i][0], (uint16_t) keep[i][1]);
+        memcpy(&Output[keep[i][0] & ~(BLOCK_SIZE - 1)], &Image[keep[i][0] & ~(BLOCK_SIZE - 1)],
+               Segments[SegmentCount - 1].length);
+        if (Segments[SegmentCount - 1].start == FRAM_START)
+        {
+            Store16(Output, FRAM_START, Checksum(&Output[FRAM_START + 2], HEADER_SIZE - 2));
+        }
+    }
+
+    // ascending order as in the hand made payloads
+    for (i = 1; i < SegmentCount; i++)
+    {
+        Segment segment = Segments[i];
+        int j = i;
+
+        for (; j > 0 && Segments[j - 1].start > segment.start; j--)
+        {
+            Segments[j] = Segments[j - 1];
+        }
+        Segments[j] = segment;
+    }
+    CheckPayload();
+    WriteTiTxt(stdout);
+    fprintf(stderr, "lazarus-payload-builder: %d handler(s), %d function(s), %u bytes of code and data\n",
+            handlerCount, FunctionCount - dataCount, (unsigned) (codeEnd - codeAddress));
+    return 0;
+}
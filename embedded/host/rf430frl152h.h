@@ -0,0 +1,264 @@
+/*
+ * rf430frl152h.h
+ *
+ * Register mock of the RF430FRL152H for building the firmware on a Linux host.
+ *
+ * This stands in for the device header of Code Composer Studio. Every peripheral
+ * register is routed through an accessor so the mock in host.c sees each access,
+ * can apply the side effects of the hardware (starting conversions, the RF FIFOs,
+ * the timer) and can count the accesses.
+ *
+ * Bit values which show up in the compiled thermometer payload (SD14EN, VIRTGND,
+ * SD14SC and the 0xD04x settings of SD14CTL1) match the device, the remaining ones
+ * only need to be distinct for the mock.
+ *
+ * Compiled for the MSP430 (make size, see size.c) it declares the registers as the
+ * device header does and maps the intrinsics to instructions of the same length.
+ * That build is only measured, never run.
+ */
+
+#ifndef HOST_RF430FRL152H_H_
+#define HOST_RF430FRL152H_H_
+
+//================================================================
+
+#ifndef __MSP430__
+
+enum host_register
+{
+    HOST_WDTCTL,
+    HOST_P1SEL0,
+    HOST_P1SEL1,
+    HOST_P1DIR,
+    HOST_P1REN,
+    HOST_CCSCTL0,
+    HOST_CCSCTL1,
+    HOST_CCSCTL4,
+    HOST_CCSCTL5,
+    HOST_CCSCTL6,
+    HOST_CCSCTL8,
+    HOST_SD14CTL0,
+    HOST_SD14CTL1,
+    HOST_SD14MEM0,
+    HOST_SD14IV,
+    HOST_RF13MCTL,
+    HOST_RF13MINT,
+    HOST_RF13MRXF,
+    HOST_RF13MTXF,
+    HOST_TA0CTL,
+    HOST_TA0CCTL0,
+    HOST_TA0R,
+    HOST_TA0CCR0,
+    HOST_TA0EX0,
+    HOST_REGISTER_COUNT
+};
+
+unsigned short *host_register16(enum host_register reg);
+unsigned char *host_register8(enum host_register reg, int high);
+
+void host_rom_call(const char *code);
+void host_bis_sr(unsigned short bits);
+void host_bic_sr_on_exit(unsigned short bits);
+void host_disable_interrupt(void);
+void host_delay_cycles(unsigned long cycles);
+
+extern unsigned char host_memory[0x10000];
+
+//===============================================================
+// Registers
+//===============================================================
+
+#define WDTCTL          (*host_register16(HOST_WDTCTL))
+#define P1SEL0          (*host_register8(HOST_P1SEL0, 0))
+#define P1SEL1          (*host_register8(HOST_P1SEL1, 0))
+#define P1DIR           (*host_register8(HOST_P1DIR, 0))
+#define P1REN           (*host_register8(HOST_P1REN, 0))
+#define CCSCTL0         (*host_register16(HOST_CCSCTL0))
+#define CCSCTL0_H       (*host_register8(HOST_CCSCTL0, 1))
+#define CCSCTL1         (*host_register16(HOST_CCSCTL1))
+#define CCSCTL4         (*host_register16(HOST_CCSCTL4))
+#define CCSCTL5         (*host_register16(HOST_CCSCTL5))
+#define CCSCTL6         (*host_register16(HOST_CCSCTL6))
+#define CCSCTL8         (*host_register16(HOST_CCSCTL8))
+#define SD14CTL0        (*host_register16(HOST_SD14CTL0))
+#define SD14CTL1        (*host_register16(HOST_SD14CTL1))
+#define SD14MEM0        (*host_register16(HOST_SD14MEM0))
+#define SD14IV          (*host_register16(HOST_SD14IV))
+#define RF13MCTL        (*host_register16(HOST_RF13MCTL))
+#define RF13MINT        (*host_register16(HOST_RF13MINT))
+#define RF13MRXF        (*host_register16(HOST_RF13MRXF))
+#define RF13MRXF_L      (*host_register8(HOST_RF13MRXF, 0))
+#define RF13MTXF        (*host_register16(HOST_RF13MTXF))
+#define RF13MTXF_L      (*host_register8(HOST_RF13MTXF, 0))
+#define TA0CTL          (*host_register16(HOST_TA0CTL))
+#define TA0CCTL0        (*host_register16(HOST_TA0CCTL0))
+#define TA0R            (*host_register16(HOST_TA0R))
+#define TA0CCR0         (*host_register16(HOST_TA0CCR0))
+#define TA0EX0          (*host_register16(HOST_TA0EX0))
+
+#else
+
+//===============================================================
+// Registers, addresses come from the linker command file of the device
+//===============================================================
+
+extern volatile unsigned int WDTCTL;
+extern volatile unsigned char P1SEL0;
+extern volatile unsigned char P1SEL1;
+extern volatile unsigned char P1DIR;
+extern volatile unsigned char P1REN;
+extern volatile unsigned int CCSCTL0;
+extern volatile unsigned char CCSCTL0_H;
+extern volatile unsigned int CCSCTL1;
+extern volatile unsigned int CCSCTL4;
+extern volatile unsigned int CCSCTL5;
+extern volatile unsigned int CCSCTL6;
+extern volatile unsigned int CCSCTL8;
+extern volatile unsigned int SD14CTL0;
+extern volatile unsigned int SD14CTL1;
+extern volatile unsigned int SD14MEM0;
+extern volatile unsigned int SD14IV;
+extern volatile unsigned int RF13MCTL;
+extern volatile unsigned int RF13MINT;
+extern volatile unsigned int RF13MRXF;
+extern volatile unsigned char RF13MRXF_L;
+extern volatile unsigned int RF13MTXF;
+extern volatile unsigned char RF13MTXF_L;
+extern volatile unsigned int TA0CTL;
+extern volatile unsigned int TA0CCTL0;
+extern volatile unsigned int TA0R;
+extern volatile unsigned int TA0CCR0;
+extern volatile unsigned int TA0EX0;
+
+#endif
+
+//===============================================================
+// Bits
+//===============================================================
+
+#define BIT0            (0x0001)
+#define BIT1            (0x0002)
+#define BIT2            (0x0004)
+#define BIT3            (0x0008)
+#define BIT4            (0x0010)
+#define BIT5            (0x0020)
+#define BIT6            (0x0040)
+#define BIT7            (0x0080)
+#define BIT8            (0x0100)
+#define BIT9            (0x0200)
+#define BITA            (0x0400)
+#define BITB            (0x0800)
+#define BITC            (0x1000)
+#define BITD            (0x2000)
+#define BITE            (0x4000)
+#define BITF            (0x8000)
+
+#define GIE             (0x0008)
+#define CPUOFF          (0x0010)
+#define OSCOFF          (0x0020)
+#define SCG0            (0x0040)
+#define SCG1            (0x0080)
+#define LPM0_bits       (CPUOFF)
+#define LPM3_bits       (SCG1 + SCG0 + CPUOFF)
+#define LPM4_bits       (SCG1 + SCG0 + OSCOFF + CPUOFF)
+
+#define WDTPW           (0x5A00)
+#define WDTHOLD         (0x0080)
+
+#define CCSKEY          (0xA500)
+#define SELA_1          (0x0100)
+#define SELM_0          (0x0000)
+#define SELS_0          (0x0000)
+#define DIVA_2          (0x0200)
+#define DIVM_1          (0x0001)
+#define DIVS_1          (0x0010)
+#define XTOFF           (0x0001)
+#define ACLKREQEN       (0x0001)
+#define MCLKREQEN       (0x0002)
+#define SMCLKREQEN      (0x0004)
+
+/* SD14CTL0 */
+#define SD14EN          (0x0001)
+#define SD14SGL         (0x0002)
+#define SD14IE          (0x0004)
+#define SD14SC          (0x0008)
+#define SD14IFG         (0x0010)
+#define SD14OVIFG       (0x0020)
+#define SD14DIV0        (0x0100)
+#define SD14DIV1        (0x0200)
+#define VIRTGND         (0x1000)
+
+/* SD14CTL1 */
+#define SD14INCH_MASK   (0x0007)
+#define SD14GAIN0       (0x0008)
+#define SD14INTDLY0     (0x0040)
+#define SD14UNI         (0x1000)
+#define SD14RBEN0       (0x4000)
+#define SD14RBEN1       (0x8000)
+
+/* SD14IV */
+#define SD14IV__NONE    (0x0000)
+#define SD14IV__OV      (0x0002)
+#define SD14IV__RES     (0x0004)
+
+#define RF13MRXEN       (0x0001)
+#define RF13MTXEN       (0x0002)
+#define RF13MRFTOEN     (0x0004)
+#define RF13MRXIE       (0x0001)
+#define RX13MRFTOIE     (0x0002)
+
+/* Timer0_A */
+#define TACLR           (0x0004)
+#define TAIE            (0x0002)
+#define TAIFG           (0x0001)
+#define MC_0            (0x0000)
+#define MC_1            (0x0010)
+#define MC_2            (0x0020)
+#define MC__MASK        (0x0030)
+#define ID_0            (0x0000)
+#define ID_1            (0x0040)
+#define ID_2            (0x0080)
+#define ID_3            (0x00C0)
+#define ID__MASK        (0x00C0)
+#define TASSEL_1        (0x0100)
+#define TASSEL_2        (0x0200)
+#define CCIE            (0x0010)
+#define CCIFG           (0x0001)
+#define TAIDEX_0        (0x0000)
+#define TAIDEX_7        (0x0007)
+
+//===============================================================
+// Intrinsics and compiler extensions
+//===============================================================
+
+#ifndef __MSP430__
+
+#define interrupt
+#define __interrupt
+#define asm(code)                       host_rom_call(code)
+#define __even_in_range(value, bound)   (value)
+#define __delay_cycles(cycles)          host_delay_cycles(cycles)
+#define __bis_SR_register(bits)         host_bis_sr(bits)
+#define __bic_SR_register_on_exit(bits) host_bic_sr_on_exit(bits)
+#define __disable_interrupt()           host_disable_interrupt()
+#define __no_operation()                ((void) 0)
+
+#define FRAM_POINTER(address)           (&host_memory[(address) & 0xFFFF])
+
+#else
+
+/* #pragma vector is ignored, all service routines share one vector */
+#define interrupt                       __attribute__((interrupt(7)))
+#define __interrupt                     interrupt
+#define __even_in_range(value, bound)   (value)
+#define __bis_SR_register(bits)         __asm__ volatile ("bis.w %0, r2" : : "i" (bits))
+#define __bic_SR_register_on_exit(bits) __asm__ volatile ("bic.w %0, 0(r1)" : : "i" (bits))
+#define __disable_interrupt()           __asm__ volatile ("dint { nop")
+#define __no_operation()                __asm__ volatile ("nop")
+/* dec and jnz take 3 cycles, as the loop the TI compiler emits; up to 3 * 0xFFFF cycles */
+#define __delay_cycles(cycles)          __asm__ volatile ("mov.w %0, r15\n1: dec.w r15\n jnz 1b" \
+                                                          : : "i" ((cycles) / 3) : "r15")
+
+#endif
+
+#endif
@@ -0,0 +1,433 @@
+/*
+ * size.c
+ *
+ * Check that the fully flashed firmware fits into FRAM_CODE of the linker command
+ * file, without Code Composer Studio.
+ *
+ * Reads main.c compiled for the MSP430 into a relocatable ELF object with one
+ * section per function and object (make size), follows the relocations from main,
+ * the interrupt vectors and the driver table, and adds up what the image keeps:
+ * the code and constants reached, the driver table (4 bytes per command plus the
+ * two keys) and the initial values of variables (.cinit of the TI linker). Objects
+ * placed outside of FRAM_CODE with #pragma location or CODE_SECTION are left out
+ * with -x. Undefined functions which are called belong to the runtime support
+ * library and are listed but not counted, the free space has to hold them along
+ * with the startup code; the other undefined symbols are peripheral registers.
+ *
+ * The figures come from another compiler than the one building the image, they
+ * are an estimate for comparing firmware changes. The map file of Code Composer
+ * Studio has the exact ones.
+ *
+ * Usage: lazarus-size-report [-x symbol]... lnk_rf430frl152h_Lazarus.cmd firmware.o
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//================================================================
+
+#define MAX_EXCLUDED                32
+#define MAX_RUNTIME                 32
+#define DRIVER_TABLE_KEYS           4           // START_KEY and END_KEY
+#define DRIVER_TABLE_ENTRY          4           // command ID and address
+#define MSP430_CALL_IMMEDIATE       0x12B0      // call #address
+#define MSP430_BRANCH_IMMEDIATE     0x4030      // br #address, a tail call
+
+static uint8_t *Object;
+static size_t ObjectSize;
+static const Elf32_Shdr *Sections;
+static int SectionCount;
+static const Elf32_Sym *Symbols;
+static int SymbolCount;
+static const char *SymbolNames;
+static const char *SectionNames;
+
+static uint8_t *Reached;
+static uint8_t *Excluded;
+static int *Pending;
+static int PendingCount;
+
+static const char *ExcludedNames[MAX_EXCLUDED];
+static int ExcludedCount;
+static const char *Runtime[MAX_RUNTIME];
+static int RuntimeCount;
+
+static void Fail(const char *message, const char *detail)
+{
+    fprintf(stderr, "lazarus-size-report: %s%s%s\n", message, detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: lazarus-size-report [-x symbol]... lnk_rf430frl152h_Lazarus.cmd firmware.o\n");
+    exit(2);
+}
+
+static const char *SectionName(int index)
+{
+    return SectionNames + Sections[index].sh_name;
+}
+
+static int Executable(int index)
+{
+    return (Sections[index].sh_flags & SHF_EXECINSTR) != 0;
+}
+
+static int Vector(int index)
+{
+    return strncmp(SectionName(index), "__interrupt_vector_", 19) == 0;
+}
+
+/*  ReadObject                                                                         *
+ *  Function:  Load the object file and locate its section and symbol tables.         */
+static void ReadObject(const char *path)
+{
+    FILE *input = fopen(path, "rb");
+    const Elf32_Ehdr *header;
+    int i;
+
+    if (input == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    fseek(input, 0, SEEK_END);
+    ObjectSize = ftell(input);
+    rewind(input);
+    Object = malloc(ObjectSize);
+    if (Object == NULL || fread(Object, 1, ObjectSize, input) != ObjectSize)
+    {
+        Fail("reading failed", path);
+    }
+    fclose(input);
+
+    header = (const Elf32_Ehdr *) Object;
+    if (ObjectSize < sizeof(*header) || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0
+            || header->e_ident[EI_CLASS] != ELFCLASS32 || header->e_ident[EI_DATA] != ELFDATA2LSB
+            || header->e_type != ET_REL || header->e_machine != EM_MSP430)
+    {
+        Fail("not a relocatable MSP430 object", path);
+    }
+    Sections = (const Elf32_Shdr *) (Object + header->e_shoff);
+    SectionCount = header->e_shnum;
+    SectionNames = (const char *) Object + Sections[header->e_shstrndx].sh_offset;
+    for (i = 0; i < SectionCount; i++)
+    {
+        if (Sections[i].sh_type == SHT_SYMTAB)
+        {
+            Symbols = (const Elf32_Sym *) (Object + Sections[i].sh_offset);
+            SymbolCount = Sections[i].sh_size / sizeof(Elf32_Sym);
+            SymbolNames = (const char *) Object + Sections[Sections[i].sh_link].sh_offset;
+        }
+    }
+    if (Symbols == NULL)
+    {
+        Fail("no symbol table", path);
+    }
+    Reached = calloc(SectionCount, 1);
+    Excluded = calloc(SectionCount, 1);
+    Pending = malloc(SectionCount * sizeof(int));
+}
+
+/*  ReadCodeArea                                                                       *
+ *  Function:  Take origin and length of FRAM_CODE from the linker command file.       */
+static void ReadCodeArea(const char *path, unsigned long *origin, unsigned long *length)
+{
+    FILE *input = fopen(path, "r");
+    char line[256];
+
+    if (input == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        const char *name = strstr(line, "FRAM_CODE");
+        const char *o = strstr(line, "origin");
+        const char *l = strstr(line, "length");
+
+        if (name != NULL && o != NULL && l != NULL && name < o && strchr(o, '=') && strchr(l, '='))
+        {
+            *origin = strtoul(strchr(o, '=') + 1, NULL, 0);
+            *length = strtoul(strchr(l, '=') + 1, NULL, 0);
+            fclose(input);
+            return;
+        }
+    }
+    Fail("no FRAM_CODE in the MEMORY directive", path);
+}
+
+/*  Exclude                                                                            *
+ *  Function:  Mark the sections of the symbols given with -x, they are neither        *
+ *             counted nor followed.                                                   */
+static void Exclude(void)
+{
+    int i, j;
+
+    for (i = 0; i < ExcludedCount; i++)
+    {
+        for (j = 1; j < SymbolCount; j++)
+        {
+            if (Symbols[j].st_shndx != SHN_UNDEF && Symbols[j].st_shndx < SectionCount
+                    && strcmp(SymbolNames + Symbols[j].st_name, ExcludedNames[i]) == 0)
+            {
+                Excluded[Symbols[j].st_shndx] = 1;
+            }
+        }
+    }
+}
+
+static void Reach(int index)
+{
+    if (index > 0 && index < SectionCount && !Reached[index] && !Excluded[index])
+    {
+        Reached[index] = 1;
+        Pending[PendingCount++] = index;
+    }
+}
+
+/*  Called                                                                             *
+ *  Function:  Whether the relocated word is the operand of a call or a branch.        */
+static int Called(int section, Elf32_Addr offset)
+{
+    const uint8_t *code = Object + Sections[section].sh_offset;
+    uint16_t opcode;
+
+    if (!Executable(section) || offset < 2 || offset > Sections[section].sh_size)
+    {
+        return 0;
+    }
+    opcode = code[offset - 2] | (code[offset - 1] << 8);
+    return opcode == MSP430_CALL_IMMEDIATE || opcode == MSP430_BRANCH_IMMEDIATE;
+}
+
+static void AddRuntime(const char *name)
+{
+    int i;
+
+    for (i = 0; i < RuntimeCount; i++)
+    {
+        if (strcmp(Runtime[i], name) == 0)
+        {
+            return;
+        }
+    }
+    if (RuntimeCount < MAX_RUNTIME)
+    {
+        Runtime[RuntimeCount++] = name;
+    }
+}
+
+/*  Follow                                                                             *
+ *  Function:  Reach everything the relocations of a reached section refer to.         */
+static void Follow(int section)
+{
+    int i, j;
+
+    for (i = 0; i < SectionCount; i++)
+    {
+        const Elf32_Rela *rela;
+        int count;
+
+        if (Sections[i].sh_type != SHT_RELA || (int) Sections[i].sh_info != section)
+        {
+            continue;
+        }
+        rela = (const Elf32_Rela *) (Object + Sections[i].sh_offset);
+        count = Sections[i].sh_size / sizeof(Elf32_Rela);
+        for (j = 0; j < count; j++)
+        {
+            const Elf32_Sym *symbol = &Symbols[ELF32_R_SYM(rela[j].r_info)];
+
+            if (symbol->st_shndx == SHN_UNDEF)
+            {
+                if (Called(section, rela[j].r_offset))
+                {
+                    AddRuntime(SymbolNames + symbol->st_name);
+                }
+            }
+            else if (symbol->st_shndx < SectionCount)
+            {
+                Reach(symbol->st_shndx);
+            }
+        }
+    }
+}
+
+/*  CountDriverFunctions                                                               *
+ *  Function:  The entries of the driver table are the data referring to functions     *
+ *             (jump tables refer into them), make them roots and count them.          */
+static int CountDriverFunctions(void)
+{
+    int count = 0;
+    int i, j;
+
+    for (i = 1; i < SectionCount; i++)
+    {
+        const Elf32_Rela *rela;
+        int target = Sections[i].sh_info;
+
+        if (Sections[i].sh_type != SHT_RELA || !(Sections[target].sh_flags & SHF_ALLOC)
+                || Executable(target) || Vector(target))
+        {
+            continue;
+        }
+        rela = (const Elf32_Rela *) (Object + Sections[i].sh_offset);
+        for (j = 0; j < (int) (Sections[i].sh_size / sizeof(Elf32_Rela)); j++)
+        {
+            const Elf32_Sym *symbol = &Symbols[ELF32_R_SYM(rela[j].r_info)];
+
+            if (ELF32_ST_TYPE(symbol->st_info) == STT_FUNC && symbol->st_shndx != SHN_UNDEF
+                    && symbol->st_shndx < SectionCount)
+            {
+                Reach(symbol->st_shndx);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/*  Label                                                                              *
+ *  Function:  The function or object a section holds, its name otherwise.             */
+static const char *Label(int section)
+{
+    int i;
+
+    for (i = 1; i < SymbolCount; i++)
+    {
+        int type = ELF32_ST_TYPE(Symbols[i].st_info);
+
+        if (Symbols[i].st_shndx == section && (type == STT_FUNC || type == STT_OBJECT))
+        {
+            return SymbolNames + Symbols[i].st_name;
+        }
+    }
+    return SectionName(section);
+}
+
+/*  Report                                                                             *
+ *  Function:  Print the counted sections of one kind, largest first, and return       *
+ *             their total.                                                            */
+static unsigned long Report(const char *kind, int executable)
+{
+    uint8_t *listed = calloc(SectionCount, 1);
+    unsigned long total = 0;
+    int i;
+
+    for (i = 1; i < SectionCount; i++)
+    {
+        if (Reached[i] && !Vector(i) && Executable(i) == executable && Sections[i].sh_type == SHT_PROGBITS)
+        {
+            total += Sections[i].sh_size;
+        }
+    }
+    printf("  %-36s %5lu\n", kind, total);
+    for (;;)
+    {
+        int largest = 0;
+
+        for (i = 1; i < SectionCount; i++)
+        {
+            if (Reached[i] && !listed[i] && !Vector(i) && Executable(i) == executable
+                    && Sections[i].sh_type == SHT_PROGBITS && Sections[i].sh_size > 0
+                    && (largest == 0 || Sections[i].sh_size > Sections[largest].sh_size))
+            {
+                largest = i;
+            }
+        }
+        if (largest == 0)
+        {
+            break;
+        }
+        listed[largest] = 1;
+        printf("    %-34s %5lu\n", Label(largest), (unsigned long) Sections[largest].sh_size);
+    }
+    free(listed);
+    return total;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long origin = 0, length = 0, used, table;
+    char label[40];
+    int commands, option, i;
+
+    while ((option = getopt(argc, argv, "x:")) != -1)
+    {
+        switch (option)
+        {
+            case 'x':
+                if (ExcludedCount == MAX_EXCLUDED)
+                {
+                    Fail("too many symbols to exclude", optarg);
+                }
+                ExcludedNames[ExcludedCount++] = optarg;
+                break;
+            default:
+                Usage();
+        }
+    }
+    if (argc - optind != 2)
+    {
+        Usage();
+    }
+    ReadCodeArea(argv[optind], &origin, &length);
+    ReadObject(argv[optind + 1]);
+    Exclude();
+
+    for (i = 1; i < SymbolCount; i++)
+    {
+        if (strcmp(SymbolNames + Symbols[i].st_name, "main") == 0 && Symbols[i].st_shndx < SectionCount)
+        {
+            Reach(Symbols[i].st_shndx);
+        }
+    }
+    if (PendingCount == 0)
+    {
+        Fail("no main", argv[optind + 1]);
+    }
+    for (i = 1; i < SectionCount; i++)
+    {
+        if (Vector(i))
+        {
+            Reach(i);
+        }
+    }
+    commands = CountDriverFunctions();
+    while (PendingCount > 0)
+    {
+        Follow(Pending[--PendingCount]);
+    }
+
+    table = commands ? DRIVER_TABLE_KEYS + DRIVER_TABLE_ENTRY * commands : 0;
+    snprintf(label, sizeof(label), "FRAM_CODE from 0x%04lX", origin);
+    printf("%-38s %5lu\n", label, length);
+    used = Report("code", 1);
+    used += Report("constants and initial values", 0);
+    snprintf(label, sizeof(label), "driver table, %d commands", commands);
+    printf("  %-36s %5lu\n", label, table);
+    used += table;
+    printf("  %-36s %5ld\n", "free", (long) length - (long) used);
+    printf("runtime support, not counted:");
+    for (i = 0; i < RuntimeCount; i++)
+    {
+        printf(" %s", Runtime[i]);
+    }
+    printf("\n");
+
+    if (used > length)
+    {
+        fprintf(stderr, "lazarus-size-report: FRAM_CODE overflows by %lu bytes\n", used - length);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * table.c
+ *
+ * Generate temperature_table.h, the lookup table with which the firmware converts
+ * conversion results of the thermistor into centi-degrees Celsius.
+ *
+ * The coefficients are those of steinharthart() in TemperatureReading.kt of the
+ * app, keep both in sync. The table holds the temperature at every
+ * 2^TABLE_SHIFT counts of the 14 bit result, the firmware interpolates linearly
+ * in between. With a spacing of 128 counts the interpolation error stays below
+ * 0.04 degrees up to 60 degrees Celsius; the worst case is reported on stderr.
+ *
+ * The table has a fixed address so the payload builder can take it along with
+ * the temperature command (-d in PAYLOAD_FLAGS of the Makefile).
+ *
+ * Usage: lazarus-table-generator > ../temperature_table.h
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+//================================================================
+
+#define RAW_OFFSET      411.737     // added to the raw value before applying the equation
+#define COEFFICIENT_A   0.000679241
+#define COEFFICIENT_B   0.000324031
+#define COEFFICIENT_C   -0.000000173770
+#define COEFFICIENT_D   -0.0000000000677986
+#define KELVIN          273.15
+
+#define RAW_BITS        14
+#define TABLE_SHIFT     7
+#define TABLE_ENTRIES   ((1 << (RAW_BITS - TABLE_SHIFT)) + 1)
+#define TABLE_ADDRESS   0xF9A0      // block 40 behind the signature, the payload builder copies the table from there
+
+static double Celsius(double raw)
+{
+    double l = log(raw + RAW_OFFSET);
+
+    return 1.0 / (COEFFICIENT_A + COEFFICIENT_B * l + COEFFICIENT_C * pow(l, 3.0) + COEFFICIENT_D * pow(l, 2.0)) - KELVIN;
+}
+
+/* Round to centi-degrees within the range of s16_t */
+static long CentiCelsius(double celsius)
+{
+    double centi = floor(celsius * 100.0 + 0.5);
+
+    if (centi > 32767.0)
+    {
+        return 32767;
+    }
+    if (centi < -32768.0)
+    {
+        return -32768;
+    }
+    return (long) centi;
+}
+
+int main(void)
+{
+    long table[TABLE_ENTRIES];
+    double worst = 0.0;
+    long worstRaw = 0;
+    long raw;
+    int i;
+
+    for (i = 0; i < TABLE_ENTRIES; i++)
+    {
+        table[i] = CentiCelsius(Celsius((double) ((long) i << TABLE_SHIFT)));
+    }
+
+    // mirror the interpolation of RawToCentiCelsius() in main.c
+    for (raw = 0; raw < (1L << RAW_BITS); raw++)
+    {
+        long index = raw >> TABLE_SHIFT;
+        long fraction = raw & ((1 << TABLE_SHIFT) - 1);
+        long value = table[index] + (((table[index + 1] - table[index]) * fraction + (1 << (TABLE_SHIFT - 1))) >> TABLE_SHIFT);
+        double error = fabs(value / 100.0 - Celsius((double) raw));
+
+        if (error > worst)
+        {
+            worst = error;
+            worstRaw = raw;
+        }
+    }
+    fprintf(stderr, "lazarus-table-generator: largest error %.3f degrees at raw %ld\n", worst, worstRaw);
+
+    printf("/*\n");
+    printf(" * temperature_table.h\n");
+    printf(" *\n");
+    printf(" * Generated by host/table.c, regenerate with \"make -C embedded/host table\".\n");
+    printf(" *\n");
+    printf(" * Temperature in centi-degrees Celsius at every %d counts of the thermistor\n", 1 << TABLE_SHIFT);
+    printf(" * conversion, for linear interpolation by RawToCentiCelsius() in main.c. The\n");
+    printf(" * payload builder copies it from its fixed address (-d in host/Makefile).\n");
+    printf(" */\n\n");
+    printf("#ifndef TEMPERATURE_TABLE_H_\n");
+    printf("#define TEMPERATURE_TABLE_H_\n\n");
+    printf("#define TEMPERATURE_TABLE_SHIFT         %d\n", TABLE_SHIFT);
+    printf("#define TEMPERATURE_TABLE_ENTRIES       %d\n", TABLE_ENTRIES);
+    printf("#define TEMPERATURE_TABLE_ADDRESS       0x%04X\n\n", TABLE_ADDRESS);
+    printf("#pragma location = TEMPERATURE_TABLE_ADDRESS\n");
+    printf("static const s16_t TemperatureTable[TEMPERATURE_TABLE_ENTRIES] = {\n");
+    for (i = 0; i < TABLE_ENTRIES; i++)
+    {
+        printf("%s%6ld%s", (i % 8 == 0) ? "    " : " ", table[i],
+               (i + 1 == TABLE_ENTRIES) ? "\n" : ((i % 8 == 7) ? ",\n" : ","));
+    }
+    printf("};\n\n");
+    printf("#endif\n");
+    return 0;
+}
@@ -0,0 +1,21 @@
+/*
+ * tag.h
+ *
+ * Memory of a Libre sensor as seen by the app via NFC, for the host tools which
+ * prepare images for it.
+ *
+ * The app's unit tests (android/app/src/test) simulate the tag itself behind
+ * NFCTransport and check its TI-TXT parser, so that code is exercised as it ships.
+ */
+
+#ifndef TAG_H_
+#define TAG_H_
+
+//================================================================
+
+#define TAG_FRAM_START              0xF860      // block 0 of the ISO 15693 memory
+#define TAG_BLOCKS                  244
+#define TAG_BLOCK_SIZE              8
+#define TAG_PROGRAM_KEY_BLOCK       39
+
+#endif
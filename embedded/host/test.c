@@ -0,0 +1,598 @@
+/*
+ * test.c
+ *
+ * Behavioral tests of the firmware running in the host simulation.
+ *
+ * Each test boots a fresh device, talks to it like a reader and checks the
+ * answers. A failed check is reported with its line and the run continues, the
+ * exit status tells whether all checks passed.
+ *
+ * Usage: lazarus-host-test
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "host.h"
+
+//================================================================
+
+#define CUSTOM_CHANNEL              3           // channel of CUSTOM_SD14CTL1 in main.c
+#define CUSTOM_SD14CTL1_LOW         0x43        // what the app sends to the custom command
+#define CUSTOM_SD14CTL1_HIGH        0xD0
+#define REFERENCE_CHANNEL           3           // channels as in enum Channel_Types of main.c
+#define THERMISTOR_CHANNEL          2
+#define INTERNAL_TEMPERATURE_CHANNEL 1
+#define TRIPLE_NS                   200000000ULL    // enough for a temperature conversion and its triple with SD14INTDLY0
+#define READING_GAP_NS              2000000000ULL   // between two readings
+#define STREAM_STOP_NS              2000000000ULL   // beyond STREAM_IDLE_LIMIT conversions of main.c
+#define COMMAND_GAP_NS              20000000ULL     // between two commands of a reader
+#define BOOT_NS                     300000000ULL    // until main() took the first temperature sample and triple
+#define MINUTE_NS                   60000000000ULL
+#define SAMPLE_LOG_BLOCK            4           // header, the entries follow, see SAMPLE_LOG_ADDRESS of main.c
+#define SAMPLE_LOG_ENTRIES          64
+#define ACTIVE_TICKS_BLOCK          72          // ACTIVE_TICKS_ADDRESS of main.c, bytes 2 and 3
+#define PROFILE_BLOCK               73          // PROFILE_ADDRESS of main.c
+#define MAX_ACTIVE_NS               1000000ULL      // what a handler may take within the response window
+#define CUSTOM_COMMAND_NS           45000000ULL     // the custom command waits CUSTOM_COMMAND_CYCLES of main.c
+#define CUSTOM_COMMAND_SAMPLE       1           // status of an answer with a conversion, as in main.c
+
+#define CHECK(condition) Check((condition), #condition, __LINE__)
+
+static int Failures;
+
+static void Check(int condition, const char *text, int line)
+{
+    if (!condition)
+    {
+        printf("  line %d: %s\n", line, text);
+        Failures++;
+    }
+}
+
+static uint16_t Word(const uint8_t *response, int offset)
+{
+    return response[offset] | (response[offset + 1] << 8);
+}
+
+/*  Command                                                                            *
+ *  Function:  Send a custom command, returns the answer length including the flags    *
+ *             byte and the time the handler kept the device active.                   */
+static int Command(uint16_t id, const uint8_t *parameters, int length, uint8_t *response, uint64_t *active_ns)
+{
+    uint64_t before = host_statistics.active_ns;
+    int answer = host_rf_command(id, parameters, length, response, HOST_FIFO_SIZE);
+
+    if (active_ns)
+    {
+        *active_ns = host_statistics.active_ns - before;
+    }
+    return answer;
+}
+
+/*  LogEntry                                                                           *
+ *  Function:  Read an entry of the sample log like a reader does, via the blocks.     */
+static void LogEntry(int index, uint16_t *timestamp, uint16_t *sample)
+{
+    uint8_t block[HOST_BLOCK_SIZE];
+    int offset = (index % 2) * 4;
+
+    host_read_block(SAMPLE_LOG_BLOCK + 1 + index / 2, block);
+    *timestamp = Word(block, offset);
+    *sample = Word(block, offset + 2);
+}
+
+/*  WriteLogHeader                                                                     *
+ *  Function:  Rewrite the header of the sample log, a non-zero interval with all      *
+ *             other fields zero starts a new log.                                     */
+static void WriteLogHeader(uint16_t interval)
+{
+    uint8_t header[HOST_BLOCK_SIZE] = { interval & 0xFF, interval >> 8 };
+
+    host_write_block(SAMPLE_LOG_BLOCK, header);
+}
+
+/*  Oversample                                                                         *
+ *  Function:  Send the oversampling command for n conversions, returns the count of   *
+ *             the answer and stores the sum and the sequence number.                  */
+static uint16_t Oversample(uint16_t n, uint32_t *sum, uint16_t *sequence)
+{
+    uint8_t request[2] = { n & 0xFF, n >> 8 };
+    uint8_t response[HOST_FIFO_SIZE];
+
+    CHECK(Command(0x00B5, request, sizeof(request), response, NULL) == 9);
+    *sum = Word(response, 3) | ((uint32_t) Word(response, 5) << 16);
+    *sequence = Word(response, 7);
+    return Word(response, 1);
+}
+
+/*  Statistics                                                                         *
+ *  Function:  Send the statistics command with window size n, returns the count of    *
+ *             the answer and stores minimum and maximum, and mean and variance        *
+ *             divided out of the sums like a reader does. A saturated sum of squares  *
+ *             gives a negative variance.                                              */
+static uint16_t Statistics(uint16_t n, uint16_t *min, uint16_t *max, double *mean, double *variance)
+{
+    uint8_t request[2] = { n & 0xFF, n >> 8 };
+    uint8_t response[HOST_FIFO_SIZE];
+    uint16_t count;
+    uint32_t sum;
+    uint32_t squares;
+    double deviation;
+
+    CHECK(Command(0x00B9, request, sizeof(request), response, NULL) == 17);
+    count = Word(response, 1);
+    *min = Word(response, 3);
+    *max = Word(response, 5);
+    sum = Word(response, 9) | ((uint32_t) Word(response, 11) << 16);
+    squares = Word(response, 13) | ((uint32_t) Word(response, 15) << 16);
+    deviation = (double) sum - (double) count * Word(response, 7);
+    *mean = count ? (double) sum / count : 0.0;
+    *variance = count > 1 ? (squares - deviation * deviation / count) / (count - 1) : 0.0;
+    if (squares >= 0xF0000000UL)
+    {
+        *variance = -1.0;
+    }
+    return count;
+}
+
+/*  TestPayloadCustomCommand                                                           *
+ *  Function:  As a payload the custom command gets no help from the ISRs of main.c,   *
+ *             a single request still has to deliver a fresh sample and must leave     *
+ *             the SD14 off. The handler waits for the conversion, so it may take up   *
+ *             to CUSTOM_COMMAND_NS.                                                   */
+static void TestPayloadCustomCommand(void)
+{
+    uint8_t request[2] = { CUSTOM_SD14CTL1_LOW, CUSTOM_SD14CTL1_HIGH };
+    uint8_t other[2] = { CUSTOM_SD14CTL1_LOW - CUSTOM_CHANNEL + THERMISTOR_CHANNEL, CUSTOM_SD14CTL1_HIGH };
+    uint8_t response[HOST_FIFO_SIZE];
+    uint64_t active_ns;
+    uint64_t conversions;
+    int i;
+
+    printf("payload custom command\n");
+    host_reset();
+    host_set_payload_mode(1);
+    host_set_input(CUSTOM_CHANNEL, 0x1800, 0);
+
+    for (i = 0; i < 4; i++)
+    {
+        // every request answers with a conversion taken for it and stops the SD14
+        conversions = host_statistics.conversions;
+        CHECK(Command(0x00AA, request, sizeof(request), response, &active_ns) == 5);
+        CHECK(response[0] == 0);
+        CHECK(Word(response, 1) == 0x1800);
+        CHECK(Word(response, 3) == CUSTOM_COMMAND_SAMPLE);
+        CHECK(active_ns < CUSTOM_COMMAND_NS);
+        CHECK(host_statistics.conversions > conversions);
+        CHECK(!host_sd14_enabled());
+        host_idle(READING_GAP_NS);
+    }
+
+    // the result reports a changed input at once, not a stale sample
+    host_set_input(CUSTOM_CHANNEL, 0x1900, 0);
+    CHECK(Command(0x00AA, request, sizeof(request), response, NULL) == 5);
+    CHECK(Word(response, 1) == 0x1900);
+    CHECK(Word(response, 3) == CUSTOM_COMMAND_SAMPLE);
+
+    // the parameter selects the channel, right away as well
+    host_set_input(THERMISTOR_CHANNEL, 0x1A00, 0);
+    CHECK(Command(0x00AA, other, sizeof(other), response, NULL) == 5);
+    CHECK(Word(response, 1) == 0x1A00);
+    CHECK(Word(response, 3) == CUSTOM_COMMAND_SAMPLE);
+    CHECK(!host_sd14_enabled());
+    CHECK(Command(0x00AA, request, sizeof(request), response, NULL) == 5);
+    CHECK(Word(response, 1) == 0x1900);
+    host_set_payload_mode(0);
+}
+
+/*  TestTemperatureCommand                                                             *
+ *  Function:  The temperature command answers the first request with a valid sample,  *
+ *             the SD14 ISR completes the conversion for the next one and stops the    *
+ *             SD14 in between. The custom command does not interfere.                 */
+static void TestTemperatureCommand(void)
+{
+    uint8_t request[2] = { CUSTOM_SD14CTL1_LOW, CUSTOM_SD14CTL1_HIGH };
+    uint8_t response[HOST_FIFO_SIZE];
+    uint64_t active_ns;
+    uint16_t first;
+
+    printf("temperature command\n");
+    host_reset();
+    host_set_input(CUSTOM_CHANNEL, 0x1800, 0);
+    host_run_main(BOOT_NS);
+    CHECK(!host_sd14_enabled());
+
+    // main() took a sample at power up
+    CHECK(Command(0x00B7, NULL, 0, response, &active_ns) == 5);
+    CHECK(response[0] == 0);
+    CHECK(Word(response, 3) == 1);
+    CHECK(active_ns < MAX_ACTIVE_NS);
+    first = Word(response, 1);
+
+    // the request started the next conversion, it is done with its triple before the next request
+    host_idle(TRIPLE_NS);
+    CHECK(!host_sd14_enabled());
+    CHECK(Command(0x00B7, NULL, 0, response, &active_ns) == 5);
+    CHECK(Word(response, 1) == first);
+    CHECK(Word(response, 3) == 2);
+    CHECK(active_ns < MAX_ACTIVE_NS);
+
+    host_set_input(CUSTOM_CHANNEL, 0x1900, 0);
+    host_idle(TRIPLE_NS);
+    CHECK(Command(0x00B7, NULL, 0, response, NULL) == 5);
+    CHECK(Word(response, 1) != first);
+    CHECK(Word(response, 3) == 3);
+
+    // the custom command leaves the conversion the request started alone
+    CHECK(host_sd14_enabled());
+    CHECK(Command(0x00AA, request, sizeof(request), response, &active_ns) == 5);
+    CHECK(Word(response, 3) == 0);
+    CHECK(active_ns < MAX_ACTIVE_NS);
+    CHECK(host_sd14_enabled());
+    host_idle(TRIPLE_NS);
+    CHECK(Command(0x00AA, request, sizeof(request), response, NULL) == 5);
+    CHECK(Word(response, 1) == 0x1900);
+    CHECK(Word(response, 3) == CUSTOM_COMMAND_SAMPLE);
+}
+
+/*  TestRatiometricCommand                                                             *
+ *  Function:  The ratiometric command answers at once with the newest triple and      *
+ *             leaves the conversions to the SD14 ISR, which also takes one behind     *
+ *             every temperature sample.                                               */
+static void TestRatiometricCommand(void)
+{
+    uint8_t response[HOST_FIFO_SIZE];
+    uint64_t active_ns;
+    uint16_t sequence;
+
+    printf("ratiometric command\n");
+    host_reset();
+    host_set_input(REFERENCE_CHANNEL, 0x2000, 0);
+    host_set_input(THERMISTOR_CHANNEL, 0x1800, 0);
+    host_set_input(INTERNAL_TEMPERATURE_CHANNEL, 0x0900, 0);
+    host_run_main(BOOT_NS);
+    CHECK(!host_sd14_enabled());
+
+    // main() took a triple at power up behind the temperature sample
+    CHECK(Command(0x00B4, NULL, 0, response, &active_ns) == 9);
+    CHECK(Word(response, 1) == 0x2000);
+    CHECK(Word(response, 3) == 0x1800);
+    CHECK(Word(response, 5) == 0x0900);
+    CHECK(Word(response, 7) != 0);
+    CHECK(active_ns < MAX_ACTIVE_NS);
+    sequence = Word(response, 7);
+
+    // the request started the next triple, it reports the changed input
+    host_set_input(THERMISTOR_CHANNEL, 0x1900, 0);
+    host_idle(TRIPLE_NS);
+    CHECK(!host_sd14_enabled());
+    CHECK(Command(0x00B4, NULL, 0, response, &active_ns) == 9);
+    CHECK(Word(response, 3) == 0x1900);
+    CHECK(Word(response, 7) == sequence + 1);
+    CHECK(active_ns < MAX_ACTIVE_NS);
+
+    // every temperature sample is followed by its triple, a request right after the temperature command gets the
+    // triple belonging to the sample just answered, the triple of the next sample comes with the next pair
+    host_idle(TRIPLE_NS);
+    host_set_input(THERMISTOR_CHANNEL, 0x1A00, 0);
+    CHECK(Command(0x00B7, NULL, 0, response, NULL) == 5);
+    CHECK(Command(0x00B4, NULL, 0, response, NULL) == 9);
+    CHECK(Word(response, 3) == 0x1900);
+    CHECK(Word(response, 7) == sequence + 2);
+    host_idle(TRIPLE_NS);
+    CHECK(!host_sd14_enabled());
+    CHECK(Command(0x00B7, NULL, 0, response, NULL) == 5);
+    CHECK(Command(0x00B4, NULL, 0, response, NULL) == 9);
+    CHECK(Word(response, 3) == 0x1A00);
+    CHECK(Word(response, 7) == sequence + 3);
+}
+
+/*  TestStreamAfterIdle                                                                *
+ *  Function:  Once streaming stopped for lack of requests, the next request starts a  *
+ *             new stream and must not hand out the samples of the old one.            */
+static void TestStreamAfterIdle(void)
+{
+    uint8_t request[1] = { 0 };
+    uint8_t response[HOST_FIFO_SIZE];
+    uint64_t active_ns;
+    int length;
+
+    printf("stream after idle\n");
+    host_reset();
+    host_set_input(CUSTOM_CHANNEL, 0x1800, 0);
+    host_run_main(BOOT_NS);
+
+    // the first request starts the stream
+    CHECK(Command(0x00B8, request, 1, response, &active_ns) == 3);
+    CHECK(Word(response, 1) == 0);
+    CHECK(active_ns < MAX_ACTIVE_NS);
+
+    host_idle(TRIPLE_NS);
+    length = Command(0x00B8, request, 1, response, &active_ns);
+    CHECK(length > 3);
+    CHECK(Word(response, 1) == (length - 3) / 2);
+    CHECK(Word(response, length - 2) == 0x1800);
+    CHECK(active_ns < MAX_ACTIVE_NS);
+
+    // nobody asks, streaming stops with the old samples still in the buffer
+    host_set_input(CUSTOM_CHANNEL, 0x1900, 0);
+    host_idle(STREAM_STOP_NS);
+    CHECK(!host_sd14_enabled());
+    CHECK(Command(0x00B8, request, 1, response, NULL) == 3);
+    CHECK(Word(response, 1) == 0);
+
+    host_idle(TRIPLE_NS);
+    length = Command(0x00B8, request, 1, response, NULL);
+    CHECK(length > 3);
+    CHECK(Word(response, 1) == (length - 3) / 2);
+    CHECK(Word(response, 3) == 0x1900);
+}
+
+/*  TestSampleLog                                                                      *
+ *  Function:  The scheduler takes a sample per interval into the FRAM ring, which     *
+ *             wraps after SAMPLE_LOG_ENTRIES. The log lives in FRAM, so logging       *
+ *             resumes where it was after the device restarted.                        */
+static void TestSampleLog(void)
+{
+    uint8_t header[HOST_BLOCK_SIZE];
+    uint16_t timestamp, sample;
+    int i;
+
+    printf("sample log\n");
+    host_reset();
+    host_set_input(CUSTOM_CHANNEL, 0x1800, 0);
+    WriteLogHeader(1);
+    host_run_main(SAMPLE_LOG_ENTRIES * MINUTE_NS + 5 * MINUTE_NS + MINUTE_NS / 2);
+
+    // one sample when logging was enabled, one per minute since then
+    host_read_block(SAMPLE_LOG_BLOCK, header);
+    CHECK(Word(header, 0) == 1);
+    CHECK(Word(header, 4) == SAMPLE_LOG_ENTRIES + 6);
+    CHECK(Word(header, 2) == 6);
+    CHECK(Word(header, 6) == SAMPLE_LOG_ENTRIES + 5);
+
+    // the oldest entry is at next, the first six were overwritten
+    for (i = 0; i < SAMPLE_LOG_ENTRIES; i++)
+    {
+        LogEntry((6 + i) % SAMPLE_LOG_ENTRIES, &timestamp, &sample);
+        CHECK(timestamp == 6 + i);
+        CHECK(sample == 0x1800);
+    }
+
+    // restarting keeps the log and its interval
+    host_reset();
+    host_set_input(CUSTOM_CHANNEL, 0x1900, 0);
+    host_run_main(2 * MINUTE_NS + MINUTE_NS / 2);
+    host_read_block(SAMPLE_LOG_BLOCK, header);
+    CHECK(Word(header, 4) == SAMPLE_LOG_ENTRIES + 8);
+    CHECK(Word(header, 2) == 8);
+    CHECK(Word(header, 6) == SAMPLE_LOG_ENTRIES + 7);
+    LogEntry(7, &timestamp, &sample);
+    CHECK(timestamp == SAMPLE_LOG_ENTRIES + 7);
+    CHECK(sample == 0x1900);
+
+    // a new log with a longer interval, picked up at the next timer event
+    WriteLogHeader(3);
+    host_run_main(10 * MINUTE_NS);
+    host_read_block(SAMPLE_LOG_BLOCK, header);
+    CHECK(Word(header, 0) == 3);
+    CHECK(Word(header, 4) == Word(header, 2));
+    CHECK(Word(header, 4) >= 3);
+    for (i = 0; i < Word(header, 4); i++)
+    {
+        LogEntry(i, &timestamp, &sample);
+        CHECK(timestamp == 3 * i);
+    }
+
+    WriteLogHeader(0);                      // the log survives host_reset(), keep the other tests free of it
+}
+
+/*  WriteProfile                                                                       *
+ *  Function:  Rewrite the measurement profile as the app does, in a single block.     */
+static void WriteProfile(uint16_t sd14ctl1)
+{
+    uint8_t profile[HOST_BLOCK_SIZE] = { sd14ctl1 & 0xFF, sd14ctl1 >> 8 };
+
+    host_write_block(PROFILE_BLOCK, profile);
+}
+
+/*  TestMeasurementProfile                                                             *
+ *  Function:  The sample log converts with the settings of the profile from the next  *
+ *             sample on, the temperature command keeps its own.                       */
+static void TestMeasurementProfile(void)
+{
+    uint8_t block[HOST_BLOCK_SIZE];
+    uint8_t response[HOST_FIFO_SIZE];
+    uint16_t timestamp, sample;
+    uint16_t celsius;
+    int i;
+
+    printf("measurement profile\n");
+    host_reset();
+    host_read_block(PROFILE_BLOCK, block);
+    CHECK(block[0] == CUSTOM_SD14CTL1_LOW && block[1] == CUSTOM_SD14CTL1_HIGH);
+
+    // the thermistor channel instead of the custom one
+    host_set_input(CUSTOM_CHANNEL, 0x1800, 0);
+    host_set_input(THERMISTOR_CHANNEL, 0x1A00, 0);
+    host_run_main(BOOT_NS);
+    CHECK(Command(0x00B7, NULL, 0, response, NULL) == 5);
+    celsius = Word(response, 1);
+    WriteProfile((CUSTOM_SD14CTL1_HIGH << 8) + CUSTOM_SD14CTL1_LOW - CUSTOM_CHANNEL + THERMISTOR_CHANNEL);
+    WriteLogHeader(1);
+    host_run_main(2 * MINUTE_NS + MINUTE_NS / 2);
+    host_read_block(SAMPLE_LOG_BLOCK, block);
+    CHECK(Word(block, 4) == 3);
+    for (i = 0; i < 3; i++)
+    {
+        LogEntry(i, &timestamp, &sample);
+        CHECK(sample == 0x1A00);
+    }
+    CHECK(!host_sd14_enabled());
+    CHECK(Command(0x00B7, NULL, 0, response, NULL) == 5);
+    CHECK(Word(response, 1) == celsius);
+
+    WriteLogHeader(0);                      // FRAM survives host_reset(), keep the other tests free of both
+    WriteProfile((CUSTOM_SD14CTL1_HIGH << 8) + CUSTOM_SD14CTL1_LOW);
+}
+
+/*  TestActiveTicks                                                                    *
+ *  Function:  The active ticks behind the temperature table are readable via block    *
+ *             72 and stay within the active time of the cycle model, give or take     *
+ *             the tick each stretch may gain by rounding (a wrong wrap of TA0R would  *
+ *             add almost a minute).                                                   */
+static void TestActiveTicks(void)
+{
+    uint8_t block[HOST_BLOCK_SIZE];
+    uint32_t ticks;
+
+    printf("active ticks\n");
+    host_reset();
+    host_read_block(ACTIVE_TICKS_BLOCK, block);
+    ticks = Word(block, 2) | ((uint32_t) Word(block, 4) << 16);
+    WriteLogHeader(1);
+    host_run_main(10 * MINUTE_NS + MINUTE_NS / 2);
+    host_read_block(ACTIVE_TICKS_BLOCK, block);
+    ticks = (Word(block, 2) | ((uint32_t) Word(block, 4) << 16)) - ticks;
+    CHECK(ticks <= host_statistics.active_ns / 1000000 + host_statistics.wakeups);
+    WriteLogHeader(0);
+}
+
+/*  TestOversamplingCommand                                                            *
+ *  Function:  The oversampling command sums exactly the requested number of           *
+ *             conversions.                                                            */
+static void TestOversamplingCommand(void)
+{
+    uint64_t conversions;
+    uint32_t sum;
+    uint16_t sequence;
+    uint16_t first;
+
+    printf("oversampling command\n");
+    host_reset();
+    host_set_input(CUSTOM_CHANNEL, 0x1800, 3);
+    host_run_main(BOOT_NS);
+
+    // nothing completed yet, the request starts the decimation
+    CHECK(Oversample(16, &sum, &sequence) == 0);
+    CHECK(sum == 0);
+    first = sequence;
+    conversions = host_statistics.conversions;
+    host_idle(16 * 3 * COMMAND_GAP_NS);
+    CHECK(host_statistics.conversions - conversions == 16);
+    CHECK(Oversample(16, &sum, &sequence) == 16);
+    CHECK(sum >= 16 * 0x1800 && sum <= 16 * (0x1800 + 6));
+    CHECK(sum != 16 * 0x1800);              // the noise is summed, not averaged away
+    CHECK(sequence == (uint16_t)(first + 1));
+
+    // a different N gets no result until a run for it completed, each answer starts the next run
+    CHECK(Oversample(4, &sum, &sequence) == 0);
+    host_idle(16 * 3 * COMMAND_GAP_NS);
+    CHECK(Oversample(4, &sum, &sequence) == 0);
+    conversions = host_statistics.conversions;
+    host_idle(4 * 3 * COMMAND_GAP_NS);
+    CHECK(host_statistics.conversions - conversions == 4);
+    CHECK(Oversample(4, &sum, &sequence) == 4);
+    CHECK(sum >= 4 * 0x1800 && sum <= 4 * (0x1800 + 6));
+    CHECK(sequence == (uint16_t)(first + 3));
+
+    // the result of the previous run is answered again until the next one completed, the sequence number tells
+    CHECK(Oversample(4, &sum, &sequence) == 4);
+    CHECK(sequence == (uint16_t)(first + 3));
+    host_idle(4 * 3 * COMMAND_GAP_NS);
+    CHECK(Oversample(4, &sum, &sequence) == 4);
+    CHECK(sequence == (uint16_t)(first + 4));
+
+    // a longer run without noise
+    host_set_input(CUSTOM_CHANNEL, 0x1000, 0);
+    host_idle(4 * 3 * COMMAND_GAP_NS);
+    CHECK(Oversample(32, &sum, &sequence) == 0);
+    conversions = host_statistics.conversions;
+    host_idle(32 * 3 * COMMAND_GAP_NS);
+    CHECK(host_statistics.conversions - conversions == 32);
+    CHECK(Oversample(32, &sum, &sequence) == 32);
+    CHECK(sum == 32 * 0x1000);
+
+    // a zero N is a single conversion
+    host_idle(32 * 3 * COMMAND_GAP_NS);
+    CHECK(Oversample(0, &sum, &sequence) == 0);
+    host_idle(3 * COMMAND_GAP_NS);
+    CHECK(Oversample(0, &sum, &sequence) == 1);
+    CHECK(sum == 0x1000);
+}
+
+/*  TestStatisticsCommand                                                              *
+ *  Function:  The statistics command summarizes exactly the requested number of       *
+ *             conversions, the sums give mean and variance without rounding.          */
+static void TestStatisticsCommand(void)
+{
+    uint64_t conversions;
+    uint16_t min;
+    uint16_t max;
+    double mean;
+    double variance;
+
+    printf("statistics command\n");
+    host_reset();
+    host_set_input(CUSTOM_CHANNEL, 0x1800, 0);
+    host_run_main(BOOT_NS);
+
+    // without noise the variance is zero and the mean exact
+    Statistics(16, &min, &max, &mean, &variance);
+    conversions = host_statistics.conversions;
+    host_idle(16 * 3 * COMMAND_GAP_NS);
+    CHECK(host_statistics.conversions - conversions == 16);
+    CHECK(Statistics(0, &min, &max, &mean, &variance) == 16);
+    CHECK(min == 0x1800 && max == 0x1800);
+    CHECK(mean == 0x1800);
+    CHECK(variance == 0.0);
+
+    // uniform noise over 0..6 has a mean of 3 and a variance of 4, the window is large enough to get close
+    host_set_input(CUSTOM_CHANNEL, 0x1800, 3);
+    Statistics(1024, &min, &max, &mean, &variance);
+    host_idle(1024 * 3 * COMMAND_GAP_NS);
+    CHECK(Statistics(0, &min, &max, &mean, &variance) == 1024);
+    CHECK(min == 0x1800 && max == 0x1806);
+    CHECK(mean > 0x1800 + 2.9 && mean < 0x1800 + 3.1);
+    CHECK(variance > 3.7 && variance < 4.3);
+
+    // a nonzero N answers the running window and starts the next one, its first conversion is the reference
+    host_set_input(CUSTOM_CHANNEL, 0x17FD, 3);
+    CHECK(Statistics(1024, &min, &max, &mean, &variance) == 1024);
+    host_idle(1024 * 3 * COMMAND_GAP_NS);
+    CHECK(Statistics(0, &min, &max, &mean, &variance) == 1024);
+    CHECK(min == 0x17FD && max == 0x1803);
+    CHECK(mean > 0x1800 - 0.1 && mean < 0x1800 + 0.1);
+    CHECK(variance > 3.7 && variance < 4.3);
+
+    // a wide spread saturates the squares, the mean stays
+    host_set_input(CUSTOM_CHANNEL, 0x0000, 0x1FFF);
+    Statistics(1024, &min, &max, &mean, &variance);
+    host_idle(1024 * 3 * COMMAND_GAP_NS);
+    CHECK(Statistics(0, &min, &max, &mean, &variance) == 1024);
+    CHECK(variance < 0.0);
+    CHECK(mean > 0x1FFF - 0x200 && mean < 0x1FFF + 0x200);
+    host_set_input(CUSTOM_CHANNEL, 0x1800, 0);
+}
+
+int main(void)
+{
+    TestPayloadCustomCommand();
+    TestTemperatureCommand();
+    TestRatiometricCommand();
+    TestOversamplingCommand();
+    TestStatisticsCommand();
+    TestStreamAfterIdle();
+    TestSampleLog();
+    TestMeasurementProfile();
+    TestActiveTicks();
+
+    if (Failures)
+    {
+        printf("%d check(s) failed\n", Failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -62,8 +62,15 @@ MEMORY
     RF13M_ROM_ISR			: origin = 0x54D0, length = 0x0002
 
     //FRAM                    : origin = 0xF840, length = 0x0790
-    FRAM                    : origin = 0xF868, length = 0x0068
-    FRAM_CODE               : origin = 0xF8D0, length = 0x0700  // code area, can be increased /  decreased with FRAM, FRAM + FRAM_CODE = 0x768
+    // data at fixed addresses (#pragma location in main.c and temperature_table.h), kept out of FRAM_CODE
+    FRAM                    : origin = 0xF868, length = 0x0018  // NDEF message, blocks 1 to 3
+    SAMPLE_LOG              : origin = 0xF880, length = 0x0108  // SAMPLE_LOG_ADDRESS, blocks 4 to 36
+    PERF_COUNTERS           : origin = 0xF988, length = 0x0010  // PERF_COUNTERS_ADDRESS, blocks 37 and 38
+    SIGNATURE               : origin = 0xF998, length = 0x0008  // block 39, written by the app
+    TEMPERATURE_TABLE       : origin = 0xF9A0, length = 0x0102  // TEMPERATURE_TABLE_ADDRESS, from block 40
+    ACTIVE_TICKS            : origin = 0xFAA2, length = 0x0002  // ACTIVE_TICKS_ADDRESS, in block 72
+    PROFILE                 : origin = 0xFAA8, length = 0x0008  // PROFILE_ADDRESS, block 73
+    FRAM_CODE               : origin = 0xFAB0, length = 0x0520  // code area up to the signatures, holds the driver table at its end
     JTAGSIGNATURE           : origin = 0xFFD0, length = 0x0004, fill = 0xFFFF
     BSLSIGNATURE            : origin = 0xFFD4, length = 0x0004, fill = 0xFFFF
     INT00                   : origin = 0xFFE0, length = 0x0002
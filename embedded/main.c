@@ -39,23 +39,138 @@
 #include <rf430frl152h.h>
 #include <string.h>
 #include "types.h"
+#include "temperature_table.h"
+
+/* Optional commands, 1 builds one in. FRAM_CODE has room for one of them next to the custom and
+ * temperature commands and the sample log, by default the checksum command. "make -C host size"
+ * tells whether a selection fits. The host build enables all of them for the tests and benchmarks.
+ * The others are opt-in builds replacing the checksum command: next to it the estimate overflows by
+ * 45 bytes with the ratiometric command, 50 with the oversampling, 144 with the statistics and 44 with
+ * the stream command. */
+#ifndef CHECKSUM_COMMAND_ENABLED
+#define CHECKSUM_COMMAND_ENABLED        1           // 0xB6, see userChecksumCommand
+#endif
+#ifndef RATIOMETRIC_COMMAND_ENABLED
+#define RATIOMETRIC_COMMAND_ENABLED     0           // 0xB4, see userRatiometricCommand, opt-in
+#endif
+#ifndef OVERSAMPLING_COMMAND_ENABLED
+#define OVERSAMPLING_COMMAND_ENABLED    0           // 0xB5, see userOversamplingCommand, opt-in
+#endif
+#ifndef STATISTICS_COMMAND_ENABLED
+#define STATISTICS_COMMAND_ENABLED      0           // 0xB9, see userStatisticsCommand, opt-in
+#endif
+#ifndef STREAM_COMMAND_ENABLED
+#define STREAM_COMMAND_ENABLED          0           // 0xB8, see userStreamCommand, opt-in
+#endif
 
 //*****************************FUNCTION PROTOTYPES********************************/
 void DeviceInit(void);
 void initISO15693(u16_t parameters );
 void SetupSD14(unsigned char channel);
 void userCustomCommand();
+void userRatiometricCommand();
+void userOversamplingCommand();
+void userChecksumCommand();
+void userTemperatureCommand();
+void userStreamCommand();
+void AppendStreamSample(u16_t sample);
+void userStatisticsCommand();
+void AccumulateStatistics(u16_t sample);
+u16_t ConvertCustomSample(u16_t settings);
+s16_t RawToCentiCelsius(u16_t raw);
+u16_t FramChecksum(const u08_t *data, u16_t length);
+void StartOversampling(u16_t target);
+void StartRatiometric(void);
+void StartCustomConversion(u08_t state);
+void StartTemperatureConversion(void);
+void PublishTemperatureSample(u16_t sample);
+void AppendSampleLog(u16_t sample);
+void ConfigureSampleLog(void);
+void RunSampleLog(void);
+void SetupScheduler(void);
+void RunScheduler(void);
+void RunJob(u16_t index);
+void CommandReceived(void);
 //********************************************************************************/
-u16_t SamplesBuffer[4];
+u16_t SamplesBuffer[8];
 u08_t State;
 
+#define RATIOMETRIC_CHANNELS            3
+
+#if RATIOMETRIC_COMMAND_ENABLED
+u16_t RatiometricPending[RATIOMETRIC_CHANNELS];     // results of the running triple
+u08_t RatiometricIndex;                             // position of the running conversion within the triple
+#endif
+
+#if OVERSAMPLING_COMMAND_ENABLED
+u32_t OversamplingSum;                      // accumulator of the running oversampling
+u16_t OversamplingCount;                    // conversions accumulated by the running oversampling
+u16_t OversamplingTarget;                   // conversions requested for the running oversampling
+u32_t OversamplingResultSum;                // sum of the newest completed oversampling
+u16_t OversamplingResultCount;              // conversions in the newest completed oversampling
+u16_t OversamplingSequence;                 // completed oversamplings, zero while none completed
+#endif
+
+#if STREAM_COMMAND_ENABLED
+#define STREAM_BUFFER_SIZE              16          // power of two
+#define STREAM_MAX_SAMPLES              15          // what fits into NTX behind the flags and the sequence number
+#define STREAM_IDLE_LIMIT               64          // conversions without a request after which streaming stops
+
+u16_t StreamBuffer[STREAM_BUFFER_SIZE];     // ring buffer of the continuous conversions
+u16_t StreamSequence;                       // number of the newest sample, counts all streamed conversions
+u16_t StreamAvailable;                      // samples in the ring buffer since streaming started
+u16_t StreamIdleCount;                      // conversions since the last request
+#endif
+
+#if STATISTICS_COMMAND_ENABLED
+#define STATISTICS_SATURATED_HIGH       0xF000      // high word of the saturated sum of squares, a square is below 0x10000000
+
+u16_t StatisticsCount;                      // conversions in the running window
+u16_t StatisticsWindow;                     // conversions requested for the running window
+u16_t StatisticsMin;
+u16_t StatisticsMax;
+u16_t StatisticsFirst;                      // first conversion of the window, the deviations are taken from it
+u32_t StatisticsSum;                        // sum of the conversions, at most 0xFFFF * 0x3FFF
+u32_t StatisticsSquares;                    // sum of the squared deviations, stops growing once saturated
+#endif
+
 enum state_type
 {
     IDLE_STATE              						= 1,
-    ONE_SHOT_TEMP_REFERENCE_SAMPLE_STATE            = 2,
-    ONE_SHOT_TEMP_THERMISTOR_SAMPLE_STATE           = 3
+    SAMPLE_LOG_SAMPLE_STATE                         = 5,
+    OVERSAMPLING_STATE                              = 6,
+    STREAMING_STATE                                 = 7,
+    STATISTICS_STATE                                = 8,
+    RATIOMETRIC_STATE                               = 9,
+    TEMPERATURE_STATE                               = 10
+};
+
+/* Layout of SamplesBuffer
+ *
+ * The custom command, which also runs as a payload (see the driver section), keeps nothing here. The
+ * temperature command samples are double buffered: the SD14
+ * ISR always writes the slot which is not referenced by TEMPERATURE_SAMPLE_LATEST and only
+ * afterwards switches TEMPERATURE_SAMPLE_LATEST over and increments the sequence number. A sequence
+ * number of zero means no conversion completed yet.
+ */
+enum Samples_Buffer_Index
+{
+    REFERENCE_SAMPLE                    = 0,    // reference resistor conversion result
+    THERMISTOR_SAMPLE                   = 1,    // thermistor conversion result
+    INTERNAL_TEMPERATURE_SAMPLE         = 2,    // internal temperature sensor conversion result
+    RATIOMETRIC_SEQUENCE                = 3,    // number of completed ratiometric triples (wraps, skips zero)
+    TEMPERATURE_SAMPLE_SLOT_0           = 4,
+    TEMPERATURE_SAMPLE_SLOT_1           = 5,
+    TEMPERATURE_SAMPLE_LATEST           = 6,    // slot holding the newest temperature conversion
+    TEMPERATURE_SAMPLE_SEQUENCE         = 7     // number of completed temperature conversions (wraps, skips zero)
 };
 
+#define CUSTOM_SD14CTL1                 0xD043      // thermistor, fastest rate, what the app sends to the custom command
+#define CUSTOM_SD14CTL0                 (SD14EN + SD14SGL + VIRTGND)    // a single conversion, the SD14 stops by itself
+#define CUSTOM_COMMAND_SD14CTL0         (SD14EN + VIRTGND)  // continuous as in the original payload, the handler stops it
+#define CUSTOM_COMMAND_CYCLES           80000       // 40 ms at MCLK 2 MHz, the first result with CUSTOM_SD14CTL1 takes two conversions
+#define CUSTOM_COMMAND_SAMPLE           1           // status of an answer with a conversion of the request
+
 enum Channel_Types
 {
     ADC0_CHANNEL                        = 0x0,
@@ -64,11 +179,23 @@ enum Channel_Types
     REFERENCE_ADC1_CHANNEL              = 0x3,
 };
 
+#if RATIOMETRIC_COMMAND_ENABLED
+/* Order of the conversions of a ratiometric triple */
+const u08_t RatiometricChannels[RATIOMETRIC_CHANNELS] =
+{
+    REFERENCE_ADC1_CHANNEL, THERMISTOR_ADC2_CHANNEL, INTERNAL_TEMPERATURE_CHANNEL
+};
+#endif
+
 //*****************************DEFINES *******************************************/
 #define CLEAR_BLOCK_LOCKS                            	BIT3
 #define FRAM_LOCK_BLOCK_AREA_SIZE  						38
 #define FRAM_LOCK_BLOCKS								0xF840  //Address of ISO15693 lock blocks
 
+#ifndef FRAM_POINTER
+#define FRAM_POINTER(address)                           ((u08_t *) (address))   // the host build maps this into its memory image
+#endif
+
 
 #define ROM_EUSCI_SUPPORT_ENABLED       BIT2
 #define EROM_EUSCI_SUPPORT_DISABLED     0
@@ -135,17 +262,47 @@ typedef void(*DriverFunction)(void);
 #define DRIVER_TABLE_START 				0xFFCE               	// starting address for driver table
 #define DRIVER_TABLE_KEY  				0xCECE               	// identifier indicating start and end of driver table
 #define USER_CUSTOM_COMMAND_ID       	0x00AA               	// user custom command, range from A0 - D0
+#define USER_RATIOMETRIC_COMMAND_ID    	0x00B4               	// reference, thermistor and internal temperature in one frame
+#define USER_OVERSAMPLING_COMMAND_ID   	0x00B5               	// sum of N consecutive conversions
+#define USER_CHECKSUM_COMMAND_ID       	0x00B6               	// CRC-16/MCRF4XX of an FRAM range
+#define USER_TEMPERATURE_COMMAND_ID    	0x00B7               	// newest sample in centi-degrees Celsius
+#define USER_STREAM_COMMAND_ID         	0x00B8               	// newest samples of the continuous conversion
+#define USER_STATISTICS_COMMAND_ID     	0x00B9               	// min, max, mean and variance over a window of conversions
 
-#define NUMBER_OF_DRIVER_FUNCTIONS 		1                     	// we only driver two functions here
+#define NUMBER_OF_DRIVER_FUNCTIONS 		(2 + CHECKSUM_COMMAND_ENABLED + RATIOMETRIC_COMMAND_ENABLED + OVERSAMPLING_COMMAND_ENABLED + STATISTICS_COMMAND_ENABLED + STREAM_COMMAND_ENABLED)
+
+/*
+ * The payload builder (embedded/host/payload.c) deploys handlers onto a sensor whose interrupt
+ * vectors, main loop and timer stay with the sensor firmware. The custom and checksum commands
+ * therefore do all their work inside the handler and share no data with the ISRs of this file. The
+ * temperature command, the ratiometric, oversampling, statistics and stream commands as well as
+ * the sample log rely on the SD14 and Timer0_A ISRs and only work on a fully flashed image; the builder
+ * leaves out every handler sharing data with an ISR. Only the latter call CommandReceived().
+ *
+ * The optional commands follow the others without gaps, DRIVER_n of a disabled one is the slot of
+ * the next enabled one.
+ */
 //------------------------------------------------------------------------------
 #define DRIVER_1_COMMAND (DRIVER_TABLE_START-2)  				// DIGITAL_SENSOR_DRIVER_ID, see below
 #define DRIVER_1_ADDR    (DRIVER_TABLE_START-4)
 
-//#define DRIVER_2_COMMAND (DRIVER_1_ADDR-2)                		// INIT_DIGITAL_SENSOR_DRIVER_ID, see below
-//#define DRIVER_2_ADDR    (DRIVER_1_ADDR-4)
+#define DRIVER_2_COMMAND (DRIVER_1_ADDR-2)                		// USER_TEMPERATURE_COMMAND_ID, see below
+#define DRIVER_2_ADDR    (DRIVER_1_ADDR-4)
+
+#define DRIVER_3_COMMAND (DRIVER_2_ADDR-2)                		// USER_CHECKSUM_COMMAND_ID, see below
+#define DRIVER_3_ADDR    (DRIVER_2_ADDR-4)
 
-//#define DRIVER_3_COMMAND (DRIVER_2_ADDR-2)                		// INIT_DIGITAL_SENSOR_DRIVER_ID, see below
-//#define DRIVER_3_ADDR    (DRIVER_2_ADDR-4)
+#define DRIVER_4_COMMAND (DRIVER_3_COMMAND-4*CHECKSUM_COMMAND_ENABLED)		// USER_RATIOMETRIC_COMMAND_ID, see below
+#define DRIVER_4_ADDR    (DRIVER_3_ADDR-4*CHECKSUM_COMMAND_ENABLED)
+
+#define DRIVER_5_COMMAND (DRIVER_4_COMMAND-4*RATIOMETRIC_COMMAND_ENABLED)	// USER_OVERSAMPLING_COMMAND_ID, see below
+#define DRIVER_5_ADDR    (DRIVER_4_ADDR-4*RATIOMETRIC_COMMAND_ENABLED)
+
+#define DRIVER_6_COMMAND (DRIVER_5_COMMAND-4*OVERSAMPLING_COMMAND_ENABLED)	// USER_STATISTICS_COMMAND_ID, see below
+#define DRIVER_6_ADDR    (DRIVER_5_ADDR-4*OVERSAMPLING_COMMAND_ENABLED)
+
+#define DRIVER_7_COMMAND (DRIVER_6_COMMAND-4*STATISTICS_COMMAND_ENABLED)	// USER_STREAM_COMMAND_ID, see below
+#define DRIVER_7_ADDR    (DRIVER_6_ADDR-4*STATISTICS_COMMAND_ENABLED)
 
 #define DRIVER_TABLE_END  (DRIVER_TABLE_START-2-(NUMBER_OF_DRIVER_FUNCTIONS*4))
 //********************************************************************************/
@@ -197,17 +354,67 @@ const u16_t  CustomCommandID = USER_CUSTOM_COMMAND_ID;              					// the
 #pragma location = DRIVER_1_ADDR														// the location of the address
 const DriverFunction CustomCommandAddress = (DriverFunction)&userCustomCommand;     	// the location the function is in
 
-////Second ID, address pair?
-//#pragma RETAIN(Digital_Sensor_Driver_ID);
-//#pragma location = DRIVER_2_COMMAND
-//const u16_t  Digital_Sensor_Driver_ID = DIGITAL_SENSOR_DRIVER_ID;                    // the function identifier
-//
-//#pragma RETAIN(DigitalSensorMeasurementFunctionAddress);
-//#pragma location = DRIVER_2_ADDR
-//const DriverFunction DigitalSensorMeasurementFunctionAddress = (DriverFunction)&DigitalSensorMeasurement;   // the location the function is in
+//Second ID, address pair
+#pragma RETAIN(TemperatureCommandID);
+#pragma location = DRIVER_2_COMMAND
+const u16_t  TemperatureCommandID = USER_TEMPERATURE_COMMAND_ID;                    	// the function identifier
+
+#pragma RETAIN(TemperatureCommandAddress);
+#pragma location = DRIVER_2_ADDR
+const DriverFunction TemperatureCommandAddress = (DriverFunction)&userTemperatureCommand;	// the location the function is in
+
+//Optional ID, address pairs
+#if CHECKSUM_COMMAND_ENABLED
+#pragma RETAIN(ChecksumCommandID);
+#pragma location = DRIVER_3_COMMAND
+const u16_t  ChecksumCommandID = USER_CHECKSUM_COMMAND_ID;                          	// the function identifier
+
+#pragma RETAIN(ChecksumCommandAddress);
+#pragma location = DRIVER_3_ADDR
+const DriverFunction ChecksumCommandAddress = (DriverFunction)&userChecksumCommand;	// the location the function is in
+#endif
+
+#if RATIOMETRIC_COMMAND_ENABLED
+#pragma RETAIN(RatiometricCommandID);
+#pragma location = DRIVER_4_COMMAND
+const u16_t  RatiometricCommandID = USER_RATIOMETRIC_COMMAND_ID;                    	// the function identifier
+
+#pragma RETAIN(RatiometricCommandAddress);
+#pragma location = DRIVER_4_ADDR
+const DriverFunction RatiometricCommandAddress = (DriverFunction)&userRatiometricCommand;	// the location the function is in
+#endif
+
+#if OVERSAMPLING_COMMAND_ENABLED
+#pragma RETAIN(OversamplingCommandID);
+#pragma location = DRIVER_5_COMMAND
+const u16_t  OversamplingCommandID = USER_OVERSAMPLING_COMMAND_ID;                  	// the function identifier
+
+#pragma RETAIN(OversamplingCommandAddress);
+#pragma location = DRIVER_5_ADDR
+const DriverFunction OversamplingCommandAddress = (DriverFunction)&userOversamplingCommand;	// the location the function is in
+#endif
+
+#if STATISTICS_COMMAND_ENABLED
+#pragma RETAIN(StatisticsCommandID);
+#pragma location = DRIVER_6_COMMAND
+const u16_t  StatisticsCommandID = USER_STATISTICS_COMMAND_ID;                      	// the function identifier
+
+#pragma RETAIN(StatisticsCommandAddress);
+#pragma location = DRIVER_6_ADDR
+const DriverFunction StatisticsCommandAddress = (DriverFunction)&userStatisticsCommand;	// the location the function is in
+#endif
 
+#if STREAM_COMMAND_ENABLED
+#pragma RETAIN(StreamCommandID);
+#pragma location = DRIVER_7_COMMAND
+const u16_t  StreamCommandID = USER_STREAM_COMMAND_ID;                              	// the function identifier
 
-//Third ID, address pair?  If so, update NUMBER_OF_DRIVER_FUNCTIONS to 3...
+#pragma RETAIN(StreamCommandAddress);
+#pragma location = DRIVER_7_ADDR
+const DriverFunction StreamCommandAddress = (DriverFunction)&userStreamCommand;     	// the location the function is in
+#endif
+
+//Another ID, address pair?  If so, update NUMBER_OF_DRIVER_FUNCTIONS...
 
 //Ending key
 #pragma RETAIN(END_KEY);
@@ -251,6 +458,162 @@ const u08_t NFC_NDEF_Message[21] = {
 		0x00,		// Empty don't care
 };
 
+//------------------------------------------------------------------------------
+// Sample log section
+//------------------------------------------------------------------------------
+#define SAMPLE_LOG_ADDRESS              0xF880      // block 4, directly behind the NDEF message
+#define SAMPLE_LOG_ENTRIES              64          // must be a power of two
+
+/*******************************Sample Log Format*******************************/
+/*
+ *   Address	Block	Comment
+ *
+ *   0xF880     4       Header: interval, next, count, minutes of the newest sample (each 16 bit, little endian)
+ *   0xF888     5-36    64 entries: timestamp (minutes), sample (each 16 bit, little endian)
+ *
+ *   Logging is enabled by writing block 4 with a non-zero interval (in minutes) and zero for the
+ *   remaining fields. Entries are written round robin, 'next' is the index of the oldest entry
+ *   once 'count' reached SAMPLE_LOG_ENTRIES. All blocks are readable via read multiple blocks.
+ *   The header is picked up at the next timer event, or while no job keeps the timer running at
+ *   the next custom command which relies on the ISRs (see the driver section).
+ *****************************************************************************************/
+typedef struct
+{
+	u16_t timestamp;                        // minutes since logging was enabled
+	u16_t sample;                           // conversion with the measurement profile, by default CUSTOM_SD14CTL1
+} SampleLogEntry;
+
+typedef struct
+{
+	u16_t interval;                         // minutes between two samples, zero disables logging
+	u16_t next;                             // index of the entry written next
+	u16_t count;                            // number of entries written, saturates at 0xFFFF
+	u16_t minutes;                          // minutes from enabling the log to the newest sample
+	SampleLogEntry entries[SAMPLE_LOG_ENTRIES];
+} SampleLogType;
+
+#pragma PERSISTENT(SampleLog);
+#pragma location = SAMPLE_LOG_ADDRESS
+SampleLogType SampleLog = { 0 };
+
+//------------------------------------------------------------------------------
+// Performance counter section
+//------------------------------------------------------------------------------
+#define PERF_COUNTERS_ADDRESS           0xF988      // block 37, directly behind the sample log and in front of block 39
+
+/*****************************Performance Counter Format*****************************/
+/*
+ *   Address	Block	Comment
+ *
+ *   0xF988     37      conversions, wakeups (each 32 bit, little endian)
+ *   0xF990     38      overflows, commands, timer events, boots (each 16 bit, little endian)
+ *
+ *   0xFAA2     72      active ticks (16 bit, little endian), bytes 2 and 3 behind the temperature table
+ *
+ *   All counters wrap around, a reader compares two snapshots. They are updated in the hot paths
+ *   without disabling interrupts, so a 32 bit counter read while it carries may be off once.
+ *   The firmware never resets them, writing both blocks with zero does (and the two bytes of the
+ *   active ticks).
+ *
+ *   The active ticks add up the Timer0_A ticks (1 ms) between entering and leaving the SD14 ISR
+ *   and between the timer event and the scheduler restarting the timer, i.e. the time out of
+ *   LPM3 the firmware spends on its own. Only time while the scheduler timer runs is seen, and
+ *   with its resolution each stretch counts as a whole tick or none, so only the sum over many
+ *   wakeups is meaningful.
+ *****************************************************************************************/
+typedef struct
+{
+	u32_t conversions;                      // results of the SD14, all states
+	u32_t wakeups;                          // interrupts of the firmware leaving LPM3 (SD14 and Timer0_A0)
+	u16_t overflows;                        // SD14MEM0 overwritten before it was read
+	u16_t commands;                         // custom commands relying on the ISRs, see the driver section
+	u16_t timerEvents;                      // sample log timer compare events
+	u16_t boots;                            // runs of main, i.e. power ups with enough field to start
+} PerfCountersType;
+
+#pragma PERSISTENT(PerfCounters);
+#pragma location = PERF_COUNTERS_ADDRESS
+PerfCountersType PerfCounters = { 0 };
+
+#define ACTIVE_TICKS_ADDRESS            0xFAA2      // block 72, between the temperature table and FRAM_CODE
+
+#pragma PERSISTENT(ActiveTicks);
+#pragma location = ACTIVE_TICKS_ADDRESS
+u16_t ActiveTicks = 0;
+
+//------------------------------------------------------------------------------
+// Measurement profile section
+//------------------------------------------------------------------------------
+#define PROFILE_ADDRESS                 0xFAA8      // block 73, between the active ticks and FRAM_CODE
+
+/*****************************Measurement Profile Format*****************************/
+/*
+ *   Address	Comment
+ *
+ *   0xFAA8     SD14CTL1: channel, gain, rate, filter and interrupt delay as in the TI documentation
+ *   0xFAAA     Reserved, 3 x 16 bit
+ *
+ *   The profile sets the conversions StartCustomConversion starts, i.e. those of the sample log and
+ *   of the oversampling, statistics and stream commands. The rate of SD14CTL1 is the decimation
+ *   ratio of the SD14 filter and so the averaging, there is no room for averaging in the SD14 ISR
+ *   or for other clock dividers in FRAM_CODE.
+ *   The app switches profiles with a single write of block 73, it applies from the next start on.
+ *   The custom command converts with the settings of its request as it also has to work as a
+ *   payload, the temperature and ratiometric commands with their own as the lookup table and the
+ *   reader are made for these.
+ *****************************************************************************************/
+typedef struct
+{
+	u16_t sd14ctl1;                         // SD14CTL1 of the conversions
+	u16_t reserved[3];
+} MeasurementProfileType;
+
+#pragma PERSISTENT(Profile);
+#pragma location = PROFILE_ADDRESS
+MeasurementProfileType Profile = { CUSTOM_SD14CTL1, { 0 } };
+
+//------------------------------------------------------------------------------
+// Scheduler section
+//------------------------------------------------------------------------------
+#define SCHEDULER_TICKS_PER_MINUTE      60000       // Timer0_A counts ACLK / 64 = 1 kHz
+
+/*
+ * Periodic work runs as jobs of a scheduler counting minutes. Timer0_A wakes the device once a
+ * minute while a job is enabled and is stopped when none is, so the device only wakes up when
+ * there is something to do. Periods and deadlines are 16 bit minutes, the scheduler sees every
+ * minute and runs a job when its deadline equals the current minute, so any period up to 0xFFFF
+ * works across the wrap around. Jobs run from the main loop with interrupts disabled.
+ *
+ * The minute is what the hardware allows, not a choice: both dividers of Timer0_A are at their
+ * maximum (ID_3 and TAIDEX_7) and ACLK is shared with the SD14, so the 16 bit timer counts 1 kHz
+ * and reaches at most 65.5 s. A longer wake interval, like the greatest common divisor of the
+ * periods of the enabled jobs, would still need a wakeup per timer period. With a sample log
+ * interval of N minutes N - 1 wakeups only count the minute, each a Timer0_A ISR without register
+ * accesses (see "make -C host bench").
+ *
+ * RunJob() dispatches with a switch instead of a function pointer: the custom commands reach the
+ * scheduler via CommandReceived() and the payload builder can not follow indirect calls.
+ */
+typedef struct
+{
+	u16_t period;                           // minutes between two runs, zero disables the job
+	u16_t due;                              // SchedulerNow at the next run
+} SchedulerJob;
+
+enum Scheduler_Job_Index
+{
+    SAMPLE_LOG_JOB                      = 0,
+    NUMBER_OF_JOBS                      = 1
+};
+
+SchedulerJob Jobs[NUMBER_OF_JOBS] = {
+	{ 0, 0 },                               // SAMPLE_LOG_JOB
+};
+
+u16_t SchedulerNow;                         // minutes elapsed while the timer was running (wraps)
+u08_t SchedulerRunning;                     // whether Timer0_A wakes up the device every minute
+u08_t SchedulerTimerEvent;                  // set by the timer ISR for the main loop
+
 /*********************** SUMMARY **************************************************************************************************
  * This project only utilizes the RF stack (ISO15693) on the ROM of the RF430FRL15xH. This setup allows the user to make a
  * custom application that is run from FRAM.  Only the RF13M vector that runs the RF stack needs to be pointing to its
@@ -284,17 +647,24 @@ void main()
 
 	initISO15693(CLEAR_BLOCK_LOCKS);
 	DeviceInit();
+	PerfCounters.boots++;
+
+	State = IDLE_STATE;
+	SetupScheduler();
+	if (State == IDLE_STATE)
+	{
+		StartTemperatureConversion();       // so the first temperature command already finds a sample and triple
+	}
 
 	while(1)
 	{
-		State = ONE_SHOT_TEMP_REFERENCE_SAMPLE_STATE;
-		SetupSD14(REFERENCE_ADC1_CHANNEL);
-		__bis_SR_register(LPM3_bits + GIE); // sampling here two channels, SD14_ADC will wake up twice and store the conversions
-											// into samplesBuffer, last conversion will cause this LPM mode to be exited and continue to below.
-		//processing can be done on the stored conversions here
-		//  SamplesBuffer[0]  = reference resistor conversion result
-		//  SamplesBuffer[1]  = thermistor conversion result
-		__bis_SR_register(LPM3_bits + GIE);
+		__disable_interrupt();              // the timer ISR may have fired meanwhile
+		if (SchedulerTimerEvent)
+		{
+			SchedulerTimerEvent = 0;
+			RunScheduler();
+		}
+		__bis_SR_register(LPM3_bits + GIE); // the deepest mode possible, the timer and the SD14 run from ACLK
 		__no_operation();
 	}
 }
@@ -319,31 +689,103 @@ void SetupSD14(unsigned char channel)
 #pragma vector=SD_ADC_VECTOR
 interrupt void SD14_ADC (void)
 {
+	u16_t start = TA0R;
+
+	PerfCounters.wakeups++;
 	switch(__even_in_range(SD14IV,4))
 	{
 		case SD14IV__NONE: // no interrupt pending
 			break;
 		case SD14IV__OV: //SD14MEM overflow - SD14OVIFG
 			SD14CTL0 &= ~SD14OVIFG; // clear the overflow bit
+			PerfCounters.overflows++;
 			break;
 		case SD14IV__RES:
 			SD14CTL0 &= ~SD14IFG;   // clear the data available interrupt
-			if (State == ONE_SHOT_TEMP_REFERENCE_SAMPLE_STATE)
+			PerfCounters.conversions++;
+			if (State == SAMPLE_LOG_SAMPLE_STATE)
+			{
+				AppendSampleLog(SD14MEM0);
+				SD14CTL0 &= ~SD14EN; //disable the SD14 until the scheduler restarts it
+				State = IDLE_STATE;  //no need to wake up, stay in LPM3 until the next timer event
+			}
+#if OVERSAMPLING_COMMAND_ENABLED
+			else if (State == OVERSAMPLING_STATE)
+			{
+				OversamplingSum += SD14MEM0;    // the SD14 keeps converting, only accumulate here
+				if (++OversamplingCount >= OversamplingTarget)
+				{
+					SD14CTL0 &= ~SD14EN;
+					OversamplingResultSum = OversamplingSum;
+					OversamplingResultCount = OversamplingCount;
+					if (++OversamplingSequence == 0)
+					{
+						OversamplingSequence = 1;
+					}
+					State = IDLE_STATE;
+				}
+			}
+#endif
+#if STREAM_COMMAND_ENABLED
+			else if (State == STREAMING_STATE)
+			{
+				AppendStreamSample(SD14MEM0);   // the SD14 keeps converting
+				if (++StreamIdleCount >= STREAM_IDLE_LIMIT)
+				{
+					SD14CTL0 &= ~SD14EN;        // nobody is listening anymore
+					State = IDLE_STATE;
+				}
+			}
+#endif
+#if STATISTICS_COMMAND_ENABLED
+			else if (State == STATISTICS_STATE)
+			{
+				AccumulateStatistics(SD14MEM0); // the SD14 keeps converting
+				if (StatisticsCount >= StatisticsWindow)
+				{
+					SD14CTL0 &= ~SD14EN;        // the window is complete
+					State = IDLE_STATE;
+				}
+			}
+#endif
+#if RATIOMETRIC_COMMAND_ENABLED
+			else if (State == RATIOMETRIC_STATE)
 			{
-				State = ONE_SHOT_TEMP_THERMISTOR_SAMPLE_STATE;
-				SamplesBuffer[0] = SD14MEM0;            // compensation for thermistor current bias error
-				SetupSD14(THERMISTOR_ADC2_CHANNEL);              //setup ADC and start the conversion
+				RatiometricPending[RatiometricIndex] = SD14MEM0;
+				SD14CTL0 &= ~SD14EN;            // switch the channel with the SD14 stopped
+				if (++RatiometricIndex < RATIOMETRIC_CHANNELS)
+				{
+					SetupSD14(RatiometricChannels[RatiometricIndex]);
+					break;
+				}
+				SamplesBuffer[REFERENCE_SAMPLE] = RatiometricPending[0];
+				SamplesBuffer[THERMISTOR_SAMPLE] = RatiometricPending[1];
+				SamplesBuffer[INTERNAL_TEMPERATURE_SAMPLE] = RatiometricPending[2];
+				if (++SamplesBuffer[RATIOMETRIC_SEQUENCE] == 0)
+				{
+					SamplesBuffer[RATIOMETRIC_SEQUENCE] = 1;
+				}
+				State = IDLE_STATE;
 			}
-			else if (State == ONE_SHOT_TEMP_THERMISTOR_SAMPLE_STATE)
+#endif
+			else if (State == TEMPERATURE_STATE)
 			{
-				SamplesBuffer[1] = SD14MEM0;            // compensation for thermistor current bias error
-				SD14CTL0 &= ~SD14EN; //disable the SD14 until it is restarted if using consecutive readings by the timer
+				PublishTemperatureSample(SD14MEM0);
+				SD14CTL0 &= ~SD14EN; //switch the channel with the SD14 stopped
+#if RATIOMETRIC_COMMAND_ENABLED
+				StartRatiometric();  //the triple belonging to the sample, switches the SD14 off when done
+#else
 				State = IDLE_STATE;
-				//conversion completed, data available
-				__bic_SR_register_on_exit(LPM4_bits);  	//exit LPM mode after this interrupt
+#endif
 			}
 			break;
 	}
+	start = TA0R - start;
+	if (start >= SCHEDULER_TICKS_PER_MINUTE)
+	{
+		start += SCHEDULER_TICKS_PER_MINUTE;    // TA0R restarted at zero after TA0CCR0
+	}
+	ActiveTicks += start;
 }
 
 /**************************************************************************************************************************************************
@@ -405,7 +847,7 @@ void initISO15693(u16_t parameters )
   if (parameters & CLEAR_BLOCK_LOCKS )
   {
     //initializeBlockLocks();   //inline function
-    memset ((u08_t *) FRAM_LOCK_BLOCKS, 0xFF, FRAM_LOCK_BLOCK_AREA_SIZE);     //block is locked with a zero bit, clears FRAM and RAM lock blocks
+    memset (FRAM_POINTER(FRAM_LOCK_BLOCKS), 0xFF, FRAM_LOCK_BLOCK_AREA_SIZE);     //block is locked with a zero bit, clears FRAM and RAM lock blocks
   }
 }
 
@@ -413,7 +855,11 @@ void initISO15693(u16_t parameters )
 *  userCustomCommand
 ***************************************************************************************************************************************************
 *
-* Brief : This function is called by the RF stack whenever a custom command by its ID number is transmitted
+* Brief : This function is called by the RF stack whenever a custom command by its ID number is transmitted. The request
+*         carries the value for SD14CTL1 (channel and settings of the conversion, 16 bit little endian), the app sends
+*         CUSTOM_SD14CTL1 for the thermistor. The answer is the conversion followed by a status (16 bit each), the status is
+*         CUSTOM_COMMAND_SAMPLE for a conversion taken for this request and zero if the SD14 was busy with a conversion of the
+*         ISRs (only on a fully flashed image).
 *
 * Param[in] :   None
 *
@@ -427,22 +873,633 @@ void userCustomCommand()
 {
     /*
      * This function the only code customized for diafyt Lazarus.
+     *
+     * A reading is a single request: the handler converts and waits for the result itself, as the
+     * original payload did, and switches the SD14 off before answering. This needs no ISR and no RAM,
+     * so it also works as a payload, and neither the SD14 nor the bias current stay on after the
+     * request. The answer is delayed by the conversion (CUSTOM_COMMAND_CYCLES), which the reader has
+     * to wait for; NfcV transceive of Android does.
      */
-    
-    /* Initialization and start of the sd14 unit */
-    SD14CTL0 = SD14EN + VIRTGND;
-    SD14CTL0 |= SD14SC;
-    SD14CTL1 = 0xD043; // 1101000001000011 
+    u16_t settings = RF13MRXF_L;
+    u16_t status = 0;
+    u16_t sample = 0;
 
-    /* Wait for an interrupt to rewrite the sd14 register. ***/
-    __delay_cycles(1000);
+    settings |= (u16_t)RF13MRXF_L << 8;
+    if (!((SD14CTL0 & SD14EN) && (SD14CTL0 & SD14IE)))
+    {
+        sample = ConvertCustomSample(settings);
+        status = CUSTOM_COMMAND_SAMPLE;
+    }
 
-    /* Copy the result from the sd14 register to a variable. */
-    SamplesBuffer[0]=SD14MEM0;
+    /* Transmit the result via NFC */
+    RF13MTXF_L=0;
+    RF13MTXF=sample;
+    RF13MTXF=status;
+}
+
+/**************************************************************************************************************************************************
+*  userTemperatureCommand
+***************************************************************************************************************************************************
+*
+* Brief : The newest thermistor sample converted to centi-degrees Celsius (16 bit signed) on the sensor, followed by its sequence
+*         number (16 bit, both little endian). A sequence number of zero means no conversion completed yet.
+*
+*         The answer is sent at once, the request starts the conversion for the next one unless the SD14 is busy. The SD14 ISR
+*         publishes the result and takes a ratiometric triple right behind it (see userRatiometricCommand), main() takes the first
+*         sample at power up. So a single request gets a valid sample, taken after the previous request.
+*
+* Param[in] :   None
+*
+* Param[out]:   None
+*
+* Return        None
+**************************************************************************************************************************************************/
+void userTemperatureCommand()
+{
+    u16_t sample = SamplesBuffer[SamplesBuffer[TEMPERATURE_SAMPLE_LATEST]];
+
+    CommandReceived();
 
     /* Transmit the result via NFC */
     RF13MTXF_L=0;
-    RF13MTXF=SamplesBuffer[0];
+    RF13MTXF=(u16_t)RawToCentiCelsius(sample);
+    RF13MTXF=SamplesBuffer[TEMPERATURE_SAMPLE_SEQUENCE];
+
+    if (State == IDLE_STATE)
+    {
+        StartTemperatureConversion();
+    }
+}
+
+#if STREAM_COMMAND_ENABLED
+/**************************************************************************************************************************************************
+*  userStreamCommand
+***************************************************************************************************************************************************
+*
+* Brief : Burst readout of the continuous thermistor conversion. The request carries the number of samples K (8 bit, 0 or more
+*         than STREAM_MAX_SAMPLES mean as many as possible), the answer is the sequence number of the newest sample followed by
+*         up to K samples, oldest first (all 16 bit, little endian). The number of samples follows from the answer length, a
+*         reader detects gaps with the sequence number.
+*
+*         The first request starts the SD14 in continuous mode, the SD14 ISR fills a ring buffer. Streaming stops by itself once
+*         no request came for STREAM_IDLE_LIMIT conversions. Each stream starts with sequence number zero, so the first request
+*         after a pause gets no samples of the previous stream.
+*
+* Param[in] :   None
+*
+* Param[out]:   None
+*
+* Return        None
+**************************************************************************************************************************************************/
+void userStreamCommand()
+{
+    u16_t count = RF13MRXF_L;
+    u16_t index;
+
+    CommandReceived();
+    if (State != STREAMING_STATE)
+    {
+        StreamAvailable = 0;            // whatever is left belongs to an earlier stream
+        StreamSequence = 0;
+        if (State == IDLE_STATE)
+        {
+            StartCustomConversion(STREAMING_STATE);
+        }
+    }
+    StreamIdleCount = 0;
+
+    if (count == 0 || count > STREAM_MAX_SAMPLES)
+    {
+        count = STREAM_MAX_SAMPLES;
+    }
+    if (count > StreamAvailable)
+    {
+        count = StreamAvailable;
+    }
+
+    /* Transmit the result via NFC */
+    RF13MTXF_L=0;
+    RF13MTXF=StreamSequence;
+    for (index = StreamSequence - count + 1; count > 0; count--, index++)
+    {
+        RF13MTXF=StreamBuffer[index & (STREAM_BUFFER_SIZE - 1)];
+    }
+}
+#endif
+
+#if STATISTICS_COMMAND_ENABLED
+/**************************************************************************************************************************************************
+*  userStatisticsCommand
+***************************************************************************************************************************************************
+*
+* Brief : Summary of a window of continuous thermistor conversions, so a reader gets the aggregates in one short
+*         exchange instead of fetching every sample. The request carries the window size N (16 bit, little endian). The answer is the
+*         number of conversions so far, their minimum and maximum, the first conversion (all 16 bit), the sum of the conversions and
+*         the sum of the squares of their deviations from the first conversion (32 bit each, the latter is saturated at 0xF0000000 and
+*         above), all little endian. Minimum, maximum and the first conversion are only valid with a count above zero.
+*
+*         The reader divides out mean and variance: with n conversions, S and Q the sums and D = S - n * first, the mean is S / n and
+*         the sample variance (Q - D * D / n) / (n - 1). Taking the deviations from the first conversion keeps their squares small
+*         for a steady input, Q only saturates once the window spreads, e.g. 0xFFFF conversions deviating by 256 on average. Neither
+*         the firmware nor its SD14 ISR divide or use arithmetic beyond 32 bit.
+*
+*         A nonzero N resets the accumulators after answering and starts a new window of N conversions, an N of zero only reads the
+*         summary. While the window runs no other conversion (including the sample log) can start.
+*
+* Param[in] :   None
+*
+* Param[out]:   None
+*
+* Return        None
+**************************************************************************************************************************************************/
+void userStatisticsCommand()
+{
+    u16_t window = RF13MRXF_L;
+
+    window |= (u16_t)RF13MRXF_L << 8;
+
+    CommandReceived();
+
+    /* Transmit the result via NFC */
+    RF13MTXF_L=0;
+    RF13MTXF=StatisticsCount;
+    RF13MTXF=StatisticsMin;
+    RF13MTXF=StatisticsMax;
+    RF13MTXF=StatisticsFirst;
+    RF13MTXF=(u16_t)StatisticsSum;
+    RF13MTXF=(u16_t)(StatisticsSum >> 16);
+    RF13MTXF=(u16_t)StatisticsSquares;
+    RF13MTXF=(u16_t)(StatisticsSquares >> 16);
+
+    if (window == 0 || (State != IDLE_STATE && State != STATISTICS_STATE))
+    {
+        return;
+    }
+    StatisticsCount = 0;                    // the SD14 ISR resets the accumulators with the first conversion
+    StatisticsWindow = window;
+    if (State == IDLE_STATE)
+    {
+        StartCustomConversion(STATISTICS_STATE);
+    }
+    // otherwise the SD14 keeps converting, the new window starts with its next result
+}
+#endif
+
+#if RATIOMETRIC_COMMAND_ENABLED
+/**************************************************************************************************************************************************
+*  userRatiometricCommand
+***************************************************************************************************************************************************
+*
+* Brief : Conversions of the reference resistor, the thermistor and the internal temperature sensor taken back to back, so a reader
+*         can do ratiometric compensation with a single request. The answer is the newest completed triple followed by its sequence
+*         number (each 16 bit, little endian), a sequence number of zero means no triple completed yet.
+*
+*         Every temperature conversion is followed by a triple, so a request right after userTemperatureCommand answers with the
+*         triple belonging to the temperature sample just received. Otherwise this answers at once with the newest triple and
+*         starts the next one when the SD14 is idle, the SD14 ISR switches the channels and publishes the triple once all three
+*         conversions are done. Other measurements are not interrupted, the reader then gets the previous triple again, which
+*         the unchanged sequence number tells.
+*
+* Param[in] :   None
+*
+* Param[out]:   None
+*
+* Return        None
+**************************************************************************************************************************************************/
+void userRatiometricCommand()
+{
+    CommandReceived();
+
+    /* Transmit the results via NFC */
+    RF13MTXF_L=0;
+    RF13MTXF=SamplesBuffer[REFERENCE_SAMPLE];
+    RF13MTXF=SamplesBuffer[THERMISTOR_SAMPLE];
+    RF13MTXF=SamplesBuffer[INTERNAL_TEMPERATURE_SAMPLE];
+    RF13MTXF=SamplesBuffer[RATIOMETRIC_SEQUENCE];
+
+    if (State == IDLE_STATE)
+    {
+        StartRatiometric();
+    }
+}
+#endif
+
+#if OVERSAMPLING_COMMAND_ENABLED
+/**************************************************************************************************************************************************
+*  userOversamplingCommand
+***************************************************************************************************************************************************
+*
+* Brief : Boxcar decimation of N consecutive thermistor conversions. The request carries N (16 bit, little
+*         endian), the answer is the number of accumulated conversions (16 bit) followed by their sum (32 bit) and the sequence
+*         number of the result (16 bit, all little endian). Summing N conversions gains log2(N)/2 bits of resolution, the reader
+*         divides by the count.
+*
+*         Like userCustomCommand this answers at once with the newest completed result and starts the next one, the conversions
+*         are accumulated by the SD14 ISR. A count different from the requested N means no such result is available yet. The
+*         sequence number counts the completed results (zero while there is none), so a reader takes a result as fresh once it
+*         differs from the sequence number answering its first request, which started the run.
+*
+* Param[in] :   None
+*
+* Param[out]:   None
+*
+* Return        None
+**************************************************************************************************************************************************/
+void userOversamplingCommand()
+{
+    u16_t target = RF13MRXF_L;
+    target |= (u16_t)RF13MRXF_L << 8;
+
+    CommandReceived();
+    if (target == 0)
+    {
+        target = 1;
+    }
+
+    /* Transmit the result via NFC */
+    RF13MTXF_L=0;
+    if (OversamplingResultCount == target)
+    {
+        RF13MTXF=OversamplingResultCount;
+        RF13MTXF=(u16_t)OversamplingResultSum;
+        RF13MTXF=(u16_t)(OversamplingResultSum >> 16);
+    }
+    else
+    {
+        RF13MTXF=0;
+        RF13MTXF=0;
+        RF13MTXF=0;
+    }
+    RF13MTXF=OversamplingSequence;
+
+    if (State == IDLE_STATE)
+    {
+        StartOversampling(target);
+    }
+}
+#endif
+
+#if CHECKSUM_COMMAND_ENABLED
+/**************************************************************************************************************************************************
+*  userChecksumCommand
+***************************************************************************************************************************************************
+*
+* Brief : Checksum of an FRAM range so a reader can verify programmed code without reading it back. The request carries the start
+*         address and the length in bytes (both 16 bit, little endian), the answer is the CRC-16/MCRF4XX with reversed bits as computed
+*         by CRC.kt of the app (16 bit, little endian). A range outside of FRAM is answered with an error. It shares no data with
+*         the ISRs, so the payload carries it as well and the app verifies a payload with it.
+*
+* Param[in] :   None
+*
+* Param[out]:   None
+*
+* Return        None
+**************************************************************************************************************************************************/
+#define CHECKSUM_FRAM_START             0xF860          // block 0 as seen via ISO15693
+#define ISO15693_ERROR_FLAG             0x01
+#define ISO15693_BLOCK_NOT_AVAILABLE    0x10
+
+void userChecksumCommand()
+{
+    u16_t start = RF13MRXF_L;
+    u16_t length;
+
+    start |= (u16_t)RF13MRXF_L << 8;
+    length = RF13MRXF_L;
+    length |= (u16_t)RF13MRXF_L << 8;
+
+    /* The end may touch 0x10000 exactly, compare without overflowing */
+    if (start < CHECKSUM_FRAM_START || length > (u16_t)(0 - start))
+    {
+        RF13MTXF_L=ISO15693_ERROR_FLAG;
+        RF13MTXF_L=ISO15693_BLOCK_NOT_AVAILABLE;
+        return;
+    }
+
+    /* Transmit the result via NFC */
+    RF13MTXF_L=0;
+    RF13MTXF=FramChecksum(FRAM_POINTER(start), length);
+}
+
+/*  FramChecksum                                                                       *
+ *  The data and its length in bytes                                                   *
+ *  Function:  CRC-16/MCRF4XX (reflected polynomial 0x8408, initial value 0xFFFF) with *
+ *             the bits of the result reversed. The kernel handles a byte with shifts  *
+ *             and XORs instead of a table, which is as fast on the MSP430 and keeps   *
+ *             the handler free of FRAM constants so it can go into a payload.         */
+u16_t FramChecksum(const u08_t *data, u16_t length)
+{
+    u16_t crc = 0xFFFF;
+    u16_t reversed = 0;
+    u08_t i;
+
+    while (length--)
+    {
+        u08_t x = *data++ ^ (u08_t)crc;
+
+        x ^= x << 4;
+        crc = ((u16_t)x << 8 | crc >> 8) ^ (x >> 4) ^ ((u16_t)x << 3);
+    }
+    for (i = 0; i < 16; i++)
+    {
+        reversed = (reversed << 1) | (crc & 1);
+        crc >>= 1;
+    }
+    return reversed;
+}
+#endif
+
+/*  ConvertCustomSample                                                                *
+ *  The value for SD14CTL1 requested by the reader                                     *
+ *  Function:  Convert with the given settings without help of an ISR: start the SD14  *
+ *             like the original payload did, wait CUSTOM_COMMAND_CYCLES for the       *
+ *             result and switch the SD14 off again. Only called with the SD14 free.   */
+u16_t ConvertCustomSample(u16_t settings)
+{
+    u16_t sample;
+
+    SD14CTL0 = 0;                                 // SD14CTL1 may only change with the SD14 stopped
+    SD14CTL1 = settings;
+    SD14CTL0 = CUSTOM_COMMAND_SD14CTL0;
+    SD14CTL0 |= SD14SC;
+    __delay_cycles(CUSTOM_COMMAND_CYCLES);
+    sample = SD14MEM0;
+    SD14CTL0 = 0;                                 // stopped, flags cleared
+    return sample;
+}
+
+/*  RawToCentiCelsius                                                                  *
+ *  The conversion result with the custom command settings                             *
+ *  Function:  Thermistor temperature in centi-degrees Celsius. Interpolates linearly  *
+ *             in the table generated from the Steinhart-Hart coefficients of the app, *
+ *             no floating point and a fixed number of cycles.                         */
+s16_t RawToCentiCelsius(u16_t raw)
+{
+    u16_t index;
+    s32_t fraction;
+    s16_t low;
+
+    if (raw > 0x3FFF)
+    {
+        raw = 0x3FFF;                             // SD14MEM0 holds 14 bits
+    }
+    index = raw >> TEMPERATURE_TABLE_SHIFT;
+    fraction = raw & ((1 << TEMPERATURE_TABLE_SHIFT) - 1);
+    low = TemperatureTable[index];
+    return low + (s16_t)(((TemperatureTable[index + 1] - low) * fraction + (1 << (TEMPERATURE_TABLE_SHIFT - 1))) >> TEMPERATURE_TABLE_SHIFT);
+}
+
+#if OVERSAMPLING_COMMAND_ENABLED
+/*  StartOversampling                                                                  *
+ *  The number of conversions to accumulate                                            *
+ *  Function:  Let the SD14 convert continuously, the SD14 ISR accumulates and stops   *
+ *             it after the given number of conversions.                               */
+void StartOversampling(u16_t target)
+{
+    OversamplingSum = 0;
+    OversamplingCount = 0;
+    OversamplingTarget = target;
+    StartCustomConversion(OVERSAMPLING_STATE);
+}
+#endif
+
+#if RATIOMETRIC_COMMAND_ENABLED
+/*  StartRatiometric                                                                   *
+ *  Function:  Start the first conversion of a ratiometric triple with the SetupSD14   *
+ *             settings, the SD14 ISR takes it from there.                             */
+void StartRatiometric(void)
+{
+    State = RATIOMETRIC_STATE;
+    RatiometricIndex = 0;
+    SetupSD14(RatiometricChannels[0]);
+}
+#endif
+
+/*  StartCustomConversion                                                              *
+ *  The state the SD14 ISR uses to dispatch the results                                *
+ *  Function:  Let the SD14 convert continuously with the settings of the measurement  *
+ *             profile, the results are collected by the SD14 ISR. This takes the SD14 *
+ *             over from a free running conversion of the custom command.              */
+void StartCustomConversion(u08_t state)
+{
+    State = state;
+    SD14CTL1 = Profile.sd14ctl1;
+    SD14CTL0 = SD14IE + SD14EN + VIRTGND;
+    SD14CTL0 |= SD14SC;
+}
+
+/*  StartTemperatureConversion                                                         *
+ *  Function:  Start a single conversion with the custom command settings, the SD14    *
+ *             ISR publishes it for the temperature command and stops the SD14.        */
+void StartTemperatureConversion(void)
+{
+    State = TEMPERATURE_STATE;
+    SD14CTL1 = CUSTOM_SD14CTL1;
+    SD14CTL0 = SD14IE + CUSTOM_SD14CTL0;
+    SD14CTL0 |= SD14SC;
+}
+
+/*  PublishTemperatureSample                                                           *
+ *  The conversion result                                                              *
+ *  Function:  Write the result to the free slot of the double buffer, then make it    *
+ *             the latest and count it.                                                */
+void PublishTemperatureSample(u16_t sample)
+{
+    u16_t slot = TEMPERATURE_SAMPLE_SLOT_0;
+
+    if (SamplesBuffer[TEMPERATURE_SAMPLE_LATEST] == TEMPERATURE_SAMPLE_SLOT_0)
+    {
+        slot = TEMPERATURE_SAMPLE_SLOT_1;
+    }
+    SamplesBuffer[slot] = sample;
+    SamplesBuffer[TEMPERATURE_SAMPLE_LATEST] = slot;
+    if (++SamplesBuffer[TEMPERATURE_SAMPLE_SEQUENCE] == 0)
+    {
+        SamplesBuffer[TEMPERATURE_SAMPLE_SEQUENCE] = 1;
+    }
+}
+
+#if STREAM_COMMAND_ENABLED
+/*  AppendStreamSample                                                                 *
+ *  The conversion result to store                                                     *
+ *  Function:  Put a sample of the continuous conversion into the ring buffer.         */
+void AppendStreamSample(u16_t sample)
+{
+    StreamBuffer[++StreamSequence & (STREAM_BUFFER_SIZE - 1)] = sample;
+    if (StreamAvailable < STREAM_BUFFER_SIZE)
+    {
+        StreamAvailable++;
+    }
+}
+#endif
+
+#if STATISTICS_COMMAND_ENABLED
+/*  AccumulateStatistics                                                               *
+ *  The conversion result to add                                                       *
+ *  Function:  Update the running window, cheap enough for every conversion: no        *
+ *             division and a single 32 bit multiplication, all unsigned. The sum of    *
+ *             the squares stops growing once its high word is saturated, a 16 bit     *
+ *             comparison instead of a 32 bit overflow check.                          */
+void AccumulateStatistics(u16_t sample)
+{
+    u16_t deviation;
+    u32_t square;
+
+    if (StatisticsCount++ == 0)
+    {
+        StatisticsFirst = sample;
+        StatisticsMin = sample;
+        StatisticsMax = sample;
+        StatisticsSum = 0;
+        StatisticsSquares = 0;
+    }
+    deviation = sample - StatisticsFirst;
+    if (sample < StatisticsFirst)
+    {
+        deviation = StatisticsFirst - sample;
+    }
+    square = (u32_t)deviation * deviation;
+    StatisticsSum += sample;
+    if ((u16_t)(StatisticsSquares >> 16) < STATISTICS_SATURATED_HIGH)
+    {
+        StatisticsSquares += square;        // cannot wrap, the sum stays below 0xF0000000 + 0x10000000
+    }
+    if (sample < StatisticsMin)
+    {
+        StatisticsMin = sample;
+    }
+    if (sample > StatisticsMax)
+    {
+        StatisticsMax = sample;
+    }
+}
+#endif
+
+/*  SetupScheduler                                                                     *
+ *  Function:  Prepare Timer0_A for the scheduler and start it for the enabled jobs,   *
+ *             it keeps running in LPM3.                                               */
+void SetupScheduler(void)
+{
+    TA0CCTL0 = CCIE;                              // interrupt on reaching CCR0
+    TA0EX0 = TAIDEX_7;                            // further divide by 8
+    RunScheduler();
+}
+
+/*  RunScheduler                                                                       *
+ *  Function:  Run the jobs whose deadline is the current minute and restart the      *
+ *             timer for the next minute while a job is enabled, stop it otherwise.    *
+ *             Only to be called when a minute just ended or the timer is stopped.     */
+void RunScheduler(void)
+{
+    u08_t enabled = 0;
+    u16_t i;
+
+    ConfigureSampleLog();
+    for (i = 0; i < NUMBER_OF_JOBS; i++)
+    {
+        if (Jobs[i].period == 0)
+        {
+            continue;
+        }
+        if (Jobs[i].due == SchedulerNow)
+        {
+            Jobs[i].due = SchedulerNow + Jobs[i].period;
+            RunJob(i);
+        }
+        enabled = 1;
+    }
+
+    ActiveTicks += TA0R;                          // the minute ended when the timer woke up the device
+    if (!enabled)
+    {
+        TA0CTL = MC_0 + TACLR;                    // nothing to do until a reader shows up, TA0R reads zero
+        SchedulerRunning = 0;
+        return;
+    }
+    SchedulerRunning = 1;
+    TA0CCR0 = SCHEDULER_TICKS_PER_MINUTE - 1;
+    TA0CTL = TASSEL_1 + ID_3 + MC_1 + TACLR;      // ACLK divided by 8, up mode, the next minute starts now
+}
+
+/*  RunJob                                                                             *
+ *  The index of the job in Jobs                                                       *
+ *  Function:  Do the work of a job whose deadline passed.                             */
+void RunJob(u16_t index)
+{
+    switch (index)
+    {
+        case SAMPLE_LOG_JOB:
+            RunSampleLog();
+            break;
+        default:
+            break;
+    }
+}
+
+/*  CommandReceived                                                                    *
+ *  Function:  Bookkeeping at the start of the custom commands which rely on the ISRs. *
+ *             While the timer is stopped this is also when settings written via RF    *
+ *             are picked up.                                                          */
+void CommandReceived(void)
+{
+    PerfCounters.commands++;
+    if (!SchedulerRunning)
+    {
+        RunScheduler();
+    }
+}
+
+/*  ConfigureSampleLog                                                                 *
+ *  Function:  Derive the period of the sample log job from the header, which a reader *
+ *             may have rewritten via RF since the last run.                           */
+void ConfigureSampleLog(void)
+{
+    u16_t period = SampleLog.interval;
+
+    if (period != 0)
+    {
+        if (SampleLog.count == 0 && SampleLog.next == 0 && SampleLog.minutes == 0)
+        {
+            Jobs[SAMPLE_LOG_JOB].due = SchedulerNow;            // logging was (re-)enabled, sample right away
+        }
+        else if (Jobs[SAMPLE_LOG_JOB].period != period)
+        {
+            Jobs[SAMPLE_LOG_JOB].due = SchedulerNow + period;   // resumed after a reset or the interval changed
+        }
+    }
+    Jobs[SAMPLE_LOG_JOB].period = period;
+}
+
+/*  RunSampleLog                                                                       *
+ *  Function:  Job of the sample log, starts the conversion which the SD14 ISR appends *
+ *             to the log.                                                             */
+void RunSampleLog(void)
+{
+    if (SampleLog.count != 0 || SampleLog.next != 0 || SampleLog.minutes != 0)
+    {
+        SampleLog.minutes += SampleLog.interval;    // the first sample is taken when logging was enabled
+    }
+    if (State == IDLE_STATE)
+    {
+        StartCustomConversion(SAMPLE_LOG_SAMPLE_STATE);
+    }
+    // otherwise the SD14 is busy, this sample is skipped
+}
+
+/*  AppendSampleLog                                                                    *
+ *  The conversion result to store                                                     *
+ *  Function:  Append an entry to the FRAM ring buffer of the sample log.              */
+void AppendSampleLog(u16_t sample)
+{
+    u16_t next = SampleLog.next & (SAMPLE_LOG_ENTRIES - 1);   // the header is writable via RF, never trust it
+
+    SampleLog.entries[next].timestamp = SampleLog.minutes;
+    SampleLog.entries[next].sample = sample;
+    SampleLog.next = (next + 1) & (SAMPLE_LOG_ENTRIES - 1);
+    if (SampleLog.count != 0xFFFF)
+    {
+        SampleLog.count++;
+    }
 }
 
 //#pragma vector = RFPMM_VECTOR
@@ -485,10 +1542,15 @@ __interrupt void RF13M_ISR(void)
 //{
 //}
 //
-//#pragma vector = TIMER0_A0_VECTOR
-//__interrupt void TimerA0_ISR(void)
-//{
-//}
+#pragma vector = TIMER0_A0_VECTOR
+__interrupt void TimerA0_ISR(void)
+{
+	PerfCounters.wakeups++;
+	PerfCounters.timerEvents++;
+	SchedulerNow++;
+	SchedulerTimerEvent = 1;
+	__bic_SR_register_on_exit(LPM3_bits);  	// the main loop runs the due jobs
+}
 //
 //#pragma vector = UNMI_VECTOR
 //__interrupt void UNMI_ISR(void)
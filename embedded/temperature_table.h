@@ -0,0 +1,39 @@
+/*
+ * temperature_table.h
+ *
+ * Generated by host/table.c, regenerate with "make -C embedded/host table".
+ *
+ * Temperature in centi-degrees Celsius at every 128 counts of the thermistor
+ * conversion, for linear interpolation by RawToCentiCelsius() in main.c. The
+ * payload builder copies it from its fixed address (-d in host/Makefile).
+ */
+
+#ifndef TEMPERATURE_TABLE_H_
+#define TEMPERATURE_TABLE_H_
+
+#define TEMPERATURE_TABLE_SHIFT         7
+#define TEMPERATURE_TABLE_ENTRIES       129
+#define TEMPERATURE_TABLE_ADDRESS       0xF9A0
+
+#pragma location = TEMPERATURE_TABLE_ADDRESS
+static const s16_t TemperatureTable[TEMPERATURE_TABLE_ENTRIES] = {
+     11264,  10075,   9196,   8505,   7939,   7463,   7054,   6695,
+      6378,   6093,   5835,   5601,   5385,   5187,   5002,   4830,
+      4670,   4519,   4377,   4243,   4116,   3995,   3880,   3771,
+      3667,   3567,   3471,   3379,   3291,   3206,   3125,   3046,
+      2970,   2896,   2825,   2756,   2690,   2625,   2562,   2501,
+      2442,   2384,   2328,   2273,   2220,   2168,   2118,   2068,
+      2020,   1973,   1927,   1882,   1838,   1795,   1752,   1711,
+      1671,   1631,   1592,   1554,   1516,   1480,   1444,   1408,
+      1374,   1339,   1306,   1273,   1240,   1209,   1177,   1146,
+      1116,   1086,   1057,   1028,    999,    971,    944,    916,
+       889,    863,    837,    811,    786,    761,    736,    711,
+       687,    664,    640,    617,    594,    571,    549,    527,
+       505,    484,    463,    442,    421,    400,    380,    360,
+       340,    320,    301,    282,    263,    244,    225,    207,
+       189,    171,    153,    135,    118,    100,     83,     66,
+        49,     33,     16,      0,    -16,    -32,    -48,    -64,
+       -79
+};
+
+#endif